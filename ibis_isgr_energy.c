@@ -89,26 +89,249 @@
 
 #include "ibis_isgr_energy.h"
 
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyCalLoad
+ * DESCRIPTION:
+ *  Loads the MCEC, LUT2 or L2RE table of a DOL in the calibration, unless
+ *  it is still loaded from the previous Science Window of a batch
+ *  (ptr_entry->loaded, emptied by ibis_isgr_energyCalRelease).
+ * ERROR CODES:
+ *  DAL3IBIS error codes
+ *
+ * PARAMETERS:
+ *  ptr_cal_cache   ISGRI_energy_cal_cache_struct *  in/out  calibration
+ *  ptr_entry       ISGRI_energy_cal_cache_entry_struct *  in/out  table loaded
+ *  DOL              char *    in   DOL of the table (or index)
+ *  ptr_IBIS_events             in  events (OBT range)
+ *  dsName           char *    in   data structure name
+ *  openTable, readTable        in  DAL3IBIS functions of the table
+ *  chatter           int      in   verbosity level
+ * RETURN:            int     current status
+ ************************************************************************/
+static int ibis_isgr_energyCalLoad(ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                                   ISGRI_energy_cal_cache_entry_struct *ptr_entry,
+                                   char               *DOL,
+                                   IBIS_events_struct *ptr_IBIS_events,
+                                   char               *dsName,
+                                   int               (*openTable)(),
+                                   int               (*readTable)(),
+                                   int                 chatter,
+                                   int                 status)
+{
+    if (status != ISDC_OK) return status;
+
+    if (strcmp(ptr_entry->loaded, DOL) == 0) {
+        ptr_cal_cache->nReuses++;
+        if (chatter > 2)
+            RILlogMessage(NULL, Log_0, "%s: %s kept loaded", dsName, DOL);
+        return status;
+    }
+
+    ptr_entry->loaded[0]='\0';
+    status=DAL3IBIS_populate_DS_flexible(DOL, ptr_IBIS_events, &ptr_cal_cache->calibration, dsName,
+                                         openTable, readTable, chatter, status);
+    if (status != ISDC_OK) return status;
+
+    snprintf(ptr_entry->loaded, DAL_FILE_NAME_STRING, "%s", DOL);
+    ptr_cal_cache->nLoads++;
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyCalibrate
+ * DESCRIPTION:
+ *  Loads the calibration for the events: LUT1 corrected for the MDU
+ *  temperature and bias, MCEC, LUT2 and L2RE. LUT1 is corrected in place
+ *  for the HK of each Science Window, so it is read again each time, over
+ *  the one of the previous call. In batch mode (ptr_cal_cache->select,
+ *  set by ibis_isgr_energyBatch, the driver workers and the daemon), the
+ *  table of each DOL is selected here for the time range of the Science
+ *  Window (ibis_isgr_energyCalSelect) and loaded as a direct table; MCEC,
+ *  LUT2 and L2RE stay loaded as long as their table is the same. DAL3IBIS
+ *  frees the calibration as a whole only: when one of them changes, all
+ *  the tables are loaded again. A direct table copied in the calibration
+ *  snapshot is loaded from there. In a single run and in the library,
+ *  DAL3IBIS selects the tables of the DOLs itself, for the OBT range of
+ *  the events, and every table is loaded. Without HK group (hkGRP NULL),
+ *  LUT1 is not corrected for temperature and bias.
+ * ERROR CODES:
+ *  DAL3IBIS error codes
+ *  ibis_isgr_energyCalSelect() error codes
+ *
+ * PARAMETERS:
+ *  workGRP   dal_element *     in  working group (TSTART/TSTOP), or NULL
+ *  hkGRP     dal_element *     in  group of the converted HK, or NULL
+ *  ptr_IBIS_events             in  events (OBT range)
+ *  ptr_ISGRI_energy_caldb_dols in  calibration DOLs
+ *  ptr_cal_cache               in/out  calibration, tables selected
+ *  ptr_stats                   in/out  stages measured
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyCalibrate(dal_element *workGRP,
+                              dal_element *hkGRP,
+                              IBIS_events_struct *ptr_IBIS_events,
+                              ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                              ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                              ISGRI_energy_stats_struct *ptr_stats,
+                              int chatter,
+                              int status)
+{
+    int    haveTime;
+    double tStart = 0.,
+           tStop = 0.;
+    char  *lut1DOL=ptr_ISGRI_energy_caldb_dols->lut1_DOL,
+          *mcecDOL=ptr_ISGRI_energy_caldb_dols->mcec_DOL,
+          *lut2DOL=ptr_ISGRI_energy_caldb_dols->lut2_DOL,
+          *l2reDOL=ptr_ISGRI_energy_caldb_dols->l2re_DOL;
+
+    ISGRI_energy_calibration_struct *ptr_ISGRI_energy_calibration=&ptr_cal_cache->calibration;
+
+    TRY_BLOCK_BEGIN
+        /* in a single run, DAL3IBIS selects the tables */
+        haveTime= ptr_cal_cache->select && workGRP != NULL
+                  && ibis_isgr_energyScwTime(workGRP, &tStart, &tStop, ISDC_OK) == ISDC_OK;
+
+        if (haveTime) {
+            ibis_isgr_energyStatsBegin(ptr_stats, "calibration selection");
+            TRY( ibis_isgr_energyCalSelect(ptr_cal_cache, ptr_ISGRI_energy_caldb_dols, tStart, tStop, chatter, status), status, "selecting the calibration tables");
+            lut1DOL=ptr_cal_cache->lut1.member;
+            mcecDOL=ptr_cal_cache->mcec.member;
+            lut2DOL=ptr_cal_cache->lut2.member;
+            l2reDOL=ptr_cal_cache->l2re.member;
+            ibis_isgr_energyStatsEnd(ptr_stats, 0);
+        }
+
+        /* direct tables copied in the calibration snapshot */
+        if (ptr_ISGRI_energy_caldb_dols->lut1_snap[0] != '\0') lut1DOL=ptr_ISGRI_energy_caldb_dols->lut1_snap;
+        if (ptr_ISGRI_energy_caldb_dols->mcec_snap[0] != '\0') mcecDOL=ptr_ISGRI_energy_caldb_dols->mcec_snap;
+        if (ptr_ISGRI_energy_caldb_dols->lut2_snap[0] != '\0') lut2DOL=ptr_ISGRI_energy_caldb_dols->lut2_snap;
+        if (ptr_ISGRI_energy_caldb_dols->l2re_snap[0] != '\0') l2reDOL=ptr_ISGRI_energy_caldb_dols->l2re_snap;
+
+        if (!haveTime
+            || strcmp(ptr_cal_cache->mcec.loaded, mcecDOL) != 0
+            || strcmp(ptr_cal_cache->lut2.loaded, lut2DOL) != 0
+            || strcmp(ptr_cal_cache->l2re.loaded, l2reDOL) != 0) {
+            TRY( ibis_isgr_energyCalRelease(ptr_cal_cache, status), status, "freeing the previous calibration" );
+        }
+        if (!ptr_cal_cache->initialized) {
+            TRY( DAL3IBIS_init_ISGRI_energy_calibration(ptr_ISGRI_energy_calibration,status), status, "initializing ISGRI energy calibration");
+            ptr_cal_cache->initialized=1;
+        }
+
+        ibis_isgr_energyStatsBegin(ptr_stats, "LUT1");
+        ptr_cal_cache->lut1.loaded[0]='\0';
+        TRY( DAL3IBIS_populate_DS_flexible(lut1DOL, ptr_IBIS_events, ptr_ISGRI_energy_calibration, DS_ISGR_LUT1, &DAL3IBIS_open_LUT1, &DAL3IBIS_read_LUT1,chatter,status), status, "reading LUT1" );
+        snprintf(ptr_cal_cache->lut1.loaded, DAL_FILE_NAME_STRING, "%s", lut1DOL);
+        ibis_isgr_energyStatsEnd(ptr_stats, 0);
+
+        if (hkGRP != NULL) {
+            ibis_isgr_energyStatsBegin(ptr_stats, "LUT1 temperature bias");
+            TRY( DAL3IBIS_correct_LUT1_for_temperature_bias(hkGRP,ptr_ISGRI_energy_calibration, ptr_IBIS_events, chatter,status), status, "correcting for LUT1 temperature bias");
+            ibis_isgr_energyStatsEnd(ptr_stats, 0);
+        } else if (chatter > 1)
+            RILlogMessage(NULL, Log_1, "No HK: LUT1 not corrected for temperature and bias");
+
+        ibis_isgr_energyStatsBegin(ptr_stats, "MCEC");
+        TRY( ibis_isgr_energyCalLoad(ptr_cal_cache, &ptr_cal_cache->mcec, mcecDOL, ptr_IBIS_events, DS_ISGR_MCEC, &DAL3IBIS_open_MCEC, &DAL3IBIS_read_MCEC, chatter,status), status, "loading MCE evolution correction");
+        ibis_isgr_energyStatsEnd(ptr_stats, 0);
+
+        ibis_isgr_energyStatsBegin(ptr_stats, "LUT2");
+        TRY( ibis_isgr_energyCalLoad(ptr_cal_cache, &ptr_cal_cache->lut2, lut2DOL, ptr_IBIS_events, DS_ISGR_LUT2, &DAL3IBIS_open_LUT2, &DAL3IBIS_read_LUT2, chatter,status), status, "loading LUT2" );
+        ibis_isgr_energyStatsEnd(ptr_stats, 0);
+
+        ibis_isgr_energyStatsBegin(ptr_stats, "L2RE");
+        TRY( ibis_isgr_energyCalLoad(ptr_cal_cache, &ptr_cal_cache->l2re, l2reDOL, ptr_IBIS_events, DS_ISGR_L2RE, &DAL3IBIS_open_L2RE, &DAL3IBIS_read_L2RE, chatter,status), status, "loading LUT2 rapid evolution" );
+        ibis_isgr_energyStatsEnd(ptr_stats, 0);
+    TRY_BLOCK_END
+
+    /* a partly loaded calibration is not kept */
+    if (status != ISDC_OK)
+        ibis_isgr_energyCalRelease(ptr_cal_cache, ISDC_OK);
+
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyCorrectEvents
+ * DESCRIPTION:
+ *  Corrects the events in memory: loads the calibration if asked
+ *  (ibis_isgr_energyCalibrate) and reconstructs ISGRI_PI and ISGRI_ENERGY
+ *  (ibis_isgr_energyCorrect). The correction of ibis_isgr_energyWork
+ *  without streaming and of the library (ibis_isgr_energyLibCorrect).
+ * ERROR CODES:
+ *  ibis_isgr_energyCalibrate()   error codes
+ *  ibis_isgr_energyCorrect()     error codes
+ *
+ * PARAMETERS:
+ *  workGRP, hkGRP              in  as for ibis_isgr_energyCalibrate
+ *  ptr_IBIS_events             in/out  events, ISGRI_PI and ISGRI_ENERGY
+ *  ptr_ISGRI_energy_caldb_dols in  calibration DOLs
+ *  ptr_cal_cache               in/out  calibration
+ *  ptr_ibis_isgr_energy_settings  in  seed, nThreads, spectra
+ *  calibrate         int       in  0 to keep the loaded calibration
+ *  ptr_stats                   in/out  stages measured
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyCorrectEvents(dal_element *workGRP,
+                                  dal_element *hkGRP,
+                                  IBIS_events_struct *ptr_IBIS_events,
+                                  ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                                  ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                                  ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                                  int calibrate,
+                                  ISGRI_energy_stats_struct *ptr_stats,
+                                  int chatter,
+                                  int status)
+{
+    TRY_BLOCK_BEGIN
+        if (calibrate) {
+            TRY( ibis_isgr_energyCalibrate(workGRP,hkGRP,ptr_IBIS_events,ptr_ISGRI_energy_caldb_dols,ptr_cal_cache,ptr_stats,chatter,status), status, "loading the calibration" );
+        }
+
+        ibis_isgr_energyStatsBegin(ptr_stats, "reconstruction");
+        TRY( ibis_isgr_energyCorrect(&ptr_cal_cache->calibration,ptr_IBIS_events,ptr_ibis_isgr_energy_settings,0,ptr_ibis_isgr_energy_settings->nThreads,ptr_ibis_isgr_energy_settings->spectra,chatter,status), status, "reconstructing ISGRI energies" );
+        ibis_isgr_energyStatsEnd(ptr_stats, ptr_IBIS_events->numEvents);
+    TRY_BLOCK_END
+
+    return status;
+}
+
+
 /************************************************************************
  * FUNCTION:  ibis_isgr_energyWork
  * DESCRIPTION:
  *  Does the work, i.e. inputs data, reads calibration data, 
  *  computes corrected energies. Returns ISDC_OK if everything is fine,
  *  else returns an error code transmitted from the called function.
+ *  The calibration tables are loaded by ibis_isgr_energyCalibrate
+ *  (calPrefetch: read ahead while the events are read) and freed before
+ *  returning, unless kept in ptr_cal_cache. With streamRows > 0 the
+ *  events are handled by blocks (ibis_isgr_energyStream, or
+ *  ibis_isgr_energyPipeline), only inside the GTI with gtiRows. Every
+ *  stage is timed (ibis_isgr_energyStatsReport); the complete output
+ *  gets the stage keywords, the inputs fingerprint (incremental mode
+ *  only, where an up-to-date output is kept) and the stamp. Buffers come
+ *  from one arena released before returning. The options are described
+ *  in ibis_isgr_energy.txt.
  * ERROR CODES:
  *  DAL error codes
  *  I_ISGR_ERR_MEMORY             Memory allocation error
  *  ibis_isgr_energyCheckOut()    error codes
  *  ibis_isgr_energyCheckInNEW()  error codes
+ *  ibis_isgr_energySpectraWrite() error codes
  *
  * PARAMETERS:
  *  workGRP   dal_element *     in  DOL of the working group
+ *  ptr_cal_cache               in/out  calibration kept between calls
  * RETURN:            int     current status
  ************************************************************************/
 
 int ibis_isgr_energyWork(dal_element *workGRP,
                          ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
                          ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                         ISGRI_energy_cal_cache_struct *ptr_cal_cache,
                          int chatter,
                          int status)
 {
@@ -116,27 +339,123 @@ int ibis_isgr_energyWork(dal_element *workGRP,
            freeStatus= ISDC_OK;
     char  logString[DAL_BIG_STRING];
 
+    int    stream=(ptr_ibis_isgr_energy_settings->streamRows > 0);
+    dal_element *rawTable=NULL;
+
     IBIS_events_struct IBIS_events;
-    ISGRI_energy_calibration_struct ISGRI_energy_calibration;
+    ISGRI_energy_calibration_struct *ptr_ISGRI_energy_calibration=&ptr_cal_cache->calibration;
+    ISGRI_energy_stats_struct stats;
+    ISGRI_energy_arena_struct arena;
+    ISGRI_energy_rows_struct rows;
+    ISGRI_energy_prefetch_struct prefetch;
+
+    memset(&IBIS_events, 0, sizeof(IBIS_events));
+    memset(&prefetch, 0, sizeof(prefetch));
+    memset(&stats, 0, sizeof(stats));
+    memset(&arena, 0, sizeof(arena));
+
+    ptr_ibis_isgr_energy_settings->fingerprint[0]='\0';
+    if (ptr_ibis_isgr_energy_settings->incremental) {
+        status=ibis_isgr_energyFingerprint(workGRP, ptr_ibis_isgr_energy_settings, ptr_ISGRI_energy_caldb_dols,
+                                           ptr_ibis_isgr_energy_settings->fingerprint, chatter, status);
+    }
+    if (status == ISDC_OK && ptr_ibis_isgr_energy_settings->incremental
+        && ibis_isgr_energyUpToDate(workGRP, "ISGR-EVTS-COR", ptr_ibis_isgr_energy_settings->fingerprint)) {
+        if (ptr_ibis_isgr_energy_settings->spectraFile[0] == '\0'
+            || ibis_isgr_energySpectraHas(ptr_ibis_isgr_energy_settings->spectraFile,
+                                          ptr_ibis_isgr_energy_settings->fingerprint)) {
+            RILlogMessage(NULL, Log_2, "ISGR-EVTS-COR up to date (fingerprint %s): nothing to do",
+                          ptr_ibis_isgr_energy_settings->fingerprint);
+            return status;
+        }
+        RILlogMessage(NULL, Log_2, "ISGR-EVTS-COR up to date, but its spectra are not in %s: corrected again",
+                      ptr_ibis_isgr_energy_settings->spectraFile);
+    }
 
-    TRY_BLOCK_BEGIN
-        TRY( DAL3IBIS_read_IBIS_events(workGRP,ISGRI_EVTS,&IBIS_events,ptr_ibis_isgr_energy_settings->gti,chatter,status), -1, "reading events" );
+    ptr_ibis_isgr_energy_settings->arena=&arena;
 
-        TRY( DAL3IBIS_print_all_events(workGRP,status), status, "showing events" );
+    if (ptr_ibis_isgr_energy_settings->calPrefetch)
+        ibis_isgr_energyPrefetchStart(&prefetch, workGRP, ptr_ISGRI_energy_caldb_dols, ptr_cal_cache,
+                                      ptr_ibis_isgr_energy_settings->hkCnvDOL, chatter);
 
-        TRY( DAL3IBIS_init_ISGRI_energy_calibration(&ISGRI_energy_calibration,status), status, "initializing ISGRI energy calibration");
+    TRY_BLOCK_BEGIN
+        if (ptr_ibis_isgr_energy_settings->spectraFile[0] != '\0') {
+            ptr_ibis_isgr_energy_settings->spectra=
+                (ISGRI_energy_spectra_struct *)ibis_isgr_energyArenaAlloc(&arena, sizeof(ISGRI_energy_spectra_struct));
+            if (ptr_ibis_isgr_energy_settings->spectra == NULL)
+                FAIL(I_ISGR_ERR_MEMORY, "Cannot allocate the spectra");
+        }
 
-        TRY( DAL3IBIS_populate_DS_flexible(ptr_ISGRI_energy_caldb_dols->lut1_DOL, &IBIS_events, &ISGRI_energy_calibration, DS_ISGR_LUT1, &DAL3IBIS_open_LUT1, &DAL3IBIS_read_LUT1,chatter,status), status, "reading LUT1" );
-        TRY( DAL3IBIS_correct_LUT1_for_temperature_bias(workGRP,&ISGRI_energy_calibration, &IBIS_events, chatter,status), status, "correcting for LUT1 temperature bias");
+        if (stream) {
+            ibis_isgr_energyStatsBegin(&stats, "events header");
+            TRY( ibis_isgr_energyStreamHeader(workGRP,ptr_ibis_isgr_energy_settings->gti,&arena,&rows,&IBIS_events,&rawTable,chatter,status), status, "reading events header" );
+            if (ptr_ibis_isgr_energy_settings->gtiRows && ptr_ibis_isgr_energy_settings->gti)
+                ptr_ibis_isgr_energy_settings->rows=&rows;
+            ibis_isgr_energyStatsEnd(&stats, IBIS_events.numEvents);
+        } else {
+            ibis_isgr_energyStatsBegin(&stats, "read events");
+            TRY( DAL3IBIS_read_IBIS_events(workGRP,ISGRI_EVTS,&IBIS_events,ptr_ibis_isgr_energy_settings->gti,chatter,status), -1, "reading events" );
+            ibis_isgr_energyStatsEnd(&stats, IBIS_events.numEvents);
+
+            ibis_isgr_energyStatsBegin(&stats, "print events");
+            TRY( DAL3IBIS_print_all_events(workGRP,status), status, "showing events" );
+            ibis_isgr_energyStatsEnd(&stats, IBIS_events.numEvents);
+        }
 
-        TRY( DAL3IBIS_populate_DS_flexible(ptr_ISGRI_energy_caldb_dols->mcec_DOL, &IBIS_events, &ISGRI_energy_calibration, DS_ISGR_MCEC, &DAL3IBIS_open_MCEC, &DAL3IBIS_read_MCEC, chatter,status), status, "loading MCE evolution correction");
-        TRY( DAL3IBIS_populate_DS_flexible(ptr_ISGRI_energy_caldb_dols->lut2_DOL, &IBIS_events, &ISGRI_energy_calibration, DS_ISGR_LUT2, &DAL3IBIS_open_LUT2, &DAL3IBIS_read_LUT2, chatter,status), status, "loading LUT2" );
-        TRY( DAL3IBIS_populate_DS_flexible(ptr_ISGRI_energy_caldb_dols->l2re_DOL, &IBIS_events, &ISGRI_energy_calibration, DS_ISGR_L2RE, &DAL3IBIS_open_L2RE, &DAL3IBIS_read_L2RE, chatter,status), status, "loading LUT2 rapid evolution" );
+        if (prefetch.started) {
+            ibis_isgr_energyStatsBegin(&stats, "calibration read ahead");
+            ibis_isgr_energyPrefetchJoin(&prefetch, chatter);
+            ibis_isgr_energyStatsEnd(&stats, 0);
+        }
 
-        TRY( DAL3IBIS_reconstruct_ISGRI_energies(&ISGRI_energy_calibration,&IBIS_events,chatter,status), status, "reconstructing ISGRI energies" );
+        if (!stream) {
+            TRY( ibis_isgr_energyCorrectEvents(workGRP,workGRP,&IBIS_events,ptr_ISGRI_energy_caldb_dols,ptr_cal_cache,ptr_ibis_isgr_energy_settings,1,&stats,chatter,status), status, "correcting ISGRI energies" );
+        } else {
+            TRY( ibis_isgr_energyCalibrate(workGRP,workGRP,&IBIS_events,ptr_ISGRI_energy_caldb_dols,ptr_cal_cache,&stats,chatter,status), status, "loading the calibration" );
+
+            if (ptr_ibis_isgr_energy_settings->pipeline) {
+                ibis_isgr_energyStatsBegin(&stats, "pipeline");
+                TRY( ibis_isgr_energyPipeline(workGRP,rawTable,"ISGR-EVTS-COR",ptr_ISGRI_energy_calibration,&IBIS_events,ptr_ibis_isgr_energy_settings,chatter,status), status, "streaming ISGRI energies through the pipeline" );
+            } else {
+                ibis_isgr_energyStatsBegin(&stats, "stream");
+                TRY( ibis_isgr_energyStream(workGRP,rawTable,"ISGR-EVTS-COR",ptr_ISGRI_energy_calibration,&IBIS_events,ptr_ibis_isgr_energy_settings,chatter,status), status, "streaming ISGRI energies" );
+            }
+            ibis_isgr_energyStatsEnd(&stats, IBIS_events.numEvents);
+        }
     TRY_BLOCK_END
-    
-    status=ibis_isgr_energyCheckOut(&IBIS_events,workGRP,"ISGR-EVTS-COR",ptr_ibis_isgr_energy_settings,chatter,status);
+
+    ibis_isgr_energyPrefetchJoin(&prefetch, chatter);
+
+    if (status == ISDC_OK && !stream) {
+        ibis_isgr_energyStatsBegin(&stats, "CheckOut");
+        status=ibis_isgr_energyCheckOut(&IBIS_events,workGRP,"ISGR-EVTS-COR",ptr_ibis_isgr_energy_settings,chatter,status);
+        if (status == ISDC_OK) ibis_isgr_energyStatsEnd(&stats, IBIS_events.numEvents);
+    }
+
+    status=ibis_isgr_energyStampOut(workGRP, "ISGR-EVTS-COR", &stats,
+                                    ptr_ibis_isgr_energy_settings->fingerprint, status);
+    ibis_isgr_energyStatsReport(workGRP, &stats, status,
+                                ptr_ibis_isgr_energy_settings->statsFile, chatter, ISDC_OK);
+    if (ptr_ibis_isgr_energy_settings->stats != NULL)
+        *ptr_ibis_isgr_energy_settings->stats=stats;
+
+    if (ptr_ibis_isgr_energy_settings->spectra != NULL)
+        status=ibis_isgr_energySpectraWrite(ptr_ibis_isgr_energy_settings->spectraFile,
+                                            ptr_ibis_isgr_energy_settings->spectra, stats.swid,
+                                            ptr_ibis_isgr_energy_settings->fingerprint, chatter, status);
+
+    /* the columns of the blocks are in the arena */
+    if (!stream)
+        ibis_isgr_energyEventsFree(&IBIS_events);
+    ibis_isgr_energyArenaRelease(&arena, chatter);
+    /* in batch mode, the caller frees the calibration after the last group */
+    if (!ptr_cal_cache->select || status != ISDC_OK) {
+        freeStatus=ibis_isgr_energyCalRelease(ptr_cal_cache, ISDC_OK);
+        if (status == ISDC_OK) status=freeStatus;
+    }
+    ptr_ibis_isgr_energy_settings->arena=NULL;
+    ptr_ibis_isgr_energy_settings->rows=NULL;
+    ptr_ibis_isgr_energy_settings->spectra=NULL;
 
     if (status != ISDC_OK) {
         RILlogMessage(NULL, Error_2, "ibis_isgr_energyWork failed with status=%d", status);
@@ -144,10 +463,158 @@ int ibis_isgr_energyWork(dal_element *workGRP,
         RILlogMessage(NULL, Log_2, "ibis_isgr_energyWork succeeded with status=%d", status);
     }
 
+    return status;
+}
+
+
+
+
+
+
+/* IBIS_events_struct as this component knows it: the number of events,
+   the columns of ISGRI_EVENT_COLUMNS and the OBT range. A DAL3IBIS with
+   another event structure stops the compilation here, so that no column
+   is left out of the views and releases */
+#define EVENTS_LAYOUT_COLUMN(type, col, input)  type *col;
+typedef struct {
+    long   numEvents;
+    ISGRI_EVENT_COLUMNS(EVENTS_LAYOUT_COLUMN)
+    OBTime obtStart,
+           obtEnd;
+} ISGRI_energy_events_layout_struct;
+#undef EVENTS_LAYOUT_COLUMN
+
+typedef char ISGRI_energy_events_layout_check
+    [sizeof(ISGRI_energy_events_layout_struct) == sizeof(IBIS_events_struct) ? 1 : -1];
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyEventsView
+ * DESCRIPTION:
+ *  Fills a view on the rows first..first+numEvents-1 of an event list:
+ *  same Science Window information, every column of ISGRI_EVENT_COLUMNS
+ *  pointing inside the arrays of the full list. Nothing is copied or
+ *  allocated.
+ *
+ * PARAMETERS:
+ *  ptr_IBIS_events   IBIS_events_struct *   in   full event list
+ *  first             long     in   first row of the view (0-based)
+ *  numEvents         long     in   number of rows of the view
+ *  ptr_view          IBIS_events_struct *  out   view
+ ************************************************************************/
+void ibis_isgr_energyEventsView(IBIS_events_struct *ptr_IBIS_events,
+                                long                first,
+                                long                numEvents,
+                                IBIS_events_struct *ptr_view)
+{
+    *ptr_view=*ptr_IBIS_events;
+    ptr_view->numEvents=numEvents;
+
+#define EVENTS_VIEW_COLUMN(type, col, input) \
+    ptr_view->col = (ptr_IBIS_events->col == NULL) ? NULL : ptr_IBIS_events->col + first;
+
+    ISGRI_EVENT_COLUMNS(EVENTS_VIEW_COLUMN)
+
+#undef EVENTS_VIEW_COLUMN
+}
+
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyEventsFree
+ * DESCRIPTION:
+ *  Frees the columns of an event list allocated by
+ *  DAL3IBIS_read_IBIS_events (every column of ISGRI_EVENT_COLUMNS) and
+ *  sets them to NULL; the Science Window information is kept.
+ *  The columns come from the DAL allocator, so they are given back with
+ *  DALfreeDataBuffer, which also takes them off the list of
+ *  DAL_GC_free_all.
+ *
+ * PARAMETERS:
+ *  ptr_IBIS_events   IBIS_events_struct *   in/out  event list
+ ************************************************************************/
+void ibis_isgr_energyEventsFree(IBIS_events_struct *ptr_IBIS_events)
+{
+#define EVENTS_FREE_COLUMN(type, col, input) \
+    if (ptr_IBIS_events->col != NULL) \
+        DALfreeDataBuffer(ptr_IBIS_events->col, ISDC_OK); \
+    ptr_IBIS_events->col=NULL;
+
+    ISGRI_EVENT_COLUMNS(EVENTS_FREE_COLUMN)
+
+#undef EVENTS_FREE_COLUMN
+}
+
+
+
+
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyRowBytes
+ * DESCRIPTION:
+ *  Width of a row of the output table (NAXIS1), or of its two columns
+ *  if unknown.
+ ************************************************************************/
+long ibis_isgr_energyRowBytes(dal_element *outTable)
+{
+    long rowBytes = 0;
+
+    if (DALattributeGetInt(outTable, "NAXIS1", &rowBytes, NULL, NULL, ISDC_OK) != ISDC_OK
+        || rowBytes <= 0)
+        rowBytes=ISGRI_EVENT_OUT_BYTES;
+    return rowBytes;
+}
 
-    //status=DAL3IBIS_dealocate(&ISGRI_energy_calibration,status);
 
 
+
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyWriteRows
+ * DESCRIPTION:
+ *  Writes ISGRI_PI and ISGRI_ENERGY of rows firstRow..firstRow+numRows-1
+ *  (0-based), by chunks of rows filling half of the FITS I/O buffers
+ *  (ISGRI_OUT_CHUNK_BYTES): both columns of a chunk are written while
+ *  its rows are in the buffers, so every row of the file is written
+ *  once, also when the chunk does not start on a FITS block or other
+ *  HDUs use buffers.
+ * ERROR CODES:
+ *  DAL error codes
+ *
+ * PARAMETERS:
+ *  outTable  dal_element *   in    output table
+ *  firstRow         long     in    first row (0-based)
+ *  numRows          long     in    number of rows
+ *  isgriPi     DAL3_Byte *   in    ISGRI_PI of the rows
+ *  isgriEnergy     float *   in    ISGRI_ENERGY of the rows
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyWriteRows(dal_element *outTable,
+                              long         firstRow,
+                              long         numRows,
+                              DAL3_Byte   *isgriPi,
+                              float       *isgriEnergy,
+                              int          status)
+{
+    long  done,
+          chunkRows,
+          rows;
+
+    if (status != ISDC_OK) return status;
+
+    chunkRows=ISGRI_OUT_CHUNK_BYTES/ibis_isgr_energyRowBytes(outTable);
+    if (chunkRows < 1) chunkRows=1;
+
+    for (done=0; done < numRows && status == ISDC_OK; done+=chunkRows) {
+        rows=numRows-done;
+        if (rows > chunkRows) rows=chunkRows;
+        status=DALtablePutColBins(outTable, "ISGRI_PI",     0, DAL_BYTE,  firstRow+done+1,
+                                  rows, isgriPi+done, status);
+        status=DALtablePutColBins(outTable, "ISGRI_ENERGY", 0, DAL_FLOAT, firstRow+done+1,
+                                  rows, isgriEnergy+done, status);
+    }
     return status;
 }
 
@@ -157,10 +624,12 @@ int ibis_isgr_energyWork(dal_element *workGRP,
 
 
 /************************************************************************
- * FUNCTION:  ibis_isgr_energyCheckOut
+ * FUNCTION:  ibis_isgr_energyPrepareOut
  * DESCRIPTION:
- *  Checks for the presence and size of the output columns, add rows if
- * necessary. Copy the necessary attributes.
+ *  Checks for the presence and size of the output table, add rows if
+ * necessary. Copy the necessary attributes. With eraseALL, rows are only
+ * deleted and added again if their number changes, since all rows of
+ * the output columns are then rewritten.
  *  Returns ISDC_OK if everything is fine, else returns an error code.
  * ERROR CODES:
  *  DAL error codes
@@ -169,23 +638,23 @@ int ibis_isgr_energyWork(dal_element *workGRP,
  * PARAMETERS:
  *  workGRP  dal_element *    in    DOL of the working group
  *  outName         char *    in    bintable name of the output data
- *  chatter          int      in    verbosity level
  *  numEvents       long      in    length of the event list
  *  erase            int      in    0 to replace output columns, 1 to erase rows
+ *  outTable dal_element **  out    output table
+ *  chatter          int      in    verbosity level
  * RETURN:            int     current status
  ************************************************************************/
-int ibis_isgr_energyCheckOut(
-        IBIS_events_struct *ptr_IBIS_events,
+int ibis_isgr_energyPrepareOut(
         dal_element *workGRP,
         char         *outName,
+        long          numEvents,
         ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+        dal_element **outTable,
         int           chatter,
         int           status
         )
 {
     long  outRow;
-    dal_element *c_outTable;
-    dal_element **outTable = &c_outTable;
 
 
     do {
@@ -200,7 +669,13 @@ int ibis_isgr_energyCheckOut(
 
         if (outRow > 0l) {
 
-            if (ptr_ibis_isgr_energy_settings->erase) {
+            if (ptr_ibis_isgr_energy_settings->erase && outRow == numEvents) {
+                /* all rows of both columns are written: nothing to erase */
+                if (chatter > 1)
+                    RILlogMessage(NULL, Log_1, "Output table: %ld rows kept, %.0f bytes of I/O saved.",
+                            outRow, 2.*outRow*ibis_isgr_energyRowBytes(*outTable));
+            }
+            else if (ptr_ibis_isgr_energy_settings->erase) {
                 DALtableDelRows(*outTable, 1l, outRow, status);
                 if (status != ISDC_OK) {
                     RILlogMessage(NULL, Error_2, "Cannot delete all rows. Status=%d",
@@ -211,7 +686,7 @@ int ibis_isgr_energyCheckOut(
                 if (chatter > 1)
                     RILlogMessage(NULL, Log_1, "Output table: deleted OLD values.");
             }
-            else if (outRow != ptr_IBIS_events->numEvents) {
+            else if (outRow != numEvents) {
                 RILlogMessage(NULL, Error_2, "%13s has wrong length (%ld rows).",
                         outName, outRow);
                 status=I_ISGR_ERR_ISGR_OUT_COR;
@@ -221,7 +696,7 @@ int ibis_isgr_energyCheckOut(
         }
 
         if (outRow == 0l) {
-            status=DALtableAddRows(*outTable, 0l, ptr_IBIS_events->numEvents, status);
+            status=DALtableAddRows(*outTable, 0l, numEvents, status);
             if (status != ISDC_OK) {
                 RILlogMessage(NULL, Error_2, "Cannot ADD rows. Status=%d", status);
                 break;
@@ -237,13 +712,58 @@ int ibis_isgr_energyCheckOut(
             RILlogMessage(NULL, Error_2, "Could not copy ScW attributes");
             break;
         }
+
+        /* the fingerprint is set again once the output is complete */
+        status=DALattributePutChar(*outTable, KEY_FINGERPRINT, "", NULL,
+                "fingerprint of the inputs", status);
+
+    } while(0);
+    return status;
+}
+
+
+
+
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyCheckOut
+ * DESCRIPTION:
+ *  Prepares the output table and writes the output columns.
+ *  Returns ISDC_OK if everything is fine, else returns an error code.
+ * ERROR CODES:
+ *  DAL error codes
+ *  ibis_isgr_energyPrepareOut() error codes
+ *
+ * PARAMETERS:
+ *  ptr_IBIS_events          in    events with reconstructed energies
+ *  workGRP  dal_element *    in    DOL of the working group
+ *  outName         char *    in    bintable name of the output data
+ *  chatter          int      in    verbosity level
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyCheckOut(
+        IBIS_events_struct *ptr_IBIS_events,
+        dal_element *workGRP,
+        char         *outName,
+        ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+        int           chatter,
+        int           status
+        )
+{
+    dal_element *c_outTable;
+    dal_element **outTable = &c_outTable;
+
+
+    do {
+        status=ibis_isgr_energyPrepareOut(workGRP, outName, ptr_IBIS_events->numEvents,
+                ptr_ibis_isgr_energy_settings, outTable, chatter, status);
+        if (status != ISDC_OK) break;
             
         RILlogMessage(NULL, Log_0, "will write %li events",ptr_IBIS_events->numEvents, status);
 
-        status=DALtablePutCol(*outTable, "ISGRI_PI", 0, DAL_BYTE, ptr_IBIS_events->numEvents,
-                ptr_IBIS_events->isgri_pi, status);
-        status=DALtablePutCol(*outTable, "ISGRI_ENERGY", 0, DAL_FLOAT, ptr_IBIS_events->numEvents,
-                ptr_IBIS_events->isgri_energy, status);
+        status=ibis_isgr_energyWriteRows(*outTable, 0l, ptr_IBIS_events->numEvents,
+                ptr_IBIS_events->isgri_pi, ptr_IBIS_events->isgri_energy, status);
 
         if (status != ISDC_OK) {
             RILlogMessage(NULL, Error_2, "Cannot write output data. Status=%d", status);
@@ -251,10 +771,50 @@ int ibis_isgr_energyCheckOut(
             RILlogMessage(NULL, Log_0, "all done");
         }
 
-        status=CommonStampObject(*outTable, "Energy correction.", status);
-
     } while(0);
     return status;
 }
 
 
+
+
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyStampOut
+ * DESCRIPTION:
+ *  Completes the output table once all its rows are written: keywords
+ *  of the stages measured so far (ibis_isgr_energyStatsKeywords), the
+ *  fingerprint of the inputs, then the stamp. An interrupted run thus
+ *  leaves no fingerprint, and nothing is written after the stamp.
+ * ERROR CODES:
+ *  DAL error codes
+ *
+ * PARAMETERS:
+ *  workGRP  dal_element *    in    working group
+ *  outName         char *    in    bintable name of the output data
+ *  ptr_stats                 in    measured stages
+ *  fingerprint     char *    in    fingerprint of the inputs
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyStampOut(dal_element *workGRP,
+                             char        *outName,
+                             ISGRI_energy_stats_struct *ptr_stats,
+                             char        *fingerprint,
+                             int          status)
+{
+    dal_element *outTable = NULL;
+
+    if (status != ISDC_OK) return status;
+
+    status=DALobjectFindElement(workGRP, outName, &outTable, status);
+    status=ibis_isgr_energyStatsKeywords(outTable, ptr_stats, status);
+    status=DALattributePutChar(outTable, KEY_FINGERPRINT, fingerprint,
+                               NULL, "fingerprint of the inputs", status);
+    status=CommonStampObject(outTable, "Energy correction.", status);
+    if (status != ISDC_OK)
+        RILlogMessage(NULL, Error_2, "Cannot stamp %s. Status=%d", outName, status);
+    return status;
+}
+
+
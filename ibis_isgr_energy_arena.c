@@ -0,0 +1,122 @@
+/************************************************************************
+ * FILE:        ibis_isgr_energy_arena.c
+ * VERSION:     9.1
+ * COMPONENT:   ibis_isgr_energy
+ * AUTHOR:      V. Savchenko,   APC & ISDC
+ * DESCRIPTION: arena owning the buffers allocated by the component for one
+ *              Science Window: allocations are carved from large chunks and
+ *              all released at once at the end of ibis_isgr_energyWork
+ * HISTORY:
+ *   VS, 9.1  first version
+ ************************************************************************/
+
+#include "ibis_isgr_energy.h"
+
+
+/* chunk header, padded to keep the data aligned */
+#define ARENA_HEADER  ((sizeof(ISGRI_energy_arena_chunk_struct)+ISGRI_ARENA_ALIGN-1) \
+                       / ISGRI_ARENA_ALIGN * ISGRI_ARENA_ALIGN)
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyArenaAlloc
+ * DESCRIPTION:
+ *  Allocates size bytes, zeroed and aligned on ISGRI_ARENA_ALIGN, from
+ *  the arena. A new chunk of ISGRI_ARENA_CHUNK bytes (or more for a large
+ *  request) is added when the current one is full.
+ *
+ * PARAMETERS:
+ *  ptr_arena                  in/out  arena
+ *  size           size_t      in      bytes
+ * RETURN:         void *      the buffer, NULL if no memory
+ ************************************************************************/
+void *ibis_isgr_energyArenaAlloc(ISGRI_energy_arena_struct *ptr_arena,
+                                 size_t                     size)
+{
+    size_t  chunkSize;
+    char   *ptr;
+
+    ISGRI_energy_arena_chunk_struct *ptr_chunk=ptr_arena->chunks;
+
+    size=(size+ISGRI_ARENA_ALIGN-1)/ISGRI_ARENA_ALIGN*ISGRI_ARENA_ALIGN;
+    if (size == 0) size=ISGRI_ARENA_ALIGN;
+
+    if (ptr_chunk == NULL || ptr_chunk->used+size > ptr_chunk->size) {
+        chunkSize= size > ISGRI_ARENA_CHUNK ? size : ISGRI_ARENA_CHUNK;
+        ptr_chunk=NULL;
+        if (posix_memalign((void **)&ptr_chunk, ISGRI_ARENA_ALIGN, ARENA_HEADER+chunkSize) != 0)
+            return NULL;
+        ptr_chunk->next=ptr_arena->chunks;
+        ptr_chunk->size=chunkSize;
+        ptr_chunk->used=0;
+        ptr_arena->chunks=ptr_chunk;
+        ptr_arena->numChunks++;
+        ptr_arena->reserved+=chunkSize;
+        if (ptr_arena->reserved > ptr_arena->highWater) ptr_arena->highWater=ptr_arena->reserved;
+    }
+
+    ptr=(char *)ptr_chunk+ARENA_HEADER+ptr_chunk->used;
+    ptr_chunk->used+=size;
+    ptr_arena->used+=size;
+    ptr_arena->numAllocs++;
+    memset(ptr, 0, size);
+
+    return ptr;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyArenaMark / ibis_isgr_energyArenaRewind
+ * DESCRIPTION:
+ *  Rewind releases everything allocated since the mark, e.g. the
+ *  temporary buffers of one streaming block.
+ ************************************************************************/
+void ibis_isgr_energyArenaMark(ISGRI_energy_arena_struct      *ptr_arena,
+                               ISGRI_energy_arena_mark_struct *ptr_mark)
+{
+    ptr_mark->chunk=ptr_arena->chunks;
+    ptr_mark->used= ptr_arena->chunks == NULL ? 0 : ptr_arena->chunks->used;
+}
+
+void ibis_isgr_energyArenaRewind(ISGRI_energy_arena_struct      *ptr_arena,
+                                 ISGRI_energy_arena_mark_struct *ptr_mark)
+{
+    ISGRI_energy_arena_chunk_struct *ptr_chunk;
+
+    while (ptr_arena->chunks != NULL && ptr_arena->chunks != ptr_mark->chunk) {
+        ptr_chunk=ptr_arena->chunks;
+        ptr_arena->chunks=ptr_chunk->next;
+        ptr_arena->used-=ptr_chunk->used;
+        ptr_arena->reserved-=ptr_chunk->size;
+        ptr_arena->numChunks--;
+        free(ptr_chunk);
+    }
+    if (ptr_arena->chunks != NULL) {
+        ptr_arena->used-=ptr_arena->chunks->used-ptr_mark->used;
+        ptr_arena->chunks->used=ptr_mark->used;
+    }
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyArenaRelease
+ * DESCRIPTION:
+ *  Frees all the buffers of the arena; with chatter > 3 the number of
+ *  allocations and the high-water mark are logged.
+ ************************************************************************/
+void ibis_isgr_energyArenaRelease(ISGRI_energy_arena_struct *ptr_arena,
+                                  int                        chatter)
+{
+    ISGRI_energy_arena_mark_struct empty;
+
+    if (chatter > 3)
+        RILlogMessage(NULL, Log_0, "Arena: %ld buffers, %lu bytes in %d chunks, high-water %lu bytes",
+                      ptr_arena->numAllocs, (unsigned long)ptr_arena->used,
+                      ptr_arena->numChunks, (unsigned long)ptr_arena->highWater);
+
+    empty.chunk=NULL;
+    empty.used=0;
+    ibis_isgr_energyArenaRewind(ptr_arena, &empty);
+    ptr_arena->used=0;
+    ptr_arena->numAllocs=0;
+}
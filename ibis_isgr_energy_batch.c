@@ -0,0 +1,537 @@
+/************************************************************************
+ * FILE:        ibis_isgr_energy_batch.c
+ * VERSION:     9.1
+ * COMPONENT:   ibis_isgr_energy
+ * AUTHOR:      V. Savchenko,   APC & ISDC
+ * DESCRIPTION: batch processing of a list of Science Windows, with the
+ *              calibration tables selected once while they stay valid
+ * HISTORY:
+ *   VS, 9.1  batch mode and calibration cache
+ *   VS, 9.1  selection of all tables of a Science Window (calPrefetch)
+ *   VS, 9.1  file of a member of the group (outCompressed, calPrefetch)
+ *   VS, 9.1  compressed output written next to the member, not over it
+ ************************************************************************/
+
+#include <ctype.h>
+#include "fitsio.h"
+#include "ibis_isgr_energy.h"
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyScwTime
+ * DESCRIPTION:
+ *  Reads the time range (IJD) of the Science Window from the attributes
+ *  of the working group.
+ * ERROR CODES:
+ *  DAL error codes
+ *
+ * PARAMETERS:
+ *  workGRP   dal_element *     in  working group
+ *  tStart         double *    out  TSTART of the Science Window
+ *  tStop          double *    out  TSTOP of the Science Window
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyScwTime(dal_element *workGRP,
+                            double      *tStart,
+                            double      *tStop,
+                            int          status)
+{
+    if (status != ISDC_OK) return status;
+
+    status=DALattributeGetReal(workGRP, "TSTART", tStart, NULL, NULL, status);
+    status=DALattributeGetReal(workGRP, "TSTOP",  tStop,  NULL, NULL, status);
+    if (status != ISDC_OK)
+        RILlogMessage(NULL, Warning_1, "Cannot read TSTART/TSTOP of the Science Window. Status=%d", status);
+
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyCalMember
+ * DESCRIPTION:
+ *  Selects the calibration table of a DOL for a Science Window. A DOL
+ *  pointing directly to a table is used for any time: it is its own
+ *  member, with an unbounded validity. For an index (grouping table), the
+ *  member valid over the whole Science Window (VSTART <= tStart and
+ *  VSTOP >= tStop) with the highest VERSION, then the latest VSTART, is
+ *  selected, and the DOL of that table (file[extension number]) is
+ *  returned. In batch mode only, the member is then given to
+ *  DAL3IBIS_populate_DS_flexible as a direct table, so the table loaded
+ *  is the one selected here, and the same one is read ahead and kept in
+ *  the cache; a single run lets DAL3IBIS select it.
+ *  Without a valid member, the index DOL itself is returned with an
+ *  empty validity, to let DAL3IBIS report the missing table.
+ * ERROR CODES:
+ *  I_ISGR_ERR_CAL_INDEX      if the table or index cannot be read
+ *
+ * PARAMETERS:
+ *  DOL              char *    in   DOL of the table or of the index
+ *  dsName           char *    in   data structure name
+ *  tStart, tStop  double      in   time range of the Science Window (IJD)
+ *  member           char *   out   DOL of the table, DAL_FILE_NAME_STRING
+ *  vStart, vStop  double *   out   validity of the table (IJD)
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyCalMember(char   *DOL,
+                              char   *dsName,
+                              double  tStart,
+                              double  tStop,
+                              char   *member,
+                              double *vStart,
+                              double *vStop,
+                              int     status)
+{
+    int       fitsStatus = 0,
+              anyNull,
+              hduNum,
+              colStart,
+              colStop,
+              colVersion,
+              colName = 0,
+              version,
+              bestVersion = 0;
+    long      numRows = 0,
+              row,
+              best = 0;
+    double    start,
+              stop,
+              bestStart = 0.;
+    char      extName[FLEN_VALUE],
+              name[FLEN_VALUE],
+             *names[1],
+              fileName[FLEN_FILENAME];
+    fitsfile *indexPtr = NULL,
+             *memberPtr = NULL;
+
+    if (status != ISDC_OK) return status;
+
+    snprintf(member, DAL_FILE_NAME_STRING, "%s", DOL);
+    *vStart=-CAL_VALIDITY_UNBOUNDED;
+    *vStop = CAL_VALIDITY_UNBOUNDED;
+
+    names[0]=name;
+    extName[0]='\0';
+    fits_open_table(&indexPtr, DOL, READONLY, &fitsStatus);
+    fits_read_key(indexPtr, TSTRING, "EXTNAME", extName, NULL, &fitsStatus);
+    if (fitsStatus == 0 && strcmp(extName, "GROUPING") == 0) {
+        fits_get_num_rows(indexPtr, &numRows, &fitsStatus);
+        fits_get_colnum(indexPtr, CASEINSEN, "VSTART",  &colStart,   &fitsStatus);
+        fits_get_colnum(indexPtr, CASEINSEN, "VSTOP",   &colStop,    &fitsStatus);
+        fits_get_colnum(indexPtr, CASEINSEN, "VERSION", &colVersion, &fitsStatus);
+        if (fitsStatus == 0 && fits_get_colnum(indexPtr, CASEINSEN, "MEMBER_NAME", &colName, &fitsStatus) != 0) {
+            /* one kind of member only */
+            fitsStatus=0;
+            colName=0;
+        }
+
+        for (row=1; row <= numRows && fitsStatus == 0; row++) {
+            fits_read_col(indexPtr, TDOUBLE, colStart,   row, 1, 1, NULL, &start,   &anyNull, &fitsStatus);
+            fits_read_col(indexPtr, TDOUBLE, colStop,    row, 1, 1, NULL, &stop,    &anyNull, &fitsStatus);
+            fits_read_col(indexPtr, TINT,    colVersion, row, 1, 1, NULL, &version, &anyNull, &fitsStatus);
+            name[0]='\0';
+            if (colName > 0)
+                fits_read_col(indexPtr, TSTRING, colName, row, 1, 1, NULL, names, &anyNull, &fitsStatus);
+            if (fitsStatus != 0 || start > tStart || stop < tStop
+                || (colName > 0 && strcmp(name, dsName) != 0))
+                continue;
+            if (best == 0 || version > bestVersion || (version == bestVersion && start > bestStart)) {
+                best=row;
+                bestVersion=version;
+                bestStart=start;
+                *vStart=start;
+                *vStop=stop;
+            }
+        }
+
+        if (fitsStatus == 0 && best == 0)
+            *vStart=*vStop=0.;
+        if (fitsStatus == 0 && best > 0) {
+            fits_open_member(indexPtr, best, &memberPtr, &fitsStatus);
+            fits_file_name(memberPtr, fileName, &fitsStatus);
+            if (fitsStatus == 0) {
+                fits_get_hdu_num(memberPtr, &hduNum);
+                if (snprintf(member, DAL_FILE_NAME_STRING, "%s[%d]", fileName, hduNum-1) >= DAL_FILE_NAME_STRING)
+                    fitsStatus=FILE_NOT_OPENED;
+            }
+            if (memberPtr != NULL) fits_close_file(memberPtr, &fitsStatus);
+        }
+    }
+    if (indexPtr != NULL) fits_close_file(indexPtr, &fitsStatus);
+
+    if (fitsStatus != 0) {
+        RILlogMessage(NULL, Error_2, "%s: cannot select the table of %s (FITS status %d)",
+                      dsName, DOL, fitsStatus);
+        snprintf(member, DAL_FILE_NAME_STRING, "%s", DOL);
+        return I_ISGR_ERR_CAL_INDEX;
+    }
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyCalLookup
+ * DESCRIPTION:
+ *  Selects the table of a calibration DOL for the current Science Window
+ *  (ibis_isgr_energyCalMember), into the member of the entry. The member
+ *  of the previous Science Window is kept if it was selected for the same
+ *  DOL and its validity covers the Science Window; the index is then not
+ *  read again.
+ * ERROR CODES:
+ *  ibis_isgr_energyCalMember() error codes
+ *
+ * PARAMETERS:
+ *  ptr_cal_cache   ISGRI_energy_cal_cache_struct *  in/out  counters
+ *  ptr_entry       ISGRI_energy_cal_cache_entry_struct *  in/out  table
+ *  DOL              char *    in   DOL of the calibration table or index
+ *  dsName           char *    in   data structure name
+ *  tStart, tStop  double      in   time range of the Science Window (IJD)
+ *  chatter           int      in   verbosity level
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyCalLookup(ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                              ISGRI_energy_cal_cache_entry_struct *ptr_entry,
+                              char        *DOL,
+                              char        *dsName,
+                              double       tStart,
+                              double       tStop,
+                              int          chatter,
+                              int          status)
+{
+    if (status != ISDC_OK) return status;
+
+    if ( ptr_entry->resolved
+         && strcmp(ptr_entry->DOL, DOL) == 0
+         && tStart >= ptr_entry->vStart
+         && tStop  <= ptr_entry->vStop ) {
+        if (chatter > 2)
+            RILlogMessage(NULL, Log_0, "%s: %s still valid %.5f - %.5f",
+                          dsName, ptr_entry->member, ptr_entry->vStart, ptr_entry->vStop);
+        return status;
+    }
+
+    ptr_entry->resolved=0;
+    status=ibis_isgr_energyCalMember(DOL, dsName, tStart, tStop, ptr_entry->member,
+                                     &ptr_entry->vStart, &ptr_entry->vStop, status);
+    if (status != ISDC_OK) return status;
+
+    snprintf(ptr_entry->DOL, DAL_FILE_NAME_STRING, "%s", DOL);
+    ptr_entry->resolved=1;
+
+    if (chatter > 2)
+        RILlogMessage(NULL, Log_0, "%s: %s selected, valid %.5f - %.5f",
+                      dsName, ptr_entry->member, ptr_entry->vStart, ptr_entry->vStop);
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyCalSelect
+ * DESCRIPTION:
+ *  Selects the LUT1, MCEC, LUT2 and L2RE tables of the calibration DOLs
+ *  for the time range of the Science Window (ibis_isgr_energyCalLookup),
+ *  into the members of the cache. Used by ibis_isgr_energyCalibrate, and
+ *  before by ibis_isgr_energyPrefetchStart so that the tables read ahead
+ *  are the members loaded afterwards.
+ * ERROR CODES:
+ *  ibis_isgr_energyCalLookup() error codes
+ *
+ * PARAMETERS:
+ *  ptr_cal_cache   ISGRI_energy_cal_cache_struct *  in/out  tables selected
+ *  ptr_ISGRI_energy_caldb_dols  in  calibration DOLs
+ *  tStart, tStop  double      in   time range of the Science Window (IJD)
+ *  chatter           int      in   verbosity level
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyCalSelect(ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                              ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                              double       tStart,
+                              double       tStop,
+                              int          chatter,
+                              int          status)
+{
+    TRY_BLOCK_BEGIN
+        TRY( ibis_isgr_energyCalLookup(ptr_cal_cache, &ptr_cal_cache->lut1, ptr_ISGRI_energy_caldb_dols->lut1_DOL, DS_ISGR_LUT1, tStart, tStop, chatter, status), status, "selecting LUT1");
+        TRY( ibis_isgr_energyCalLookup(ptr_cal_cache, &ptr_cal_cache->mcec, ptr_ISGRI_energy_caldb_dols->mcec_DOL, DS_ISGR_MCEC, tStart, tStop, chatter, status), status, "selecting MCE evolution correction");
+        TRY( ibis_isgr_energyCalLookup(ptr_cal_cache, &ptr_cal_cache->lut2, ptr_ISGRI_energy_caldb_dols->lut2_DOL, DS_ISGR_LUT2, tStart, tStop, chatter, status), status, "selecting LUT2");
+        TRY( ibis_isgr_energyCalLookup(ptr_cal_cache, &ptr_cal_cache->l2re, ptr_ISGRI_energy_caldb_dols->l2re_DOL, DS_ISGR_L2RE, tStart, tStop, chatter, status), status, "selecting LUT2 rapid evolution");
+    TRY_BLOCK_END
+
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyCalRelease
+ * DESCRIPTION:
+ *  Frees the calibration tables loaded by DAL3IBIS (DAL3IBIS_dealocate).
+ *  The members selected are kept, the next call of
+ *  ibis_isgr_energyCalibrate loads all the tables again.
+ * ERROR CODES:
+ *  DAL3IBIS error codes
+ *
+ * PARAMETERS:
+ *  ptr_cal_cache   ISGRI_energy_cal_cache_struct *  in/out  calibration
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyCalRelease(ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                               int status)
+{
+    if (!ptr_cal_cache->initialized) return status;
+
+    status=DAL3IBIS_dealocate(&ptr_cal_cache->calibration, status);
+    memset(&ptr_cal_cache->calibration, 0, sizeof(ptr_cal_cache->calibration));
+    ptr_cal_cache->initialized=0;
+    ptr_cal_cache->lut1.loaded[0]='\0';
+    ptr_cal_cache->mcec.loaded[0]='\0';
+    ptr_cal_cache->lut2.loaded[0]='\0';
+    ptr_cal_cache->l2re.loaded[0]='\0';
+
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyOpenGroup
+ * DESCRIPTION:
+ *  Opens the Science Window group of a batch list as a single run does:
+ *  the DOL is given to inGRP and the group is prepared by
+ *  CommonPreparePARsStrings, so that inRawEvts and hkCnvDOL apply to
+ *  every group of the list. outGRP and outCorEvts are empty in batch
+ *  mode (get_all_PIL): the output of each group is updated in place.
+ * ERROR CODES:
+ *  PIL and DAL error codes
+ *
+ * PARAMETERS:
+ *  grpDOL           char *    in   DOL of the group
+ *  ptr_ibis_isgr_energy_settings  in/out  makeUnique, clobber
+ *  ptr_workGRP  dal_element **  out  working group
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyOpenGroup(char        *grpDOL,
+                              ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                              dal_element **ptr_workGRP,
+                              int          status)
+{
+    *ptr_workGRP=NULL;
+    if (status != ISDC_OK) return status;
+
+    status=PILPutString("inGRP", grpDOL);
+    status=CommonPreparePARsStrings("inGRP",
+                                    "inRawEvts,hkCnvDOL",
+                                    "outGRP",
+                                    "outCorEvts",
+                                    ptr_ibis_isgr_energy_settings->makeUnique,
+                                    ptr_workGRP,
+                                    &ptr_ibis_isgr_energy_settings->clobber,
+                                    status);
+    if (status != ISDC_OK)
+        RILlogMessage(NULL, Error_2, "Cannot open group %s. Status=%d", grpDOL, status);
+
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyGroupMember
+ * DESCRIPTION:
+ *  File of the member dsName of a group, read with cfitsio, so that the
+ *  file can be read or rewritten outside DAL. Members missing or
+ *  without EXTNAME are skipped.
+ *
+ * PARAMETERS:
+ *  grpDOL           char *    in   DOL of the group
+ *  dsName           char *    in   EXTNAME of the member
+ *  fileName         char *   out   its file, "" if none, DAL_FILE_NAME_STRING
+ ************************************************************************/
+void ibis_isgr_energyGroupMember(char *grpDOL,
+                                 char *dsName,
+                                 char *fileName)
+{
+    int       fitsStatus = 0;
+    long      numMembers = 0,
+              i;
+    char      extName[FLEN_VALUE];
+    fitsfile *groupPtr = NULL,
+             *memberPtr;
+
+    fileName[0]='\0';
+    fits_open_file(&groupPtr, grpDOL, READONLY, &fitsStatus);
+    fits_get_num_members(groupPtr, &numMembers, &fitsStatus);
+    for (i=1; i <= numMembers && fitsStatus == 0 && fileName[0] == '\0'; i++) {
+        memberPtr=NULL;
+        extName[0]='\0';
+        fits_open_member(groupPtr, i, &memberPtr, &fitsStatus);
+        fits_read_key(memberPtr, TSTRING, "EXTNAME", extName, NULL, &fitsStatus);
+        if (fitsStatus == 0 && strcmp(extName, dsName) == 0)
+            fits_file_name(memberPtr, fileName, &fitsStatus);
+        if (memberPtr != NULL) fits_close_file(memberPtr, &fitsStatus);
+        fitsStatus=0;
+    }
+    if (groupPtr != NULL) {
+        fitsStatus=0;
+        fits_close_file(groupPtr, &fitsStatus);
+    }
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyCompressOut
+ * DESCRIPTION:
+ *  With outCompressed, writes ISGR-EVTS-COR of the Science Window just
+ *  corrected, tile-compressed with energyTolerance, to the file of that
+ *  member with suffix ISGRI_COMPRESS_SUFFIX (ibis_isgr_energyCompressFile);
+ *  the member itself is left as DAL wrote it. Called once the group is
+ *  closed, so that DAL has written everything; the group is the one of
+ *  the run (outGRP, else inGRP, set for each Science Window in batch
+ *  mode). Nothing is done without outCompressed or after an error.
+ * ERROR CODES:
+ *  PIL error codes
+ *  I_ISGR_ERR_COMPRESS       if the output cannot be found or compressed
+ *
+ * PARAMETERS:
+ *  ptr_ibis_isgr_energy_settings  in  outCompressed, energyTolerance
+ *  chatter           int      in   verbosity level
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyCompressOut(ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                                int chatter,
+                                int status)
+{
+    char grpDOL[DAL_FILE_NAME_STRING],
+         fileName[DAL_FILE_NAME_STRING],
+         outName[DAL_FILE_NAME_STRING+8];
+
+    if (status != ISDC_OK || !ptr_ibis_isgr_energy_settings->outCompressed) return status;
+
+    status=PILGetString("outGRP", grpDOL);
+    if (status == ISDC_OK && grpDOL[0] == '\0')
+        status=PILGetString("inGRP", grpDOL);
+    if (status != ISDC_OK) return status;
+
+    ibis_isgr_energyGroupMember(grpDOL, "ISGR-EVTS-COR", fileName);
+    if (fileName[0] == '\0') {
+        RILlogMessage(NULL, Error_2, "No ISGR-EVTS-COR in %s to compress", grpDOL);
+        return I_ISGR_ERR_COMPRESS;
+    }
+
+    snprintf(outName, sizeof(outName), "%s%s", fileName, ISGRI_COMPRESS_SUFFIX);
+    return ibis_isgr_energyCompressFile(fileName, "ISGR-EVTS-COR", outName,
+                                        ptr_ibis_isgr_energy_settings->energyTolerance, chatter, status);
+}
+
+
+/* DOL of a line of the list of groups (trimmed), NULL if none */
+char *ibis_isgr_energyListEntry(char *line)
+{
+    char *grpName,
+         *end;
+
+    grpName=line;
+    while (isspace((unsigned char)*grpName)) grpName++;
+    end=grpName+strlen(grpName);
+    while (end > grpName && isspace((unsigned char)end[-1])) *--end='\0';
+    if (*grpName == '\0' || *grpName == '#') return NULL;
+
+    return grpName;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyBatch
+ * DESCRIPTION:
+ *  Processes every Science Window group listed in the ASCII file given
+ *  by the grpList setting (one DOL per line, '#' starts a comment).
+ *  Each group is opened as by a single run (ibis_isgr_energyOpenGroup).
+ *  The calibration tables selected in the indexes are kept (ptr_cal_cache)
+ *  between Science Windows, and an index is only searched again when the
+ *  next Science Window is outside the validity of its table; MCEC, LUT2
+ *  and L2RE stay loaded while their table does not change, and the
+ *  calibration is freed after the last group (by the daemon when it
+ *  stops, if the batch is a job of the daemon).
+ *  The output ISGR-EVTS-COR must already be present in each group. With
+ *  outCompressed, a compressed copy is written once the group is closed.
+ *  A failing Science Window is reported and the next one is processed;
+ *  the first error status is returned.
+ * ERROR CODES:
+ *  DAL error codes
+ *  I_ISGR_ERR_BATCH_LIST     if the list cannot be read or is empty
+ *  ibis_isgr_energyWork()    error codes
+ *  ibis_isgr_energyCompressOut() error codes
+ *
+ * PARAMETERS:
+ *  ptr_ibis_isgr_energy_settings  in  settings (grpList)
+ *  ptr_ISGRI_energy_caldb_dols    in  calibration DOLs
+ *  ptr_cal_cache                  in/out  calibration kept between calls
+ *  chatter           int      in   verbosity level
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyBatch(ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                          ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                          ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                          int chatter,
+                          int status)
+{
+    FILE        *listFile;
+    char         line[DAL_FILE_NAME_STRING],
+                *grpName;
+    long         numScw = 0,
+                 numFailed = 0;
+    int          scwStatus,
+                 kept,
+                 firstError = ISDC_OK;
+    dal_element *workGRP;
+
+    if (status != ISDC_OK) return status;
+
+    /* in the daemon, the calibration stays loaded for the next job */
+    kept=ptr_cal_cache->select;
+    ptr_cal_cache->select=1;
+
+    listFile=fopen(ptr_ibis_isgr_energy_settings->grpList, "r");
+    if (listFile == NULL) {
+        RILlogMessage(NULL, Error_2, "Cannot open list of groups %s",
+                      ptr_ibis_isgr_energy_settings->grpList);
+        return I_ISGR_ERR_BATCH_LIST;
+    }
+
+    while (fgets(line, DAL_FILE_NAME_STRING, listFile) != NULL) {
+
+        if ((grpName=ibis_isgr_energyListEntry(line)) == NULL) continue;
+
+        numScw++;
+        RILlogMessage(NULL, Log_1, "Science Window %ld: %s", numScw, grpName);
+
+        scwStatus=ibis_isgr_energyOpenGroup(grpName, ptr_ibis_isgr_energy_settings, &workGRP, ISDC_OK);
+        if (scwStatus == ISDC_OK) {
+            scwStatus=ibis_isgr_energyWork(workGRP, ptr_ibis_isgr_energy_settings,
+                                           ptr_ISGRI_energy_caldb_dols, ptr_cal_cache,
+                                           chatter, scwStatus);
+            scwStatus=CommonCloseSWG(workGRP, scwStatus);
+            scwStatus=ibis_isgr_energyCompressOut(ptr_ibis_isgr_energy_settings, chatter, scwStatus);
+        }
+
+        if (scwStatus != ISDC_OK) {
+            numFailed++;
+            if (firstError == ISDC_OK) firstError=scwStatus;
+        }
+    }
+    fclose(listFile);
+
+    if (numScw == 0) {
+        RILlogMessage(NULL, Error_2, "No group found in %s", ptr_ibis_isgr_energy_settings->grpList);
+        return I_ISGR_ERR_BATCH_LIST;
+    }
+
+    RILlogMessage(NULL, Log_1, "Batch: %ld Science Windows, %ld failed", numScw, numFailed);
+    if (chatter > 1)
+        RILlogMessage(NULL, Log_1, "Batch: %ld calibration tables loaded, %ld kept loaded",
+                      ptr_cal_cache->nLoads, ptr_cal_cache->nReuses);
+
+    if (!kept) {
+        status=ibis_isgr_energyCalRelease(ptr_cal_cache, status);
+        if (firstError == ISDC_OK) firstError=status;
+    }
+
+    return firstError;
+}
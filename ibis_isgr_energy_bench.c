@@ -0,0 +1,857 @@
+/************************************************************************
+ * FILE:        ibis_isgr_energy_bench.c
+ * VERSION:     9.1
+ * COMPONENT:   ibis_isgr_energy
+ * AUTHOR:      V. Savchenko,   APC & ISDC
+ * DESCRIPTION: micro-benchmark of the energy correction on synthetic events
+ *              in memory. With -cal, the stages of ibis_isgr_energyWork
+ *              done by DAL3IBIS are timed on those events: loading of
+ *              the LUT1, MCEC, LUT2 and L2RE tables of the DOLs given
+ *              (DAL3IBIS_populate_DS_flexible) and the reconstruction by
+ *              blocks (ibis_isgr_energyReconstruct, DAL3IBIS inside), with
+ *              the heap each stage keeps (all libraries, from mallinfo).
+ *              The temperature and bias correction of LUT1 needs HK and
+ *              is not timed here. The other stages are experiments on a
+ *              model of the per-event correction, timed and not adopted
+ *              ("exp."): LUT1 scalar, with vector dispatch and in pixel
+ *              order; fused kernels, generic and specialized per
+ *              calibration configuration; MCEC/L2RE per event and per
+ *              time block. Their checks compare forms of the same model,
+ *              not DAL3IBIS output; their bytes allocated are counted by
+ *              the bench.
+ * USAGE:
+ *   ibis_isgr_energy_bench [-cal lut1DOL mcecDOL lut2DOL l2reDOL] [numEvents [repeat [timeBlock]]]
+ *   make bench
+ * HISTORY:
+ *   VS, 9.1  first version
+ *   VS, 9.1  stages MCEC, LUT2, L2RE, blocks; bytes allocated
+ *   VS, 9.1  fused kernels specialized per calibration configuration
+ *   VS, 9.1  LUT2 in double precision and compact (16-bit, tiled)
+ *   VS, 9.1  time-dependent MCEC and L2RE, per event and per time block
+ *   VS, 9.1  fused kernels labelled as experiments
+ *   VS, 9.1  compact LUT2 removed (slower than the full table)
+ *   VS, 9.1  time-blocked MCEC/L2RE labelled as experiments
+ *   VS, 9.1  pixel sort moved here from ibis_isgr_energy_reorder.c
+ *   VS, 9.1  DAL3IBIS stages timed (-cal), model stages replacing them removed
+ ************************************************************************/
+
+#include <time.h>
+#include <math.h>
+#include <malloc.h>
+#include "ibis_isgr_energy.h"
+
+
+#define BENCH_N_MDU     8
+#define BENCH_MDU(y)    ((y)/16)          /* model: 16 rows of pixels per MDU */
+#define BENCH_T_REF     -8.0
+#define BENCH_BIAS_REF  -120.0
+
+/* model of the LUT1 step: offset and gain of the pixel, rise-time slope */
+#define BENCH_ENERGY(pha, rt, go) \
+    ((((pha) - (go)[0]) * (go)[1] + (go)[2]) * (1.0 + (go)[3]*(rt)) + (go)[4])
+
+#define BENCH_PI(energy) \
+    ((energy) < 0. ? 0 : (energy) >= 255. ? 255 : (DAL3_Byte)(energy))
+
+/* corrections applied by the fused kernel, known once per Science Window:
+   one variant compiled for each combination, without per-event tests */
+#define BENCH_KERNEL_MCEC   1         /* MDU temperature and bias, per event */
+#define BENCH_KERNEL_LUT2   2         /* rise-time table */
+#define BENCH_KERNEL_L2RE   4         /* rapid evolution and dithering */
+#define BENCH_N_KERNELS     8
+
+/* largest ISGRI_ENERGY difference allowed between the kernels, in ULP:
+   same operations in the same order, without contraction into FMA */
+#define BENCH_MAX_ULP 0
+
+/* time-dependent model: HK temperature and bias sampled every
+   BENCH_HK_PERIOD, L2RE drift given at nodes every BENCH_L2RE_PERIOD,
+   events in time order over BENCH_DURATION */
+#define BENCH_DURATION      3600      /* s */
+#define BENCH_HK_PERIOD     8         /* s */
+#define BENCH_L2RE_PERIOD   60        /* s */
+#define BENCH_N_HK          (BENCH_DURATION/BENCH_HK_PERIOD+2)
+#define BENCH_N_L2RE        (BENCH_DURATION/BENCH_L2RE_PERIOD+2)
+#define BENCH_TIME_BLOCK    1.0       /* s, default timeBlock */
+
+/* LUT1 with the MCEC factors, L2RE with its drift: no dithering, so that
+   the per-event and time-blocked coefficients can be compared */
+#define BENCH_TIME_ENERGY(pha, rt, go, gain, offset, l2re) \
+    (((((pha) - ((go)[0]+(offset))) * ((go)[1]*(gain)) + (go)[2]) \
+      * (1.0 + (go)[3]*(rt)) + (go)[4]) * (l2re))
+
+
+typedef struct {
+    long       numEvents;
+    DAL3_Word *isgriPha;
+    DAL3_Byte *riseTime,
+              *isgriY,
+              *isgriZ,
+              *scalarPi,
+              *lut1Pi,
+              *pixelPi,
+              *genericPi,
+              *kernelPi,
+              *eventPi,
+              *blockPi;
+    float     *scalarEnergy,
+              *lut1Energy,
+              *pixelEnergy,
+              *genericEnergy,
+              *kernelEnergy,
+              *eventEnergy,
+              *blockEnergy;
+    double    *eventTime,                 /* s from the start, increasing */
+               hkTime[BENCH_N_HK],
+               hkT[BENCH_N_HK][BENCH_N_MDU],
+               hkBias[BENCH_N_HK][BENCH_N_MDU],
+               l2reTime[BENCH_N_L2RE],
+               l2reDrift[BENCH_N_L2RE],
+               timeBlock;                 /* s, of the time-blocked stage */
+    double    *lut1Raw,                   /* synthetic LUT1 */
+              *lut1,                      /* after MCEC */
+               mcec[BENCH_N_MDU][2],      /* gain/temperature, offset/bias */
+               meanT[BENCH_N_MDU],
+               meanBias[BENCH_N_MDU],
+               mduGain[BENCH_N_MDU],       /* MCEC factors of the fused kernel */
+               mduOffset[BENCH_N_MDU];
+    float     *lut2,                      /* energy x rise time */
+              *l2re;                      /* rise time */
+    int        kernelFlags;               /* BENCH_KERNEL_* of the Science Window */
+    unsigned long long state;
+} ISGRI_energy_bench_struct;
+
+typedef struct {
+    char  *name;
+    void (*run)(ISGRI_energy_bench_struct *);
+} ISGRI_energy_bench_stage_struct;
+
+
+static size_t benchBytes = 0;
+
+/* allocations counted in the report */
+static void *ibis_isgr_energyBenchAlloc(size_t size)
+{
+    void *ptr=malloc(size);
+
+    if (ptr == NULL) {
+        fprintf(stderr, "cannot allocate %lu bytes\n", (unsigned long)size);
+        exit(I_ISGR_ERR_MEMORY);
+    }
+    benchBytes+=size;
+    return ptr;
+}
+
+static double ibis_isgr_energyBenchNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1.0e-9*ts.tv_nsec;
+}
+
+/* xorshift: reproducible synthetic data */
+static unsigned long ibis_isgr_energyBenchRand(unsigned long long *state)
+{
+    *state^=*state << 13;
+    *state^=*state >> 7;
+    *state^=*state << 17;
+    return (unsigned long)(*state >> 11);
+}
+
+/* distance between two floats in units in the last place */
+static long ibis_isgr_energyBenchUlp(float a, float b)
+{
+    int ia,
+        ib;
+
+    memcpy(&ia, &a, sizeof(int));
+    memcpy(&ib, &b, sizeof(int));
+    if (ia < 0) ia=(int)0x80000000-ia;
+    if (ib < 0) ib=(int)0x80000000-ib;
+    return ia > ib ? (long)ia-ib : (long)ib-ia;
+}
+
+
+/* counting sort of the events by pixel: order[] gets the event indices,
+   in time order inside a pixel, the events of pixel p are
+   order[pixStart[p]..pixStart[p+1]-1]; Y or Z out of range go to the
+   last bucket (ISGRI_N_PIX) */
+static void ibis_isgr_energyBenchPixelSort(long       numEvents,
+                                           DAL3_Byte *isgriY,
+                                           DAL3_Byte *isgriZ,
+                                           long      *order,
+                                           long      *pixStart)
+{
+    long i,
+         p;
+
+    memset(pixStart, 0, (ISGRI_N_PIX+2)*sizeof(long));
+    for (i=0; i < numEvents; i++)
+        pixStart[ISGRI_PIXEL(isgriY[i], isgriZ[i])+1]++;
+    for (p=0; p <= ISGRI_N_PIX; p++)
+        pixStart[p+1]+=pixStart[p];
+    for (i=0; i < numEvents; i++)
+        order[pixStart[ISGRI_PIXEL(isgriY[i], isgriZ[i])]++]=i;
+
+    /* the placement moved every start to the next bucket */
+    for (p=ISGRI_N_PIX+1; p > 0; p--)
+        pixStart[p]=pixStart[p-1];
+    pixStart[0]=0;
+}
+
+
+/* LUT1 kernel, compiled for several vector units, the best one chosen at
+   run time (GCC function multi-versioning). Only measured here: the loops
+   of the program are compiled for the default target until the bench
+   shows a gain */
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 6 \
+    && defined(__x86_64__) && defined(__linux__)
+__attribute__((target_clones("avx512f","avx2","default")))
+#endif
+static void ibis_isgr_energyBenchTime(long        numEvents,
+                                      const double *lut1,
+                                      const DAL3_Word *isgriPha,
+                                      const DAL3_Byte *riseTime,
+                                      const DAL3_Byte *isgriY,
+                                      const DAL3_Byte *isgriZ,
+                                      DAL3_Byte  *isgriPi,
+                                      float      *isgriEnergy)
+{
+    long   i;
+    double energy;
+
+    for (i=0; i < numEvents; i++) {
+        const double *ptr_go=lut1+ISGRI_PIXEL(isgriY[i], isgriZ[i])*ISGRI_GO_N_COL;
+        energy=BENCH_ENERGY(isgriPha[i], riseTime[i], ptr_go);
+        isgriEnergy[i]=(float)energy;
+        isgriPi[i]=BENCH_PI(energy);
+    }
+}
+
+
+/* same kernel, scalar reference */
+#if defined(__GNUC__) && !defined(__clang__)
+__attribute__((optimize("no-tree-vectorize")))
+#endif
+static void ibis_isgr_energyBenchTimeScalar(long        numEvents,
+                                            const double *lut1,
+                                            const DAL3_Word *isgriPha,
+                                            const DAL3_Byte *riseTime,
+                                            const DAL3_Byte *isgriY,
+                                            const DAL3_Byte *isgriZ,
+                                            DAL3_Byte  *isgriPi,
+                                            float      *isgriEnergy)
+{
+    long   i;
+    double energy;
+
+    for (i=0; i < numEvents; i++) {
+        const double *ptr_go=lut1+ISGRI_PIXEL(isgriY[i], isgriZ[i])*ISGRI_GO_N_COL;
+        energy=BENCH_ENERGY(isgriPha[i], riseTime[i], ptr_go);
+        isgriEnergy[i]=(float)energy;
+        isgriPi[i]=BENCH_PI(energy);
+    }
+}
+
+
+/* model LUT1 corrected for the mean temperature and bias of each MDU
+   (set up once for the LUT1 experiments, not timed) */
+static void ibis_isgr_energyBenchMcec(ISGRI_energy_bench_struct *ptr_bench)
+{
+    long    p,
+            k;
+    int     mdu;
+    double *go;
+
+    for (p=0; p <= ISGRI_N_PIX; p++) {
+        go=ptr_bench->lut1+p*ISGRI_GO_N_COL;
+        for (k=0; k < ISGRI_GO_N_COL; k++)
+            go[k]=ptr_bench->lut1Raw[p*ISGRI_GO_N_COL+k];
+        mdu=BENCH_MDU(p/128 < 128 ? p/128 : 127);
+        go[1]*=1.0 + ptr_bench->mcec[mdu][0]*(ptr_bench->meanT[mdu]-BENCH_T_REF);
+        go[0]+=ptr_bench->mcec[mdu][1]*(ptr_bench->meanBias[mdu]-BENCH_BIAS_REF);
+    }
+}
+
+static void ibis_isgr_energyBenchLut1Scalar(ISGRI_energy_bench_struct *ptr_bench)
+{
+    ibis_isgr_energyBenchTimeScalar(ptr_bench->numEvents, ptr_bench->lut1,
+                                    ptr_bench->isgriPha, ptr_bench->riseTime,
+                                    ptr_bench->isgriY, ptr_bench->isgriZ,
+                                    ptr_bench->scalarPi, ptr_bench->scalarEnergy);
+}
+
+static void ibis_isgr_energyBenchLut1(ISGRI_energy_bench_struct *ptr_bench)
+{
+    ibis_isgr_energyBenchTime(ptr_bench->numEvents, ptr_bench->lut1,
+                              ptr_bench->isgriPha, ptr_bench->riseTime,
+                              ptr_bench->isgriY, ptr_bench->isgriZ,
+                              ptr_bench->lut1Pi, ptr_bench->lut1Energy);
+}
+
+/* index k of the samples with times[k] <= t < times[k+1], in [0, numSamples-2] */
+static long ibis_isgr_energyBenchSearch(const double *times,
+                                        long          numSamples,
+                                        double        t)
+{
+    long low = 0,
+         high = numSamples-2,
+         middle;
+
+    while (low < high) {
+        middle=low+(high-low+1)/2;
+        if (times[middle] <= t) low=middle;
+        else high=middle-1;
+    }
+    return low;
+}
+
+/* MCEC factors of an MDU at time t, HK interpolated from sample k */
+static void ibis_isgr_energyBenchMcecAt(ISGRI_energy_bench_struct *ptr_bench,
+                                        long    k,
+                                        double  t,
+                                        int     mdu,
+                                        double *ptr_gain,
+                                        double *ptr_offset)
+{
+    double f=(t-ptr_bench->hkTime[k])/(ptr_bench->hkTime[k+1]-ptr_bench->hkTime[k]),
+           temp=(1.-f)*ptr_bench->hkT[k][mdu] + f*ptr_bench->hkT[k+1][mdu],
+           bias=(1.-f)*ptr_bench->hkBias[k][mdu] + f*ptr_bench->hkBias[k+1][mdu];
+
+    *ptr_gain=1.0 + ptr_bench->mcec[mdu][0]*(temp-BENCH_T_REF);
+    *ptr_offset=ptr_bench->mcec[mdu][1]*(bias-BENCH_BIAS_REF);
+}
+
+/* L2RE drift at time t, interpolated from node k */
+static double ibis_isgr_energyBenchDriftAt(ISGRI_energy_bench_struct *ptr_bench,
+                                           long   k,
+                                           double t)
+{
+    double f=(t-ptr_bench->l2reTime[k])/(ptr_bench->l2reTime[k+1]-ptr_bench->l2reTime[k]);
+
+    return (1.-f)*ptr_bench->l2reDrift[k] + f*ptr_bench->l2reDrift[k+1];
+}
+
+/* MCEC and L2RE evaluated at the time of every event: two searches and
+   two interpolations per event */
+static void ibis_isgr_energyBenchTimeEvent(ISGRI_energy_bench_struct *ptr_bench)
+{
+    long   i,
+           pixel;
+    int    mdu;
+    double t,
+           gain,
+           offset,
+           energy;
+
+    for (i=0; i < ptr_bench->numEvents; i++) {
+        t=ptr_bench->eventTime[i];
+        pixel=ISGRI_PIXEL(ptr_bench->isgriY[i], ptr_bench->isgriZ[i]);
+        mdu=BENCH_MDU(ptr_bench->isgriY[i]);
+        ibis_isgr_energyBenchMcecAt(ptr_bench, ibis_isgr_energyBenchSearch(ptr_bench->hkTime, BENCH_N_HK, t),
+                                    t, mdu, &gain, &offset);
+        energy=BENCH_TIME_ENERGY(ptr_bench->isgriPha[i], ptr_bench->riseTime[i],
+                                 ptr_bench->lut1Raw+pixel*ISGRI_GO_N_COL, gain, offset,
+                                 ptr_bench->l2re[ptr_bench->riseTime[i]]
+                                 * ibis_isgr_energyBenchDriftAt(ptr_bench,
+                                       ibis_isgr_energyBenchSearch(ptr_bench->l2reTime, BENCH_N_L2RE, t), t));
+        ptr_bench->eventEnergy[i]=(float)energy;
+        ptr_bench->eventPi[i]=BENCH_PI(0.5*energy);
+    }
+}
+
+/* MCEC and L2RE evaluated once per block of timeBlock seconds, at its
+   middle, with cursors that only move forward; the events of the block
+   reuse the coefficients */
+static void ibis_isgr_energyBenchTimeBlock(ISGRI_energy_bench_struct *ptr_bench)
+{
+    long   i = 0,
+           hk = 0,
+           node = 0,
+           pixel;
+    int    mdu;
+    double blockEnd,
+           middle,
+           drift,
+           energy,
+           gain[BENCH_N_MDU],
+           offset[BENCH_N_MDU];
+
+    while (i < ptr_bench->numEvents) {
+        blockEnd=ptr_bench->eventTime[i]+ptr_bench->timeBlock;
+        middle=ptr_bench->eventTime[i]+0.5*ptr_bench->timeBlock;
+        while (hk < BENCH_N_HK-2 && ptr_bench->hkTime[hk+1] <= middle) hk++;
+        while (node < BENCH_N_L2RE-2 && ptr_bench->l2reTime[node+1] <= middle) node++;
+        for (mdu=0; mdu < BENCH_N_MDU; mdu++)
+            ibis_isgr_energyBenchMcecAt(ptr_bench, hk, middle, mdu, &gain[mdu], &offset[mdu]);
+        drift=ibis_isgr_energyBenchDriftAt(ptr_bench, node, middle);
+
+        for (; i < ptr_bench->numEvents && ptr_bench->eventTime[i] < blockEnd; i++) {
+            pixel=ISGRI_PIXEL(ptr_bench->isgriY[i], ptr_bench->isgriZ[i]);
+            mdu=BENCH_MDU(ptr_bench->isgriY[i]);
+            energy=BENCH_TIME_ENERGY(ptr_bench->isgriPha[i], ptr_bench->riseTime[i],
+                                     ptr_bench->lut1Raw+pixel*ISGRI_GO_N_COL, gain[mdu], offset[mdu],
+                                     ptr_bench->l2re[ptr_bench->riseTime[i]]*drift);
+            ptr_bench->blockEnergy[i]=(float)energy;
+            ptr_bench->blockPi[i]=BENCH_PI(0.5*energy);
+        }
+    }
+}
+
+/* LUT1, MCEC, LUT2 and L2RE in one pass over the events; with constant
+   flags, the tests of the corrections disappear from the loop */
+static inline __attribute__((always_inline))
+void ibis_isgr_energyBenchFused(ISGRI_energy_bench_struct *ptr_bench,
+                                const int   flags,
+                                DAL3_Byte  *isgriPi,
+                                float      *isgriEnergy)
+{
+    long    i,
+            e,
+            pixel;
+    int     mdu;
+    double  energy,
+            x,
+            f;
+    float   corrected;
+
+    const double *ptr_go;
+
+    for (i=0; i < ptr_bench->numEvents; i++) {
+        pixel=ISGRI_PIXEL(ptr_bench->isgriY[i], ptr_bench->isgriZ[i]);
+        ptr_go=ptr_bench->lut1Raw+pixel*ISGRI_GO_N_COL;
+        if (flags & BENCH_KERNEL_MCEC) {
+            mdu=BENCH_MDU(pixel/128 < 128 ? pixel/128 : 127);
+            energy=(((ptr_bench->isgriPha[i] - (ptr_go[0]+ptr_bench->mduOffset[mdu]))
+                     * (ptr_go[1]*ptr_bench->mduGain[mdu]) + ptr_go[2])
+                    * (1.0 + ptr_go[3]*ptr_bench->riseTime[i]) + ptr_go[4]);
+        } else {
+            energy=BENCH_ENERGY(ptr_bench->isgriPha[i], ptr_bench->riseTime[i], ptr_go);
+        }
+        corrected=(float)energy;
+
+        if (flags & BENCH_KERNEL_LUT2) {
+            /* clamped to the table without branches */
+            x=corrected*(ISGRI_RT_N_ENER_SCALED/1024.);
+            x= x < 0. ? 0. : x;
+            x= x > ISGRI_RT_N_ENER_SCALED-2 ? ISGRI_RT_N_ENER_SCALED-2 : x;
+            e=(long)x;
+            f=x-e;
+            corrected=(float)(corrected
+                * ((1.-f)*ptr_bench->lut2[e*ISGRI_RT_N_DATA+ptr_bench->riseTime[i]]
+                   +    f*ptr_bench->lut2[(e+1)*ISGRI_RT_N_DATA+ptr_bench->riseTime[i]]));
+        }
+
+        energy=corrected;
+        if (flags & BENCH_KERNEL_L2RE)
+            energy=corrected*ptr_bench->l2re[ptr_bench->riseTime[i]]
+                  + (ibis_isgr_energyBenchRand(&ptr_bench->state) % 1024)/1024. - 0.5;
+        isgriEnergy[i]=(float)energy;
+        isgriPi[i]=BENCH_PI(0.5*energy);
+    }
+}
+
+/* generic kernel: the corrections are tested for every event */
+#if defined(__GNUC__) && !defined(__clang__)
+__attribute__((noinline, noclone, optimize("no-unswitch-loops")))
+#endif
+static void ibis_isgr_energyBenchGenericKernel(ISGRI_energy_bench_struct *ptr_bench,
+                                               int         flags,
+                                               DAL3_Byte  *isgriPi,
+                                               float      *isgriEnergy)
+{
+    ibis_isgr_energyBenchFused(ptr_bench, flags, isgriPi, isgriEnergy);
+}
+
+/* the specialized kernels, one per combination of BENCH_KERNEL_* */
+#define BENCH_KERNEL(flags) \
+static void ibis_isgr_energyBenchKernel##flags(ISGRI_energy_bench_struct *ptr_bench, \
+                                               DAL3_Byte *isgriPi, float *isgriEnergy) \
+{ \
+    ibis_isgr_energyBenchFused(ptr_bench, flags, isgriPi, isgriEnergy); \
+}
+BENCH_KERNEL(0) BENCH_KERNEL(1) BENCH_KERNEL(2) BENCH_KERNEL(3)
+BENCH_KERNEL(4) BENCH_KERNEL(5) BENCH_KERNEL(6) BENCH_KERNEL(7)
+#undef BENCH_KERNEL
+
+static void (*const benchKernels[BENCH_N_KERNELS])(ISGRI_energy_bench_struct *, DAL3_Byte *, float *) = {
+    ibis_isgr_energyBenchKernel0, ibis_isgr_energyBenchKernel1,
+    ibis_isgr_energyBenchKernel2, ibis_isgr_energyBenchKernel3,
+    ibis_isgr_energyBenchKernel4, ibis_isgr_energyBenchKernel5,
+    ibis_isgr_energyBenchKernel6, ibis_isgr_energyBenchKernel7
+};
+
+/* configuration of the Science Window: MCEC factors, tables present */
+static int ibis_isgr_energyBenchConfig(ISGRI_energy_bench_struct *ptr_bench)
+{
+    int mdu,
+        flags = 0;
+
+    for (mdu=0; mdu < BENCH_N_MDU; mdu++) {
+        ptr_bench->mduGain[mdu]=1.0 + ptr_bench->mcec[mdu][0]*(ptr_bench->meanT[mdu]-BENCH_T_REF);
+        ptr_bench->mduOffset[mdu]=ptr_bench->mcec[mdu][1]*(ptr_bench->meanBias[mdu]-BENCH_BIAS_REF);
+        if (ptr_bench->mduGain[mdu] != 1.0 || ptr_bench->mduOffset[mdu] != 0.0)
+            flags|=BENCH_KERNEL_MCEC;
+    }
+    if (ptr_bench->lut2 != NULL) flags|=BENCH_KERNEL_LUT2;
+    if (ptr_bench->l2re != NULL) flags|=BENCH_KERNEL_L2RE;
+    return flags;
+}
+
+static void ibis_isgr_energyBenchGeneric(ISGRI_energy_bench_struct *ptr_bench)
+{
+    ibis_isgr_energyBenchGenericKernel(ptr_bench, ptr_bench->kernelFlags,
+                                       ptr_bench->genericPi, ptr_bench->genericEnergy);
+}
+
+/* one dispatch for the Science Window, as in ibis_isgr_energyWork */
+static void ibis_isgr_energyBenchSpecialized(ISGRI_energy_bench_struct *ptr_bench)
+{
+    benchKernels[ptr_bench->kernelFlags](ptr_bench, ptr_bench->kernelPi, ptr_bench->kernelEnergy);
+}
+
+/* every specialized kernel against the generic one, same random sequence;
+   returns the configuration of the first difference, -1 if none */
+static int ibis_isgr_energyBenchKernelCheck(ISGRI_energy_bench_struct *ptr_bench,
+                                            long *ptr_maxUlp)
+{
+    int    flags;
+    long   i,
+           ulp;
+    unsigned long long state=ptr_bench->state;
+
+    for (flags=0; flags < BENCH_N_KERNELS; flags++) {
+        ptr_bench->state=state;
+        ibis_isgr_energyBenchGenericKernel(ptr_bench, flags, ptr_bench->genericPi, ptr_bench->genericEnergy);
+        ptr_bench->state=state;
+        benchKernels[flags](ptr_bench, ptr_bench->kernelPi, ptr_bench->kernelEnergy);
+        for (i=0; i < ptr_bench->numEvents; i++) {
+            ulp=ibis_isgr_energyBenchUlp(ptr_bench->genericEnergy[i], ptr_bench->kernelEnergy[i]);
+            if (ulp > *ptr_maxUlp) *ptr_maxUlp=ulp;
+            if (ptr_bench->genericPi[i] != ptr_bench->kernelPi[i] || ulp > BENCH_MAX_ULP) {
+                fprintf(stderr, "kernel %d differs from the generic one at event %ld (%ld ULP)\n",
+                        flags, i, ulp);
+                return flags;
+            }
+        }
+    }
+    return -1;
+}
+
+
+/* LUT1 in pixel order: sort, gather, one load per pixel, scatter back */
+static void ibis_isgr_energyBenchPixel(ISGRI_energy_bench_struct *ptr_bench)
+{
+    long       k,
+               p,
+               numEvents = ptr_bench->numEvents,
+              *order,
+              *pixStart;
+    double     energy,
+               go[ISGRI_GO_N_COL];
+    DAL3_Word *sortedPha;
+    DAL3_Byte *sortedRt,
+              *sortedPi;
+    float     *sortedEnergy;
+
+    order=(long *)ibis_isgr_energyBenchAlloc(numEvents*sizeof(long));
+    pixStart=(long *)ibis_isgr_energyBenchAlloc((ISGRI_N_PIX+2)*sizeof(long));
+    sortedPha=(DAL3_Word *)ibis_isgr_energyBenchAlloc(numEvents*sizeof(DAL3_Word));
+    sortedRt=(DAL3_Byte *)ibis_isgr_energyBenchAlloc(numEvents);
+    sortedPi=(DAL3_Byte *)ibis_isgr_energyBenchAlloc(numEvents);
+    sortedEnergy=(float *)ibis_isgr_energyBenchAlloc(numEvents*sizeof(float));
+
+    ibis_isgr_energyBenchPixelSort(numEvents, ptr_bench->isgriY, ptr_bench->isgriZ, order, pixStart);
+    for (k=0; k < numEvents; k++) {
+        sortedPha[k]=ptr_bench->isgriPha[order[k]];
+        sortedRt[k] =ptr_bench->riseTime[order[k]];
+    }
+    for (p=0; p <= ISGRI_N_PIX; p++) {
+        memcpy(go, ptr_bench->lut1+p*ISGRI_GO_N_COL, sizeof(go));
+        for (k=pixStart[p]; k < pixStart[p+1]; k++) {
+            energy=BENCH_ENERGY(sortedPha[k], sortedRt[k], go);
+            sortedEnergy[k]=(float)energy;
+            sortedPi[k]=BENCH_PI(energy);
+        }
+    }
+    for (k=0; k < numEvents; k++) {
+        ptr_bench->pixelEnergy[order[k]]=sortedEnergy[k];
+        ptr_bench->pixelPi[order[k]]=sortedPi[k];
+    }
+
+    free(order);
+    free(pixStart);
+    free(sortedPha);
+    free(sortedRt);
+    free(sortedPi);
+    free(sortedEnergy);
+}
+
+
+/* heap in use (bytes), of all the libraries: what a stage keeps allocated */
+static double ibis_isgr_energyBenchHeap(void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info=mallinfo2();
+#else
+    struct mallinfo  info=mallinfo();
+#endif
+    return (double)info.uordblks + (double)info.hblkhd;
+}
+
+
+/* stages of ibis_isgr_energyWork run by DAL3IBIS (calibration loading and
+   the reconstruction by blocks), on the synthetic events in memory and
+   the calibration tables of the DOLs: time and heap kept per stage */
+static int ibis_isgr_energyBenchDal(ISGRI_energy_bench_struct *ptr_bench,
+                                    char                     **calDOL,
+                                    int                        repeat)
+{
+    int    r,
+           s,
+           status = ISDC_OK;
+    double t0,
+           heap,
+           elapsed[5],
+           kept[5];
+
+    IBIS_events_struct              events;
+    ISGRI_energy_calibration_struct calibration;
+
+    char *names[5] = { "LUT1 read", "MCEC read", "LUT2 read", "L2RE read", "reconstruction by blocks" };
+    char *dsNames[4] = { DS_ISGR_LUT1, DS_ISGR_MCEC, DS_ISGR_LUT2, DS_ISGR_L2RE };
+    int (*openTable[4])() = { DAL3IBIS_open_LUT1, DAL3IBIS_open_MCEC, DAL3IBIS_open_LUT2, DAL3IBIS_open_L2RE };
+    int (*readTable[4])() = { DAL3IBIS_read_LUT1, DAL3IBIS_read_MCEC, DAL3IBIS_read_LUT2, DAL3IBIS_read_L2RE };
+
+    memset(&events, 0, sizeof(events));
+    events.numEvents=ptr_bench->numEvents;
+    events.isgri_pha=ptr_bench->isgriPha;
+    events.riseTime=ptr_bench->riseTime;
+    events.isgri_y=ptr_bench->isgriY;
+    events.isgri_z=ptr_bench->isgriZ;
+    events.isgri_pi=ptr_bench->genericPi;
+    events.isgri_energy=ptr_bench->genericEnergy;
+    events.obtStart=0;
+    events.obtEnd=(OBTime)BENCH_DURATION << 20;   /* OBT ticks of 2^-20 s */
+
+    memset(elapsed, 0, sizeof(elapsed));
+    memset(kept, 0, sizeof(kept));
+    for (r=0; r < repeat && status == ISDC_OK; r++) {
+        memset(&calibration, 0, sizeof(calibration));
+        status=DAL3IBIS_init_ISGRI_energy_calibration(&calibration, status);
+        for (s=0; s < 4 && status == ISDC_OK; s++) {
+            heap=ibis_isgr_energyBenchHeap();
+            t0=ibis_isgr_energyBenchNow();
+            status=DAL3IBIS_populate_DS_flexible(calDOL[s], &events, &calibration, dsNames[s],
+                                                 openTable[s], readTable[s], 0, status);
+            elapsed[s]+=ibis_isgr_energyBenchNow()-t0;
+            kept[s]+=ibis_isgr_energyBenchHeap()-heap;
+        }
+        heap=ibis_isgr_energyBenchHeap();
+        t0=ibis_isgr_energyBenchNow();
+        status=ibis_isgr_energyReconstruct(&calibration, &events, 0, 0, 0, NULL, NULL, 0, status);
+        elapsed[4]+=ibis_isgr_energyBenchNow()-t0;
+        kept[4]+=ibis_isgr_energyBenchHeap()-heap;
+        DAL3IBIS_dealocate(&calibration, ISDC_OK);
+    }
+    if (status != ISDC_OK) {
+        fprintf(stderr, "DAL3IBIS stages failed with status %d\n", status);
+        return status;
+    }
+
+    printf("%-27s %12s %10s %16s\n", "DAL3IBIS stage", "Mevents/s", "ns/event", "heap kept");
+    for (s=0; s < 5; s++)
+        printf("%-27s %12.2f %10.2f %16.0f\n", names[s],
+               1.0e-6*ptr_bench->numEvents*repeat/elapsed[s],
+               1.0e9*elapsed[s]/((double)ptr_bench->numEvents*repeat), kept[s]/repeat);
+    return status;
+}
+
+
+int main (int argc, char *argv[])
+{
+    int    r,
+           s,
+           arg = 1,
+           repeat = 5;
+    char **calDOL = NULL;
+    long   i,
+           p,
+           ulp,
+           maxUlp = 0,
+           kernelUlp = 0,
+           blockChangedPi = 0,
+           numEvents = 8000000l;
+    size_t setupBytes,
+           stageBytes;
+    double t0,
+           elapsed,
+           deviation,
+           blockDeviation = 0.,
+           timeBlock = BENCH_TIME_BLOCK;
+
+    ISGRI_energy_bench_struct bench;
+    ISGRI_energy_bench_stage_struct stages[] = {
+        { "exp. LUT1 scalar",           ibis_isgr_energyBenchLut1Scalar  },
+        { "exp. LUT1 vector dispatch",  ibis_isgr_energyBenchLut1        },
+        { "exp. LUT1 pixel order",      ibis_isgr_energyBenchPixel       },
+        { "exp. fused generic",         ibis_isgr_energyBenchGeneric     },
+        { "exp. fused specialized",     ibis_isgr_energyBenchSpecialized },
+        { "exp. MCEC/L2RE per event",   ibis_isgr_energyBenchTimeEvent   },
+        { "exp. MCEC/L2RE time blocks", ibis_isgr_energyBenchTimeBlock   }
+    };
+    int numStages = sizeof(stages)/sizeof(stages[0]);
+
+    if (argc > 5 && strcmp(argv[1], "-cal") == 0) {
+        calDOL=argv+2;
+        arg=6;
+    }
+    if (argc > arg)   numEvents=atol(argv[arg]);
+    if (argc > arg+1) repeat=atoi(argv[arg+1]);
+    if (argc > arg+2) timeBlock=atof(argv[arg+2]);
+    if (numEvents <= 0 || repeat <= 0 || !(timeBlock > 0.)
+        || (argc > 1 && strcmp(argv[1], "-cal") == 0 && calDOL == NULL)) {
+        fprintf(stderr, "usage: %s [-cal lut1DOL mcecDOL lut2DOL l2reDOL] [numEvents [repeat [timeBlock]]]\n", argv[0]);
+        return I_ISGR_ERR_BAD_INPUT;
+    }
+
+    memset(&bench, 0, sizeof(bench));
+    bench.numEvents=numEvents;
+    bench.state=0x2545F4914F6CDD1Dull;
+    bench.timeBlock=timeBlock;
+
+    bench.isgriPha=(DAL3_Word *)ibis_isgr_energyBenchAlloc(numEvents*sizeof(DAL3_Word));
+    bench.riseTime=(DAL3_Byte *)ibis_isgr_energyBenchAlloc(numEvents);
+    bench.isgriY=(DAL3_Byte *)ibis_isgr_energyBenchAlloc(numEvents);
+    bench.isgriZ=(DAL3_Byte *)ibis_isgr_energyBenchAlloc(numEvents);
+    bench.scalarPi=(DAL3_Byte *)ibis_isgr_energyBenchAlloc(numEvents);
+    bench.lut1Pi=(DAL3_Byte *)ibis_isgr_energyBenchAlloc(numEvents);
+    bench.pixelPi=(DAL3_Byte *)ibis_isgr_energyBenchAlloc(numEvents);
+    bench.scalarEnergy=(float *)ibis_isgr_energyBenchAlloc(numEvents*sizeof(float));
+    bench.lut1Energy=(float *)ibis_isgr_energyBenchAlloc(numEvents*sizeof(float));
+    bench.pixelEnergy=(float *)ibis_isgr_energyBenchAlloc(numEvents*sizeof(float));
+    bench.genericPi=(DAL3_Byte *)ibis_isgr_energyBenchAlloc(numEvents);
+    bench.kernelPi=(DAL3_Byte *)ibis_isgr_energyBenchAlloc(numEvents);
+    bench.genericEnergy=(float *)ibis_isgr_energyBenchAlloc(numEvents*sizeof(float));
+    bench.kernelEnergy=(float *)ibis_isgr_energyBenchAlloc(numEvents*sizeof(float));
+    bench.eventPi=(DAL3_Byte *)ibis_isgr_energyBenchAlloc(numEvents);
+    bench.blockPi=(DAL3_Byte *)ibis_isgr_energyBenchAlloc(numEvents);
+    bench.eventEnergy=(float *)ibis_isgr_energyBenchAlloc(numEvents*sizeof(float));
+    bench.blockEnergy=(float *)ibis_isgr_energyBenchAlloc(numEvents*sizeof(float));
+    bench.eventTime=(double *)ibis_isgr_energyBenchAlloc(numEvents*sizeof(double));
+    bench.lut1Raw=(double *)ibis_isgr_energyBenchAlloc((ISGRI_N_PIX+1)*ISGRI_GO_N_COL*sizeof(double));
+    bench.lut1=(double *)ibis_isgr_energyBenchAlloc((ISGRI_N_PIX+1)*ISGRI_GO_N_COL*sizeof(double));
+    bench.lut2=(float *)ibis_isgr_energyBenchAlloc(ISGRI_RT_N_ENER_SCALED*ISGRI_RT_N_DATA*sizeof(float));
+    bench.l2re=(float *)ibis_isgr_energyBenchAlloc(ISGRI_RT_N_DATA*sizeof(float));
+    setupBytes=benchBytes;
+
+    for (p=0; p <= ISGRI_N_PIX; p++) {
+        bench.lut1Raw[p*ISGRI_GO_N_COL+0]=20.0 + (ibis_isgr_energyBenchRand(&bench.state) % 1000)*0.01;
+        bench.lut1Raw[p*ISGRI_GO_N_COL+1]=0.45 + (ibis_isgr_energyBenchRand(&bench.state) % 1000)*1.0e-4;
+        bench.lut1Raw[p*ISGRI_GO_N_COL+2]=-1.0 + (ibis_isgr_energyBenchRand(&bench.state) % 1000)*2.0e-3;
+        bench.lut1Raw[p*ISGRI_GO_N_COL+3]=(ibis_isgr_energyBenchRand(&bench.state) % 1000)*1.0e-6;
+        bench.lut1Raw[p*ISGRI_GO_N_COL+4]=(ibis_isgr_energyBenchRand(&bench.state) % 1000)*1.0e-3;
+    }
+    for (s=0; s < BENCH_N_MDU; s++) {
+        bench.mcec[s][0]=-2.0e-3 + (ibis_isgr_energyBenchRand(&bench.state) % 100)*1.0e-5;
+        bench.mcec[s][1]=0.05 + (ibis_isgr_energyBenchRand(&bench.state) % 100)*1.0e-4;
+        bench.meanT[s]=KEY_DEF_TEMP + (ibis_isgr_energyBenchRand(&bench.state) % 100)*0.02 - 1.0;
+        bench.meanBias[s]=KEY_DEF_BIAS + (ibis_isgr_energyBenchRand(&bench.state) % 100)*0.1 - 5.0;
+    }
+    for (i=0; i < ISGRI_RT_N_ENER_SCALED*ISGRI_RT_N_DATA; i++)
+        bench.lut2[i]=0.9f + (ibis_isgr_energyBenchRand(&bench.state) % 1000)*2.0e-4f;
+    for (i=0; i < ISGRI_RT_N_DATA; i++)
+        bench.l2re[i]=0.99f + (ibis_isgr_energyBenchRand(&bench.state) % 1000)*2.0e-5f;
+    for (i=0; i < numEvents; i++) {
+        bench.isgriPha[i]=(DAL3_Word)(ibis_isgr_energyBenchRand(&bench.state) % 2048);
+        bench.riseTime[i]=(DAL3_Byte)(ibis_isgr_energyBenchRand(&bench.state) % 256);
+        bench.isgriY[i]  =(DAL3_Byte)(ibis_isgr_energyBenchRand(&bench.state) % 128);
+        bench.isgriZ[i]  =(DAL3_Byte)(ibis_isgr_energyBenchRand(&bench.state) % 128);
+        bench.eventTime[i]=(double)BENCH_DURATION*i/numEvents;
+    }
+    /* slow thermal cycle and HK noise; slow L2RE drift */
+    for (i=0; i < BENCH_N_HK; i++) {
+        bench.hkTime[i]=(double)i*BENCH_HK_PERIOD;
+        for (s=0; s < BENCH_N_MDU; s++) {
+            bench.hkT[i][s]=bench.meanT[s] + 0.5*sin(2.*M_PI*bench.hkTime[i]/1800.)
+                           + (ibis_isgr_energyBenchRand(&bench.state) % 100)*1.0e-3 - 0.05;
+            bench.hkBias[i][s]=bench.meanBias[s] + (ibis_isgr_energyBenchRand(&bench.state) % 100)*4.0e-3 - 0.2;
+        }
+    }
+    for (i=0; i < BENCH_N_L2RE; i++) {
+        bench.l2reTime[i]=(double)i*BENCH_L2RE_PERIOD;
+        bench.l2reDrift[i]=1.0 + 2.0e-3*sin(2.*M_PI*bench.l2reTime[i]/3000.);
+    }
+
+    ibis_isgr_energyBenchMcec(&bench);
+    bench.kernelFlags=ibis_isgr_energyBenchConfig(&bench);
+
+    printf("events          : %ld x %d, %lu bytes of events and tables\n",
+           numEvents, repeat, (unsigned long)setupBytes);
+    printf("exp. fused      : %s%s%s (model only, not in ibis_isgr_energy)\n",
+           bench.kernelFlags & BENCH_KERNEL_MCEC ? "MCEC " : "",
+           bench.kernelFlags & BENCH_KERNEL_LUT2 ? "LUT2 " : "",
+           bench.kernelFlags & BENCH_KERNEL_L2RE ? "L2RE" : "");
+    printf("%-27s %12s %10s %16s\n", "model stage", "Mevents/s", "ns/event", "bytes allocated");
+
+    for (s=0; s < numStages; s++) {
+        elapsed=0.;
+        benchBytes=0;
+        for (r=0; r < repeat; r++) {
+            t0=ibis_isgr_energyBenchNow();
+            stages[s].run(&bench);
+            elapsed+=ibis_isgr_energyBenchNow()-t0;
+        }
+        stageBytes=benchBytes/repeat;
+        printf("%-27s %12.2f %10.2f %16lu\n", stages[s].name,
+               1.0e-6*numEvents*repeat/elapsed, 1.0e9*elapsed/((double)numEvents*repeat),
+               (unsigned long)stageBytes);
+    }
+
+    for (i=0; i < numEvents; i++) {
+        ulp=ibis_isgr_energyBenchUlp(bench.scalarEnergy[i], bench.lut1Energy[i]);
+        if (ulp > maxUlp) maxUlp=ulp;
+        if (bench.scalarPi[i] != bench.lut1Pi[i] || ulp > BENCH_MAX_ULP) {
+            fprintf(stderr, "vector kernel differs from scalar at event %ld (%ld ULP)\n", i, ulp);
+            return I_ISGR_ERR_BAD_INPUT;
+        }
+        if (bench.pixelPi[i] != bench.lut1Pi[i] || bench.pixelEnergy[i] != bench.lut1Energy[i]) {
+            fprintf(stderr, "pixel order differs from time order at event %ld\n", i);
+            return I_ISGR_ERR_BAD_INPUT;
+        }
+    }
+    if (ibis_isgr_energyBenchKernelCheck(&bench, &kernelUlp) >= 0)
+        return I_ISGR_ERR_BAD_INPUT;
+    for (i=0; i < numEvents; i++) {
+        deviation=fabs(bench.blockEnergy[i]-bench.eventEnergy[i]);
+        if (deviation > blockDeviation) blockDeviation=deviation;
+        if (bench.blockPi[i] != bench.eventPi[i]) blockChangedPi++;
+    }
+    printf("checks          : vector kernel %ld ULP max, pixel order identical,\n"
+           "                  exp. %d specialized kernels %ld ULP max from the generic model\n",
+           maxUlp, BENCH_N_KERNELS, kernelUlp);
+    printf("exp. time blocks: %g s, ISGRI_ENERGY %.3g keV max from per event, %ld PI changed\n",
+           timeBlock, blockDeviation, blockChangedPi);
+
+    /* real stages last: they overwrite the output of the generic model */
+    if (calDOL != NULL && ibis_isgr_energyBenchDal(&bench, calDOL, repeat) != ISDC_OK)
+        return I_ISGR_ERR_BAD_INPUT;
+    if (calDOL == NULL)
+        printf("DAL3IBIS stages: not timed, give the calibration tables with -cal\n");
+
+    free(bench.isgriPha);     free(bench.riseTime);
+    free(bench.isgriY);       free(bench.isgriZ);
+    free(bench.scalarPi);     free(bench.lut1Pi);
+    free(bench.pixelPi);
+    free(bench.scalarEnergy); free(bench.lut1Energy);
+    free(bench.pixelEnergy);
+    free(bench.genericPi);    free(bench.kernelPi);
+    free(bench.genericEnergy); free(bench.kernelEnergy);
+    free(bench.lut1Raw);      free(bench.lut1);
+    free(bench.lut2);         free(bench.l2re);
+    free(bench.eventPi);      free(bench.blockPi);
+    free(bench.eventEnergy);  free(bench.blockEnergy);
+    free(bench.eventTime);
+    return ISDC_OK;
+}
@@ -0,0 +1,367 @@
+/************************************************************************
+ * FILE:        ibis_isgr_energy_calsnap.c
+ * VERSION:     9.1
+ * COMPONENT:   ibis_isgr_energy
+ * AUTHOR:      V. Savchenko,   APC & ISDC
+ * DESCRIPTION: calibration snapshot: the LUT1, MCEC, LUT2 and L2RE tables
+ *              copied into one checksummed FITS file (preferably on a
+ *              node-local disk), read instead of the original DOLs
+ * HISTORY:
+ *   VS, 9.1  first version
+ ************************************************************************/
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "fitsio.h"
+#include "ibis_isgr_energy.h"
+
+#define CAL_SNAP_N_TABLES 4
+
+
+/* the calibration DOLs of the snapshot, their copies and structure names */
+static void ibis_isgr_energyCalSnapTables(ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                                          char *DOLs[CAL_SNAP_N_TABLES],
+                                          char *snapDOLs[CAL_SNAP_N_TABLES],
+                                          char *dsNames[CAL_SNAP_N_TABLES])
+{
+    DOLs[0]=ptr_ISGRI_energy_caldb_dols->lut1_DOL; snapDOLs[0]=ptr_ISGRI_energy_caldb_dols->lut1_snap; dsNames[0]=DS_ISGR_LUT1;
+    DOLs[1]=ptr_ISGRI_energy_caldb_dols->mcec_DOL; snapDOLs[1]=ptr_ISGRI_energy_caldb_dols->mcec_snap; dsNames[1]=DS_ISGR_MCEC;
+    DOLs[2]=ptr_ISGRI_energy_caldb_dols->lut2_DOL; snapDOLs[2]=ptr_ISGRI_energy_caldb_dols->lut2_snap; dsNames[2]=DS_ISGR_LUT2;
+    DOLs[3]=ptr_ISGRI_energy_caldb_dols->l2re_DOL; snapDOLs[3]=ptr_ISGRI_energy_caldb_dols->l2re_snap; dsNames[3]=DS_ISGR_L2RE;
+}
+
+
+/* DATASUM of the table of a DOL, read from its header; 0 if known */
+static int ibis_isgr_energyCalSnapSourceSum(char *DOL,
+                                            char *sum)
+{
+    int       fitsStatus = 0,
+              closeStatus = 0;
+    fitsfile *inFits = NULL;
+
+    sum[0]='\0';
+    fits_open_file(&inFits, DOL, READONLY, &fitsStatus);
+    fits_read_key(inFits, TSTRING, "DATASUM", sum, NULL, &fitsStatus);
+    if (inFits != NULL) fits_close_file(inFits, &closeStatus);
+
+    if (fitsStatus != 0) sum[0]='\0';
+    return sum[0] == '\0';
+}
+
+
+/* checksums of all HDUs of a FITS file, 0 if all are right */
+static int ibis_isgr_energyCalSnapVerify(char *fileName)
+{
+    int       hdu,
+              hduType,
+              dataOK = 1,
+              hduOK = 1,
+              fitsStatus = 0,
+              closeStatus = 0;
+    fitsfile *snapFits = NULL;
+
+    fits_open_file(&snapFits, fileName, READONLY, &fitsStatus);
+    for (hdu=1; fitsStatus == 0; hdu++) {
+        if (fits_movabs_hdu(snapFits, hdu, &hduType, &fitsStatus) != 0) {
+            if (hdu > 1) fitsStatus=0;
+            break;
+        }
+        fits_verify_chksum(snapFits, &dataOK, &hduOK, &fitsStatus);
+        if (fitsStatus == 0 && (dataOK != 1 || hduOK != 1)) fitsStatus=-1;
+    }
+    if (snapFits != NULL) fits_close_file(snapFits, &closeStatus);
+
+    return fitsStatus;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyCalSnapshotBuild
+ * DESCRIPTION:
+ *  Copies the calibration tables into the snapshot file. Only DOLs which
+ *  point directly to a table with a DATASUM are copied: an index is
+ *  resolved per Science Window (ibis_isgr_energyCalMember) and stays
+ *  read from its original DOL. Each extension gets the source DOL
+ *  (SRC_DOL), the DATASUM of the source (SRC_DSUM) and FITS checksums;
+ *  the primary header gets the snapshot format version and component
+ *  version. The checksums are verified once, here, before the file is
+ *  renamed from its temporary name: concurrent processes never see a
+ *  partial or corrupt snapshot.
+ * ERROR CODES:
+ *  I_ISGR_ERR_CAL_SNAPSHOT   if the snapshot cannot be written
+ *
+ * PARAMETERS:
+ *  snapName         char *    in   file name of the snapshot
+ *  ptr_ISGRI_energy_caldb_dols     in   calibration DOLs
+ *  chatter           int      in   verbosity level
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyCalSnapshotBuild(char *snapName,
+                                     ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                                     int   chatter,
+                                     int   status)
+{
+    int       i,
+              hduType,
+              snapVersion = CAL_SNAP_VERSION,
+              numCopied = 0,
+              fitsStatus = 0,
+              inStatus;
+    char      tmpName[DAL_FILE_NAME_STRING],
+              extName[FLEN_VALUE],
+              sum[FLEN_VALUE],
+             *DOLs[CAL_SNAP_N_TABLES],
+             *snapDOLs[CAL_SNAP_N_TABLES],
+             *dsNames[CAL_SNAP_N_TABLES];
+    fitsfile *outFits = NULL,
+             *inFits;
+
+    if (status != ISDC_OK) return status;
+
+    ibis_isgr_energyCalSnapTables(ptr_ISGRI_energy_caldb_dols, DOLs, snapDOLs, dsNames);
+    if (snprintf(tmpName, DAL_FILE_NAME_STRING, "%s.%ld", snapName, (long)getpid()) >= DAL_FILE_NAME_STRING) {
+        RILlogMessage(NULL, Warning_1, "Calibration snapshot name too long: %s", snapName);
+        return I_ISGR_ERR_CAL_SNAPSHOT;
+    }
+
+    fits_create_file(&outFits, tmpName, &fitsStatus);
+    fits_create_img(outFits, BYTE_IMG, 0, NULL, &fitsStatus);
+    fits_write_key(outFits, TINT, "CSNAPVER", &snapVersion,
+                   "calibration snapshot format", &fitsStatus);
+    fits_write_key(outFits, TSTRING, "COMPVERS", COMPONENT_VERSION,
+                   COMPONENT_NAME " version", &fitsStatus);
+
+    for (i=0; i < CAL_SNAP_N_TABLES && fitsStatus == 0; i++) {
+        inStatus=0;
+        inFits=NULL;
+        sum[0]='\0';
+        fits_open_file(&inFits, DOLs[i], READONLY, &inStatus);
+        fits_get_hdu_type(inFits, &hduType, &inStatus);
+        fits_read_key(inFits, TSTRING, "EXTNAME", extName, NULL, &inStatus);
+        fits_read_key(inFits, TSTRING, "DATASUM", sum, NULL, &inStatus);
+        if (inStatus == 0 && hduType == BINARY_TBL && strcmp(extName, dsNames[i]) == 0) {
+            fits_copy_hdu(inFits, outFits, 0, &fitsStatus);
+            fits_write_key_longstr(outFits, "SRC_DOL", DOLs[i], "source of the table", &fitsStatus);
+            fits_write_key(outFits, TSTRING, "SRC_DSUM", sum, "DATASUM of the source", &fitsStatus);
+            fits_write_chksum(outFits, &fitsStatus);
+            numCopied++;
+        } else if (chatter > 2) {
+            RILlogMessage(NULL, Log_0, "%s: %s is not a table with DATASUM, not in snapshot", dsNames[i], DOLs[i]);
+        }
+        if (inFits != NULL) {
+            inStatus=0;
+            fits_close_file(inFits, &inStatus);
+        }
+    }
+
+    fits_movabs_hdu(outFits, 1, NULL, &fitsStatus);
+    fits_write_chksum(outFits, &fitsStatus);
+    fits_close_file(outFits, &fitsStatus);
+    if (fitsStatus == 0) fitsStatus=ibis_isgr_energyCalSnapVerify(tmpName);
+
+    if (fitsStatus == 0 && numCopied > 0 && rename(tmpName, snapName) == 0) {
+        RILlogMessage(NULL, Log_1, "Calibration snapshot %s written (%d tables)", snapName, numCopied);
+        return status;
+    }
+
+    remove(tmpName);
+    RILlogMessage(NULL, Warning_1, "Cannot write calibration snapshot %s (FITS status %d, %d tables)",
+                  snapName, fitsStatus, numCopied);
+    return I_ISGR_ERR_CAL_SNAPSHOT;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyCalSnapshotCheck
+ * DESCRIPTION:
+ *  Compares the headers of the snapshot with the calibration DOLs:
+ *  format and component versions, source DOL of every extension, and
+ *  its source DATASUM with the one now in the header of the source. No
+ *  data is read: the checksums were verified when the snapshot was
+ *  written. On success, inSnap[i] tells which tables are in the snapshot.
+ *
+ * PARAMETERS:
+ *  snapName         char *    in   file name of the snapshot
+ *  DOLs, dsNames    char **   in   calibration DOLs and structure names
+ *  inSnap            int *   out   1 for each table read from the snapshot
+ * RETURN:            int     0 if the snapshot is valid, else FITS status
+ *                            or -1 if the snapshot does not match
+ ************************************************************************/
+static int ibis_isgr_energyCalSnapshotCheck(char *snapName,
+                                            char *DOLs[CAL_SNAP_N_TABLES],
+                                            char *dsNames[CAL_SNAP_N_TABLES],
+                                            int   inSnap[CAL_SNAP_N_TABLES],
+                                            int   chatter)
+{
+    int       i,
+              snapVersion = 0,
+              numFound = 0,
+              fitsStatus = 0,
+              freeStatus;
+    char      compVersion[FLEN_VALUE],
+              snapSum[FLEN_VALUE],
+              sourceSum[FLEN_VALUE],
+             *srcDOL;
+    fitsfile *snapFits;
+
+    if (fits_open_file(&snapFits, snapName, READONLY, &fitsStatus) != 0)
+        return fitsStatus;
+
+    do {
+        fits_read_key(snapFits, TINT,    "CSNAPVER", &snapVersion, NULL, &fitsStatus);
+        fits_read_key(snapFits, TSTRING, "COMPVERS", compVersion,  NULL, &fitsStatus);
+        if (fitsStatus != 0) break;
+        if (snapVersion != CAL_SNAP_VERSION || strcmp(compVersion, COMPONENT_VERSION) != 0) {
+            fitsStatus=-1;
+            break;
+        }
+
+        for (i=0; i < CAL_SNAP_N_TABLES && fitsStatus == 0; i++) {
+            inSnap[i]=0;
+            if (fits_movnam_hdu(snapFits, BINARY_TBL, dsNames[i], 0, &fitsStatus) != 0) {
+                fitsStatus=0;
+                continue;
+            }
+            srcDOL=NULL;
+            fits_read_key_longstr(snapFits, "SRC_DOL", &srcDOL, NULL, &fitsStatus);
+            fits_read_key(snapFits, TSTRING, "SRC_DSUM", snapSum, NULL, &fitsStatus);
+            if (fitsStatus == 0) {
+                if (strcmp(srcDOL, DOLs[i]) != 0) {
+                    if (chatter > 2)
+                        RILlogMessage(NULL, Log_0, "%s: snapshot made from %s", dsNames[i], srcDOL);
+                    fitsStatus=-1;
+                } else if (ibis_isgr_energyCalSnapSourceSum(DOLs[i], sourceSum)
+                           || strcmp(sourceSum, snapSum) != 0) {
+                    RILlogMessage(NULL, Warning_1, "%s: %s changed since snapshot %s", dsNames[i], DOLs[i], snapName);
+                    fitsStatus=-1;
+                } else {
+                    inSnap[i]=1;
+                    numFound++;
+                }
+            }
+            freeStatus=0;
+            if (srcDOL != NULL) fits_free_memory(srcDOL, &freeStatus);
+        }
+    } while(0);
+
+    freeStatus=0;
+    fits_close_file(snapFits, &freeStatus);
+
+    if (fitsStatus == 0 && numFound == 0) fitsStatus=-1;
+    return fitsStatus;
+}
+
+
+/* builds the snapshot if it does not exist yet, once for the processes
+   sharing it: they wait on the lock <snapName>.lock */
+static void ibis_isgr_energyCalSnapshotCreate(char *snapName,
+                                              ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                                              int   chatter)
+{
+    int  fd;
+    char lockName[DAL_FILE_NAME_STRING];
+
+    if (access(snapName, F_OK) == 0) return;
+
+    if (snprintf(lockName, DAL_FILE_NAME_STRING, "%s.lock", snapName) >= DAL_FILE_NAME_STRING
+        || (fd=open(lockName, O_RDWR | O_CREAT, 0644)) < 0) {
+        RILlogMessage(NULL, Warning_1, "Cannot lock calibration snapshot %s", snapName);
+        return;
+    }
+    while (flock(fd, LOCK_EX) != 0 && errno == EINTR) ;
+
+    if (access(snapName, F_OK) != 0)
+        ibis_isgr_energyCalSnapshotBuild(snapName, ptr_ISGRI_energy_caldb_dols, chatter, ISDC_OK);
+
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+
+/* maps the snapshot and asks the kernel to read it ahead, so that the
+   tables are loaded from the page cache */
+static void ibis_isgr_energyCalSnapshotMap(char *snapName,
+                                           int   chatter)
+{
+    int         fd;
+    void       *map;
+    struct stat st;
+
+    if ((fd=open(snapName, O_RDONLY)) < 0) return;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        map=mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_WILLNEED);
+            munmap(map, st.st_size);
+            if (chatter > 2)
+                RILlogMessage(NULL, Log_0, "Calibration snapshot %s: %ld bytes read ahead",
+                              snapName, (long)st.st_size);
+        }
+    }
+    close(fd);
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyCalSnapshot
+ * DESCRIPTION:
+ *  Sets the DOLs of the copies in the snapshot (lut1_snap, ...), which
+ *  ibis_isgr_energyCalibrate loads instead of the original DOLs; these
+ *  are kept for the fingerprint and the selection of index members.
+ *  A missing snapshot is built, once, under a lock of the file. A
+ *  snapshot that does not match the DOLs is not rebuilt, as other
+ *  processes may share it: it is reported and the original DOLs are used
+ *  (ibis_isgr_energy_calsnap rebuilds it). Any problem with the snapshot
+ *  is only a warning.
+ *
+ * PARAMETERS:
+ *  snapName         char *    in   file name of the snapshot
+ *  ptr_ISGRI_energy_caldb_dols     in/out   calibration DOLs, copies
+ *  chatter           int      in   verbosity level
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyCalSnapshot(char *snapName,
+                                ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                                int   chatter,
+                                int   status)
+{
+    int   i,
+          inSnap[CAL_SNAP_N_TABLES] = {0},
+          fitsStatus;
+    char *DOLs[CAL_SNAP_N_TABLES],
+         *snapDOLs[CAL_SNAP_N_TABLES],
+         *dsNames[CAL_SNAP_N_TABLES];
+
+    ibis_isgr_energyCalSnapTables(ptr_ISGRI_energy_caldb_dols, DOLs, snapDOLs, dsNames);
+    for (i=0; i < CAL_SNAP_N_TABLES; i++)
+        snapDOLs[i][0]='\0';
+
+    if (status != ISDC_OK || strlen(snapName) == 0) return status;
+
+    ibis_isgr_energyCalSnapshotCreate(snapName, ptr_ISGRI_energy_caldb_dols, chatter);
+
+    fitsStatus=ibis_isgr_energyCalSnapshotCheck(snapName, DOLs, dsNames, inSnap, chatter);
+    if (fitsStatus != 0) {
+        RILlogMessage(NULL, Warning_1, "Calibration snapshot %s does not match the calibration DOLs (%d), "
+                      "using original DOLs", snapName, fitsStatus);
+        return status;
+    }
+
+    ibis_isgr_energyCalSnapshotMap(snapName, chatter);
+
+    for (i=0; i < CAL_SNAP_N_TABLES; i++) {
+        if (!inSnap[i]) continue;
+        if (snprintf(snapDOLs[i], DAL_FILE_NAME_STRING, "%s[%s]", snapName, dsNames[i]) >= DAL_FILE_NAME_STRING) {
+            RILlogMessage(NULL, Warning_1, "%s: snapshot DOL too long, using %s", dsNames[i], DOLs[i]);
+            snapDOLs[i][0]='\0';
+            continue;
+        }
+        if (chatter > 2)
+            RILlogMessage(NULL, Log_0, "%s read from %s", dsNames[i], snapDOLs[i]);
+    }
+    return status;
+}
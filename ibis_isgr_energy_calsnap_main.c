@@ -0,0 +1,39 @@
+/************************************************************************
+ * FILE:        ibis_isgr_energy_calsnap_main.c
+ * VERSION:     9.1
+ * COMPONENT:   ibis_isgr_energy
+ * AUTHOR:      V. Savchenko,   APC & ISDC
+ * DESCRIPTION: writes the calibration snapshot used by ibis_isgr_energy
+ *              (parameter calSnapshot), e.g. once per node before a run,
+ *              or again after the calibration DOLs changed
+ * USAGE:
+ *   ibis_isgr_energy_calsnap snapshot GODOL mcecDOL riseDOL l2reDOL
+ * HISTORY:
+ *   VS, 9.1  first version
+ ************************************************************************/
+
+#include "ibis_isgr_energy.h"
+
+
+int main (int argc, char *argv[])
+{
+    int status = ISDC_OK;
+
+    ISGRI_energy_caldb_dols_struct ISGRI_energy_caldb_dols;
+
+    memset(&ISGRI_energy_caldb_dols, 0, sizeof(ISGRI_energy_caldb_dols));
+
+    if (argc != 6) {
+        fprintf(stderr, "usage: %s snapshot GODOL mcecDOL riseDOL l2reDOL\n", argv[0]);
+        return I_ISGR_ERR_BAD_INPUT;
+    }
+
+    snprintf(ISGRI_energy_caldb_dols.lut1_DOL, DAL_FILE_NAME_STRING, "%s", argv[2]);
+    snprintf(ISGRI_energy_caldb_dols.mcec_DOL, DAL_FILE_NAME_STRING, "%s", argv[3]);
+    snprintf(ISGRI_energy_caldb_dols.lut2_DOL, DAL_FILE_NAME_STRING, "%s", argv[4]);
+    snprintf(ISGRI_energy_caldb_dols.l2re_DOL, DAL_FILE_NAME_STRING, "%s", argv[5]);
+
+    status=ibis_isgr_energyCalSnapshotBuild(argv[1], &ISGRI_energy_caldb_dols, 3, status);
+
+    return status;
+}
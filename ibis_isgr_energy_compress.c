@@ -0,0 +1,192 @@
+/************************************************************************
+ * FILE:        ibis_isgr_energy_compress.c
+ * VERSION:     9.1
+ * COMPONENT:   ibis_isgr_energy
+ * AUTHOR:      V. Savchenko,   APC & ISDC
+ * DESCRIPTION: tile-compressed ISGR-EVTS-COR (parameter outCompressed):
+ *              once the group of a Science Window is closed, the table
+ *              ISGR-EVTS-COR is written to a separate file (name of its
+ *              file with suffix ISGRI_COMPRESS_SUFFIX) in the FITS tiled
+ *              table compression (cfitsio), in tiles of
+ *              ISGRI_COMPRESS_TILE_ROWS rows, ISGRI_PI with RICE_1 and
+ *              ISGRI_ENERGY with GZIP_2 (bytes of the floats shuffled).
+ *              ISGRI_ENERGY may first be rounded to a power-of-two step
+ *              (parameter energyTolerance), in the compressed file only:
+ *              the low bits of the mantissa are then zero and compress
+ *              away. The table is handled one tile at a time. The group
+ *              keeps its plain ISGR-EVTS-COR, which DAL reads; DAL reads
+ *              no compressed tables, so the compressed file is for
+ *              storage and archive.
+ *              Sizes and throughputs: ibis_isgr_energy_synth -compress.
+ * HISTORY:
+ *   VS, 9.1  first version
+ *   VS, 9.1  output compressed in its file, tile by tile, instead of a copy
+ *   VS, 9.1  compressed output in a separate file again, the table of the
+ *            group neither rounded nor given keywords
+ ************************************************************************/
+
+#include <unistd.h>
+#include <math.h>
+#include "fitsio.h"
+#include "ibis_isgr_energy.h"
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyQuantumStep
+ * DESCRIPTION:
+ *  Step of the rounding of ISGRI_ENERGY for a tolerance: the largest
+ *  power of two not above twice the tolerance, so that no energy moves
+ *  by more than the tolerance.
+ *
+ * PARAMETERS:
+ *  tolerance       double     in   keV, <= 0 for no rounding
+ * RETURN:          double     step in keV, 0 for no rounding
+ ************************************************************************/
+double ibis_isgr_energyQuantumStep(double tolerance)
+{
+    if (tolerance <= 0.) return 0.;
+    return pow(2., floor(log2(2.*tolerance)));
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyQuantize
+ * DESCRIPTION:
+ *  Rounds energies to the nearest multiple of step (nothing if 0).
+ ************************************************************************/
+void ibis_isgr_energyQuantize(float *isgriEnergy,
+                              long   numEvents,
+                              double step)
+{
+    long   i;
+    double inverse;
+
+    if (step <= 0.) return;
+
+    inverse=1./step;
+    for (i=0; i < numEvents; i++)
+        isgriEnergy[i]=(float)(step*rint(isgriEnergy[i]*inverse));
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyCompressFile
+ * DESCRIPTION:
+ *  Writes the binary table extName of a FITS file, tile-compressed, to
+ *  the file outName (primary HDU and compressed table). The source file
+ *  is only read: the table is first copied, plain, to a temporary file
+ *  next to outName; with a tolerance, ISGRI_ENERGY is rounded in that
+ *  copy, one tile of rows at a time, and the step is written there as
+ *  keyword EQUANT (0: exact), with the FZ* keywords read by
+ *  fits_compress_table. The compressed table is written under a second
+ *  temporary name, renamed to outName at the end, and the copy removed:
+ *  an interrupted run leaves no partial outName. A table compressed
+ *  already is left as it is. The memory used is about one tile,
+ *  whatever the number of rows.
+ * ERROR CODES:
+ *  I_ISGR_ERR_COMPRESS       if the table cannot be compressed
+ *
+ * PARAMETERS:
+ *  fileName         char *    in   FITS file of the table, not modified
+ *  extName          char *    in   name of the table
+ *  outName          char *    in   compressed file, overwritten
+ *  tolerance      double      in   keV, 0 for lossless
+ *  chatter           int      in   verbosity level
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyCompressFile(char   *fileName,
+                                 char   *extName,
+                                 char   *outName,
+                                 double  tolerance,
+                                 int     chatter,
+                                 int     status)
+{
+    int       fitsStatus = 0,
+              keyStatus = 0,
+              compressed = 0,
+              piCol = 0,
+              energyCol = 0;
+    long      numRows = 0,
+              tileRows,
+              first,
+              numRead;
+    double    step;
+    float    *isgriEnergy = NULL;
+    char      keyName[FLEN_KEYWORD],
+              copyName[DAL_FILE_NAME_STRING+32],
+              tmpName[DAL_FILE_NAME_STRING+36],
+              createName[DAL_FILE_NAME_STRING+37];
+    fitsfile *source = NULL,
+             *plain = NULL,
+             *tiled = NULL;
+
+    if (status != ISDC_OK) return status;
+
+    step=ibis_isgr_energyQuantumStep(tolerance);
+    snprintf(copyName, sizeof(copyName), "%s.%ld", outName, (long)getpid());
+    snprintf(tmpName, sizeof(tmpName), "%s.tmp", copyName);
+
+    fits_open_file(&source, fileName, READONLY, &fitsStatus);
+    fits_movnam_hdu(source, BINARY_TBL, extName, 0, &fitsStatus);
+    fits_read_key(source, TLOGICAL, "ZTABLE", &compressed, NULL, &keyStatus);
+    if (fitsStatus == 0 && keyStatus == 0 && compressed) {
+        fits_close_file(source, &fitsStatus);
+        RILlogMessage(NULL, Warning_1, "%s of %s is compressed already", extName, fileName);
+        return status;
+    }
+
+    /* plain copy of the table, the only one rounded and given keywords */
+    snprintf(createName, sizeof(createName), "!%s", copyName);
+    fits_create_file(&plain, createName, &fitsStatus);
+    fits_create_img(plain, BYTE_IMG, 0, NULL, &fitsStatus);
+    fits_copy_hdu(source, plain, 0, &fitsStatus);
+    if (source != NULL) fits_close_file(source, &fitsStatus);
+
+    fits_get_num_rows(plain, &numRows, &fitsStatus);
+    fits_get_colnum(plain, CASEINSEN, "ISGRI_PI", &piCol, &fitsStatus);
+    fits_get_colnum(plain, CASEINSEN, "ISGRI_ENERGY", &energyCol, &fitsStatus);
+    tileRows= numRows < ISGRI_COMPRESS_TILE_ROWS ? (numRows > 0 ? numRows : 1) : ISGRI_COMPRESS_TILE_ROWS;
+
+    /* rounding, one tile at a time */
+    if (fitsStatus == 0 && step > 0. && numRows > 0) {
+        isgriEnergy=(float *)malloc(tileRows*sizeof(float));
+        if (isgriEnergy == NULL) fitsStatus=MEMORY_ALLOCATION;
+        for (first=0; first < numRows && fitsStatus == 0; first+=numRead) {
+            numRead= numRows-first < tileRows ? numRows-first : tileRows;
+            fits_read_col(plain, TFLOAT, energyCol, first+1, 1, numRead, NULL, isgriEnergy, NULL, &fitsStatus);
+            ibis_isgr_energyQuantize(isgriEnergy, numRead, step);
+            fits_write_col(plain, TFLOAT, energyCol, first+1, 1, numRead, isgriEnergy, &fitsStatus);
+        }
+        free(isgriEnergy);
+    }
+
+    /* compression of the table, read by fits_compress_table */
+    fits_update_key(plain, TLONG, "FZTILELN", &tileRows, "rows per compressed tile", &fitsStatus);
+    fits_make_keyn("FZALG", piCol, keyName, &fitsStatus);
+    fits_update_key(plain, TSTRING, keyName, "RICE_1", "compression of ISGRI_PI", &fitsStatus);
+    fits_make_keyn("FZALG", energyCol, keyName, &fitsStatus);
+    fits_update_key(plain, TSTRING, keyName, "GZIP_2", "compression of ISGRI_ENERGY", &fitsStatus);
+    fits_update_key(plain, TDOUBLE, "EQUANT", &step, "[keV] rounding step of ISGRI_ENERGY, 0: exact", &fitsStatus);
+
+    snprintf(createName, sizeof(createName), "!%s", tmpName);
+    fits_create_file(&tiled, createName, &fitsStatus);
+    fits_create_img(tiled, BYTE_IMG, 0, NULL, &fitsStatus);
+    fits_compress_table(plain, tiled, &fitsStatus);
+    fits_write_chksum(tiled, &fitsStatus);
+
+    if (tiled != NULL) fits_close_file(tiled, &fitsStatus);
+    if (plain != NULL) fits_close_file(plain, &fitsStatus);
+    remove(copyName);
+    if (fitsStatus == 0 && rename(tmpName, outName) != 0) fitsStatus=FILE_NOT_CREATED;
+
+    if (fitsStatus != 0) {
+        remove(tmpName);
+        RILlogMessage(NULL, Error_2, "Cannot compress %s of %s to %s (FITS status %d)",
+                      extName, fileName, outName, fitsStatus);
+        return I_ISGR_ERR_COMPRESS;
+    }
+    if (chatter > 1)
+        RILlogMessage(NULL, Log_1, "%ld events of %s of %s compressed to %s (rounding step %g keV)",
+                      numRows, extName, fileName, outName, step);
+    return status;
+}
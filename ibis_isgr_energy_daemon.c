@@ -0,0 +1,522 @@
+/************************************************************************
+ * FILE:        ibis_isgr_energy_daemon.c
+ * VERSION:     9.1
+ * COMPONENT:   ibis_isgr_energy
+ * AUTHOR:      V. Savchenko,   APC & ISDC
+ * DESCRIPTION: daemon mode: jobs with the parameters of the component are
+ *              received on a Unix domain socket and run in one process,
+ *              which keeps the calibration loaded between jobs; and the
+ *              client sending the parameters of the command line as a job
+ * HISTORY:
+ *   VS, 9.1  first version
+ *   VS, 9.1  socket of the user only, request timeout, log to the client
+ *   VS, 9.1  calibration kept loaded between jobs, log lines prefixed
+ ************************************************************************/
+
+#define _GNU_SOURCE                     /* struct ucred */
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "ibis_isgr_energy.h"
+
+
+/* request:  "ibis_isgr_energy <version>", "cwd=<dir>", "<name>=<value>"...,
+ *           "end" (or "stop" to end the daemon), one per line
+ * reply:    each line of the output (log) of the job after "log=", then
+ *           "status=<status>", "stats=<JSON of ibis_isgr_energyStatsJson>" */
+#define DAEMON_LINE    (8*DAL_BIG_STRING)
+#define DAEMON_LOG     "log="
+#define DAEMON_TIMEOUT 30               /* s, to receive a request or send a reply */
+
+/* output of a job, read from a pipe and sent to the client */
+typedef struct {
+    int   fd;
+    FILE *out;
+} ISGRI_energy_relay_struct;
+
+/* parameters sent with each job: all those of ibis_isgr_energy.par but
+   daemon and daemonSocket, with their PIL type */
+static const struct {
+    const char *name;
+    char        type;
+} ibis_isgr_energyJobParameters[] = {
+    { "inGRP",       's' }, { "outCorEvts",  's' }, { "outGRP",      's' },
+    { "inRawEvts",   's' }, { "hkCnvDOL",    's' }, { "inGRPList",   's' },
+    { "riseDOL",     's' }, { "GODOL",       's' }, { "mcecDOL",     's' },
+    { "l2reDOL",     's' }, { "calSnapshot", 's' },
+    { "randSeed",    's' }, { "nThreads",    'i' }, { "streamRows",  'i' },
+    { "pipeline",    'b' }, { "statsFile",   's' }, { "incremental", 'b' },
+    { "useGTI",      'b' }, { "eraseALL",    'b' }, { "gtiRows",     'b' },
+    { "nProcs",      'i' }, { "jobQueue",    's' }, { "spectraFile", 's' },
+    { "calPrefetch", 'b' },
+    { "outCompressed", 'b' }, { "energyTolerance", 'r' },
+    { "chatter",     'i' }
+};
+#define DAEMON_NUM_PARAMETERS \
+    ((int)(sizeof(ibis_isgr_energyJobParameters)/sizeof(ibis_isgr_energyJobParameters[0])))
+
+
+/* removes the end of line; 0 if the line was complete */
+static int ibis_isgr_energyDaemonLine(char *line)
+{
+    size_t length = strlen(line);
+
+    if (length == 0 || line[length-1] != '\n') return 1;
+    line[length-1]='\0';
+    return 0;
+}
+
+
+/* thread sending each line of the job output with the prefix DAEMON_LOG,
+   until the job closes the pipe */
+static void *ibis_isgr_energyDaemonRelay(void *arg)
+{
+    ISGRI_energy_relay_struct *ptr_relay = (ISGRI_energy_relay_struct *)arg;
+    FILE *log;
+    char  line[DAEMON_LINE];
+    int   lineStart = 1;
+
+    log=fdopen(ptr_relay->fd, "r");
+    if (log == NULL) {
+        close(ptr_relay->fd);
+        return NULL;
+    }
+    while (fgets(line, sizeof(line), log) != NULL) {
+        fprintf(ptr_relay->out, "%s%s", lineStart ? DAEMON_LOG : "", line);
+        lineStart= line[strlen(line)-1] == '\n';
+    }
+    if (!lineStart) fputc('\n', ptr_relay->out);
+    fflush(ptr_relay->out);
+    fclose(log);
+
+    return NULL;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyDaemonJob
+ * DESCRIPTION:
+ *  Reads one request, sets its parameters in PIL, runs it from its
+ *  working directory with ibis_isgr_energyRun and sends the status and
+ *  the statistics of the (last) Science Window. While the job runs, the
+ *  standard output and error of the daemon (where RIL writes the log) go
+ *  to a pipe, whose lines are sent to the client after "log="
+ *  (ibis_isgr_energyDaemonRelay): a line of the log cannot be taken for
+ *  the status of the job.
+ *
+ * PARAMETERS:
+ *  in              FILE *    in    request
+ *  out             FILE *    in    reply
+ *  ptr_cal_cache             in/out  calibration kept between jobs
+ *  ptr_stop         int *   out    1 if the daemon must stop
+ * RETURN:            int     status of the job
+ ************************************************************************/
+static int ibis_isgr_energyDaemonJob(FILE *in,
+                                     FILE *out,
+                                     ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                                     int  *ptr_stop)
+{
+    int   i,
+          chatter = 0,
+          savedOut,
+          savedErr,
+          pipeFds[2],
+          relaying = 0,
+          status = ISDC_OK;
+    char  line[DAEMON_LINE],
+          header[DAL_BIG_STRING],
+         *value;
+
+    ibis_isgr_energy_settings_struct ibis_isgr_energy_settings;
+    ISGRI_energy_caldb_dols_struct   ISGRI_energy_caldb_dols;
+    ISGRI_energy_stats_struct        stats;
+    ISGRI_energy_relay_struct        relay;
+    pthread_t                        relayThread;
+
+    memset(&ibis_isgr_energy_settings, 0, sizeof(ibis_isgr_energy_settings));
+    memset(&ISGRI_energy_caldb_dols, 0, sizeof(ISGRI_energy_caldb_dols));
+    memset(&stats, 0, sizeof(stats));
+    ibis_isgr_energy_settings.makeUnique=1;
+    ibis_isgr_energy_settings.stats=&stats;
+
+    snprintf(header, sizeof(header), "%s %s", COMPONENT_NAME, COMPONENT_VERSION);
+
+    do {
+        if (fgets(line, sizeof(line), in) == NULL || ibis_isgr_energyDaemonLine(line) != 0
+            || strcmp(line, header) != 0) {
+            RILlogMessage(NULL, Error_2, "Daemon: request not from %s", header);
+            status=I_ISGR_ERR_DAEMON;
+            break;
+        }
+
+        while (status == ISDC_OK) {
+            if (fgets(line, sizeof(line), in) == NULL || ibis_isgr_energyDaemonLine(line) != 0) {
+                RILlogMessage(NULL, Error_2, "Daemon: truncated request");
+                status=I_ISGR_ERR_DAEMON;
+                break;
+            }
+            if (strcmp(line, "end") == 0) break;
+            if (strcmp(line, "stop") == 0) {
+                *ptr_stop=1;
+                break;
+            }
+
+            value=strchr(line, '=');
+            if (value == NULL) {
+                RILlogMessage(NULL, Error_2, "Daemon: bad request line '%s'", line);
+                status=I_ISGR_ERR_DAEMON;
+                break;
+            }
+            *value++='\0';
+
+            if (strcmp(line, "cwd") == 0) {
+                if (chdir(value) != 0) {
+                    RILlogMessage(NULL, Error_2, "Daemon: cannot change to directory %s", value);
+                    status=I_ISGR_ERR_DAEMON;
+                }
+                continue;
+            }
+
+            for (i=0; i < DAEMON_NUM_PARAMETERS; i++)
+                if (strcmp(line, ibis_isgr_energyJobParameters[i].name) == 0) break;
+            if (i == DAEMON_NUM_PARAMETERS) {
+                RILlogMessage(NULL, Error_2, "Daemon: unknown parameter '%s'", line);
+                status=I_ISGR_ERR_DAEMON;
+                break;
+            }
+            switch (ibis_isgr_energyJobParameters[i].type) {
+                case 'i': status=PILPutInt(line, atoi(value));  break;
+                case 'b': status=PILPutBool(line, atoi(value)); break;
+                case 'r': status=PILPutReal(line, atof(value)); break;
+                default:  status=PILPutString(line, value);     break;
+            }
+            if (status != ISDC_OK)
+                RILlogMessage(NULL, Error_2, "Daemon: cannot set parameter %s. Status=%d", line, status);
+        }
+        if (status != ISDC_OK || *ptr_stop) break;
+
+        fflush(stdout);
+        fflush(stderr);
+        savedOut=dup(STDOUT_FILENO);
+        savedErr=dup(STDERR_FILENO);
+        if (savedOut >= 0 && savedErr >= 0 && pipe(pipeFds) == 0) {
+            relay.fd=pipeFds[0];
+            relay.out=out;
+            relaying=(pthread_create(&relayThread, NULL, ibis_isgr_energyDaemonRelay, &relay) == 0);
+            if (relaying) {
+                dup2(pipeFds[1], STDOUT_FILENO);
+                dup2(pipeFds[1], STDERR_FILENO);
+            } else
+                close(pipeFds[0]);
+            close(pipeFds[1]);
+        }
+
+        status=ibis_isgr_energyRun(&ibis_isgr_energy_settings, &ISGRI_energy_caldb_dols,
+                                   ptr_cal_cache, &chatter, status);
+
+        fflush(stdout);
+        fflush(stderr);
+        if (relaying) {
+            /* the last writer closed: the relay sends the rest and ends */
+            dup2(savedOut, STDOUT_FILENO);
+            dup2(savedErr, STDERR_FILENO);
+            pthread_join(relayThread, NULL);
+        }
+        if (savedOut >= 0) close(savedOut);
+        if (savedErr >= 0) close(savedErr);
+    } while(0);
+
+    fprintf(out, "status=%d\n", status);
+    if (stats.numStages > 0) {
+        fprintf(out, "stats=");
+        ibis_isgr_energyStatsJson(out, &stats, status);
+        fprintf(out, "\n");
+    }
+
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyDaemon
+ * DESCRIPTION:
+ *  Serves jobs on the Unix domain socket socketName until a "stop"
+ *  request. Jobs are run one at a time; the libraries and PIL stay loaded
+ *  from one job to the next, and the calibration too, as in batch mode
+ *  (ptr_cal_cache->select): an index is searched again, and a table
+ *  loaded again, only when a Science Window is out of the validity of
+ *  the table selected. The calibration is freed when the daemon stops.
+ *  A failing job is reported to its client and the daemon goes on.
+ *  The socket is only accessible to the user of the daemon (mode 0600),
+ *  and a client of another user (SO_PEERCRED) is refused: a job runs in
+ *  any directory and writes any file the daemon can. A client not sending
+ *  its request within DAEMON_TIMEOUT seconds is dropped.
+ * ERROR CODES:
+ *  I_ISGR_ERR_DAEMON    if the socket cannot be created
+ *
+ * PARAMETERS:
+ *  socketName      char *    in    path of the socket
+ *  ptr_cal_cache             in/out  calibration kept between jobs
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyDaemon(char *socketName,
+                           ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                           int   status)
+{
+    int    listenFd,
+           connFd,
+           jobStatus,
+           bound,
+           stop = 0;
+    mode_t mask;
+    socklen_t length;
+    long   numJobs = 0,
+           numFailed = 0;
+    char   home[DAL_FILE_NAME_STRING];
+    FILE  *in,
+          *out;
+
+    struct sockaddr_un address;
+    struct ucred       peer;
+    struct timeval     timeout;
+
+    if (status != ISDC_OK) return status;
+
+    if (strlen(socketName) >= sizeof(address.sun_path)) {
+        RILlogMessage(NULL, Error_2, "Daemon: socket name too long: %s", socketName);
+        return I_ISGR_ERR_DAEMON;
+    }
+    if (getcwd(home, sizeof(home)) == NULL) home[0]='\0';
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family=AF_UNIX;
+    strcpy(address.sun_path, socketName);
+
+    listenFd=socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        RILlogMessage(NULL, Error_2, "Daemon: cannot create socket: %s", strerror(errno));
+        return I_ISGR_ERR_DAEMON;
+    }
+    unlink(socketName);
+    mask=umask(0077);
+    bound=bind(listenFd, (struct sockaddr *)&address, sizeof(address));
+    umask(mask);
+    if (bound != 0 || chmod(socketName, 0600) != 0 || listen(listenFd, 16) != 0) {
+        RILlogMessage(NULL, Error_2, "Daemon: cannot listen on %s: %s", socketName, strerror(errno));
+        close(listenFd);
+        return I_ISGR_ERR_DAEMON;
+    }
+
+    /* a client going away must not end the daemon */
+    signal(SIGPIPE, SIG_IGN);
+
+    ptr_cal_cache->select=1;
+    RILlogMessage(NULL, Log_2, "Daemon: waiting for jobs on %s", socketName);
+
+    while (!stop) {
+        connFd=accept(listenFd, NULL, NULL);
+        if (connFd < 0) {
+            if (errno == EINTR) continue;
+            RILlogMessage(NULL, Error_2, "Daemon: accept failed: %s", strerror(errno));
+            status=I_ISGR_ERR_DAEMON;
+            break;
+        }
+
+        length=sizeof(peer);
+        if (getsockopt(connFd, SOL_SOCKET, SO_PEERCRED, &peer, &length) != 0
+            || peer.uid != getuid()) {
+            RILlogMessage(NULL, Warning_1, "Daemon: client of another user refused");
+            close(connFd);
+            continue;
+        }
+        timeout.tv_sec=DAEMON_TIMEOUT;
+        timeout.tv_usec=0;
+        setsockopt(connFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(connFd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        in=fdopen(connFd, "r");
+        out= in == NULL ? NULL : fdopen(dup(connFd), "w");
+        if (in == NULL || out == NULL) {
+            if (in != NULL) fclose(in);
+            else            close(connFd);
+            continue;
+        }
+
+        jobStatus=ibis_isgr_energyDaemonJob(in, out, ptr_cal_cache, &stop);
+        fclose(out);
+        fclose(in);
+
+        if (home[0] != '\0' && chdir(home) != 0)
+            RILlogMessage(NULL, Warning_1, "Daemon: cannot return to %s", home);
+
+        if (stop) break;
+        numJobs++;
+        if (jobStatus != ISDC_OK) numFailed++;
+        RILlogMessage(NULL, Log_1, "Daemon: job %ld done with status=%d", numJobs, jobStatus);
+    }
+
+    close(listenFd);
+    unlink(socketName);
+
+    RILlogMessage(NULL, Log_2, "Daemon: %ld jobs, %ld failed; %ld calibration tables loaded, %ld kept loaded",
+                  numJobs, numFailed, ptr_cal_cache->nLoads, ptr_cal_cache->nReuses);
+    status=ibis_isgr_energyCalRelease(ptr_cal_cache, status);
+
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyClient
+ * DESCRIPTION:
+ *  Sends the parameters of this run (as given on the command line or in
+ *  the parameter file) to the daemon listening on socketName, waits for
+ *  the job and returns its status. The output of the job (the lines of
+ *  the reply after "log=") is written to the standard output; only the
+ *  "status=" and "stats=" lines of the reply are taken as the result of
+ *  the job. If no daemon answers, ptr_served is 0
+ *  and the run is done locally, as without daemonSocket.
+ * ERROR CODES:
+ *  PIL error codes
+ *  I_ISGR_ERR_DAEMON    if the daemon did not answer the job
+ *  status of the job otherwise
+ *
+ * PARAMETERS:
+ *  socketName      char *    in    path of the socket
+ *  ptr_served       int *   out    1 if the job was sent to the daemon
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyClient(char *socketName,
+                           int  *ptr_served,
+                           int   status)
+{
+    int    i,
+           fd,
+           intValue,
+           chatter = 0,
+           complete,
+           printing = 0,
+           continued = 0,
+           jobStatus = I_ISGR_ERR_DAEMON;
+    double realValue;
+    char   line[DAEMON_LINE],
+           value[DAL_FILE_NAME_STRING],
+           cwd[DAL_FILE_NAME_STRING];
+    char  *request = NULL;
+    size_t requestSize = 0;
+    FILE  *requestFile,
+          *in,
+          *out;
+
+    struct sockaddr_un address;
+
+    *ptr_served=0;
+    if (status != ISDC_OK) return status;
+
+    if (strlen(socketName) >= sizeof(address.sun_path) || getcwd(cwd, sizeof(cwd)) == NULL) {
+        RILlogMessage(NULL, Warning_1, "Cannot use daemon socket %s: processing locally", socketName);
+        return status;
+    }
+
+    /* the request is complete before connecting, parameters prompted if needed */
+    requestFile=open_memstream(&request, &requestSize);
+    if (requestFile == NULL) return I_ISGR_ERR_MEMORY;
+    fprintf(requestFile, "%s %s\ncwd=%s\n", COMPONENT_NAME, COMPONENT_VERSION, cwd);
+    for (i=0; i < DAEMON_NUM_PARAMETERS && status == ISDC_OK; i++) {
+        switch (ibis_isgr_energyJobParameters[i].type) {
+            case 'i':
+                status=PILGetInt(ibis_isgr_energyJobParameters[i].name, &intValue);
+                snprintf(value, sizeof(value), "%d", intValue);
+                if (strcmp(ibis_isgr_energyJobParameters[i].name, "chatter") == 0) chatter=intValue;
+                break;
+            case 'b':
+                status=PILGetBool(ibis_isgr_energyJobParameters[i].name, &intValue);
+                snprintf(value, sizeof(value), "%d", intValue != 0);
+                break;
+            case 'r':
+                status=PILGetReal(ibis_isgr_energyJobParameters[i].name, &realValue);
+                snprintf(value, sizeof(value), "%.17g", realValue);
+                break;
+            default:
+                status=PILGetString(ibis_isgr_energyJobParameters[i].name, value);
+                break;
+        }
+        if (status != ISDC_OK)
+            RILlogMessage(NULL, Error_2, "reading %s parameter", ibis_isgr_energyJobParameters[i].name);
+        else if (strchr(value, '\n') != NULL) {
+            RILlogMessage(NULL, Error_2, "The parameter '%s' contains an end of line", ibis_isgr_energyJobParameters[i].name);
+            status=I_ISGR_ERR_BAD_INPUT;
+        } else
+            fprintf(requestFile, "%s=%s\n", ibis_isgr_energyJobParameters[i].name, value);
+    }
+    fprintf(requestFile, "end\n");
+    fclose(requestFile);
+    if (status != ISDC_OK) {
+        free(request);
+        return status;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family=AF_UNIX;
+    strcpy(address.sun_path, socketName);
+
+    fd=socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        RILlogMessage(NULL, Warning_1, "No daemon on %s (%s): processing locally", socketName, strerror(errno));
+        if (fd >= 0) close(fd);
+        free(request);
+        return status;
+    }
+    *ptr_served=1;
+
+    signal(SIGPIPE, SIG_IGN);
+    out=fdopen(fd, "w");
+    in= out == NULL ? NULL : fdopen(dup(fd), "r");
+    if (in == NULL || out == NULL) {
+        if (out != NULL) fclose(out);
+        else             close(fd);
+        free(request);
+        return I_ISGR_ERR_DAEMON;
+    }
+
+    fwrite(request, 1, requestSize, out);
+    fflush(out);
+    free(request);
+
+    if (chatter > 1)
+        RILlogMessage(NULL, Log_1, "Job sent to the daemon on %s", socketName);
+
+    /* a line longer than the buffer is read in parts (continued) */
+    while (fgets(line, sizeof(line), in) != NULL) {
+        complete= ibis_isgr_energyDaemonLine(line) == 0;
+        if (continued) {
+            if (printing) printf("%s", line);
+        } else if (strncmp(line, DAEMON_LOG, strlen(DAEMON_LOG)) == 0) {
+            printing=1;
+            printf("%s", line+strlen(DAEMON_LOG));
+        } else {
+            printing=0;
+            if (strncmp(line, "status=", 7) == 0)
+                jobStatus=atoi(line+7);
+            else if (strncmp(line, "stats=", 6) == 0 && chatter > 2)
+                RILlogMessage(NULL, Log_0, "Daemon statistics: %s", line+6);
+        }
+        if (complete && printing) printf("\n");
+        continued=!complete;
+    }
+    fflush(stdout);
+    fclose(out);
+    fclose(in);
+
+    if (jobStatus == I_ISGR_ERR_DAEMON)
+        RILlogMessage(NULL, Error_2, "No status from the daemon on %s", socketName);
+    else
+        RILlogMessage(NULL, Log_2, "Daemon job done with status=%d", jobStatus);
+
+    return jobStatus;
+}
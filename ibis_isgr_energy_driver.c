@@ -0,0 +1,551 @@
+/************************************************************************
+ * FILE:        ibis_isgr_energy_driver.c
+ * VERSION:     9.1
+ * COMPONENT:   ibis_isgr_energy
+ * AUTHOR:      V. Savchenko,   APC & ISDC
+ * DESCRIPTION: revolution driver: the Science Windows of the batch list
+ *              are processed by nProcs worker processes, which take them
+ *              from a job queue file shared under a file lock, the ones
+ *              with the most events first
+ * HISTORY:
+ *   VS, 9.1  first version
+ *   VS, 9.1  groups opened as inGRP, only memory and worker failures retried
+ *   VS, 9.1  output of each job compressed in its file (outCompressed)
+ ************************************************************************/
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/file.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "ibis_isgr_energy.h"
+
+
+/* wall time, s */
+static double ibis_isgr_energyDriverWall(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
+
+/* opens the queue file and waits for its lock */
+static FILE *ibis_isgr_energyQueueLock(char *queueName)
+{
+    FILE *queueFile;
+
+    if ((queueFile=fopen(queueName, "r+")) == NULL) return NULL;
+    while (flock(fileno(queueFile), LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            fclose(queueFile);
+            return NULL;
+        }
+    }
+    return queueFile;
+}
+
+
+/* writes the queue file, releases its lock and closes it */
+static int ibis_isgr_energyQueueUnlock(FILE *queueFile)
+{
+    int failed;
+
+    failed=(fflush(queueFile) != 0);
+    flock(fileno(queueFile), LOCK_UN);
+    failed|=(fclose(queueFile) != 0);
+
+    return failed ? I_ISGR_ERR_DRIVER : ISDC_OK;
+}
+
+
+/* reads the jobs of the (locked) queue file, returns their number */
+static long ibis_isgr_energyQueueRead(FILE                    *queueFile,
+                                      ISGRI_energy_job_struct *jobs,
+                                      long                     maxJobs)
+{
+    char  line[DAL_FILE_NAME_STRING+DAL_BIG_STRING],
+         *DOL;
+    int   offset;
+    long  numJobs = 0;
+
+    rewind(queueFile);
+    while (numJobs < maxJobs && fgets(line, sizeof(line), queueFile) != NULL) {
+        offset=0;
+        if (sscanf(line, "%c %d %d %ld %ld %lf %n", &jobs[numJobs].state, &jobs[numJobs].attempts,
+                   &jobs[numJobs].status, &jobs[numJobs].pid, &jobs[numJobs].numEvents,
+                   &jobs[numJobs].wall, &offset) < 6 || offset == 0)
+            continue;
+        if ((DOL=ibis_isgr_energyListEntry(line+offset)) == NULL) continue;
+        snprintf(jobs[numJobs].DOL, DAL_FILE_NAME_STRING, "%s", DOL);
+        numJobs++;
+    }
+    return numJobs;
+}
+
+
+/* rewrites the (locked) queue file */
+static int ibis_isgr_energyQueueWrite(FILE                    *queueFile,
+                                      ISGRI_energy_job_struct *jobs,
+                                      long                     numJobs)
+{
+    long i;
+
+    rewind(queueFile);
+    for (i=0; i < numJobs; i++)
+        fprintf(queueFile, "%c %d %d %ld %ld %.3f %s\n", jobs[i].state, jobs[i].attempts,
+                jobs[i].status, jobs[i].pid, jobs[i].numEvents, jobs[i].wall, jobs[i].DOL);
+    if (fflush(queueFile) != 0 || ftruncate(fileno(queueFile), ftell(queueFile)) != 0)
+        return I_ISGR_ERR_DRIVER;
+
+    return ISDC_OK;
+}
+
+
+/* 1 if a job failing with this status may succeed when run again: only
+   memory and worker failures are retried, any other status (inputs,
+   calibration, parameters, DAL, or -1 of the steps of
+   ibis_isgr_energyWork) fails the Science Window */
+static int ibis_isgr_energyRetryable(int status)
+{
+    return status == I_ISGR_ERR_MEMORY || status == I_ISGR_ERR_PARALLEL
+           || status == I_ISGR_ERR_DRIVER;
+}
+
+
+/* largest number of events first */
+static int ibis_isgr_energyJobCompare(const void *a, const void *b)
+{
+    const ISGRI_energy_job_struct *jobA = (const ISGRI_energy_job_struct *)a,
+                                  *jobB = (const ISGRI_energy_job_struct *)b;
+
+    if (jobA->numEvents != jobB->numEvents)
+        return jobA->numEvents > jobB->numEvents ? -1 : 1;
+    return 0;
+}
+
+
+/* rows of ISGR-EVTS-ALL of a group, opened as by the run (inRawEvts) */
+static int ibis_isgr_energyJobEvents(char *DOL,
+                                     ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                                     long *numEvents,
+                                     int   status)
+{
+    dal_element *workGRP = NULL,
+                *rawTable = NULL;
+
+    *numEvents=0;
+    if (status != ISDC_OK) return status;
+
+    status=ibis_isgr_energyOpenGroup(DOL, ptr_ibis_isgr_energy_settings, &workGRP, status);
+    status=DALobjectFindElement(workGRP, DS_ISGR_RAW, &rawTable, status);
+    status=DALtableGetNumRows(rawTable, numEvents, status);
+    if (workGRP != NULL)
+        CommonCloseSWG(workGRP, ISDC_OK);
+
+    return status;
+}
+
+
+/* worker process: runs the pending jobs of the queue until there is none */
+static void ibis_isgr_energyDriverWorker(char                             *queueName,
+                                         long                              maxJobs,
+                                         ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                                         ISGRI_energy_caldb_dols_struct   *ptr_ISGRI_energy_caldb_dols,
+                                         ISGRI_energy_job_struct          *jobs,
+                                         int                               chatter)
+{
+    long   i,
+           numJobs,
+           numRun = 0;
+    int    jobStatus;
+    char   DOL[DAL_FILE_NAME_STRING];
+    double wallStart;
+    FILE  *queueFile;
+
+    dal_element *workGRP;
+    ISGRI_energy_cal_cache_struct cal_cache;
+
+    /* this process keeps its own calibration, as a batch does */
+    memset(&cal_cache, 0, sizeof(cal_cache));
+    cal_cache.select=1;
+
+    for (;;) {
+        if ((queueFile=ibis_isgr_energyQueueLock(queueName)) == NULL) {
+            RILlogMessage(NULL, Error_2, "Worker %ld: cannot lock %s", (long)getpid(), queueName);
+            fflush(NULL);
+            _exit(1);
+        }
+        numJobs=ibis_isgr_energyQueueRead(queueFile, jobs, maxJobs);
+        for (i=0; i < numJobs && jobs[i].state != ISGRI_JOB_PENDING; i++) ;
+        if (i == numJobs) {
+            ibis_isgr_energyQueueUnlock(queueFile);
+            break;
+        }
+        jobs[i].state=ISGRI_JOB_RUNNING;
+        jobs[i].pid=(long)getpid();
+        jobs[i].attempts++;
+        snprintf(DOL, DAL_FILE_NAME_STRING, "%s", jobs[i].DOL);
+        jobStatus=ibis_isgr_energyQueueWrite(queueFile, jobs, numJobs);
+        jobStatus=ibis_isgr_energyQueueUnlock(queueFile) != ISDC_OK ? I_ISGR_ERR_DRIVER : jobStatus;
+        if (jobStatus != ISDC_OK) {
+            RILlogMessage(NULL, Error_2, "Worker %ld: cannot update %s", (long)getpid(), queueName);
+            fflush(NULL);
+            _exit(1);
+        }
+
+        RILlogMessage(NULL, Log_1, "Worker %ld: Science Window %s", (long)getpid(), DOL);
+        wallStart=ibis_isgr_energyDriverWall();
+        workGRP=NULL;
+        jobStatus=ibis_isgr_energyOpenGroup(DOL, ptr_ibis_isgr_energy_settings, &workGRP, ISDC_OK);
+        if (jobStatus == ISDC_OK) {
+            jobStatus=ibis_isgr_energyWork(workGRP, ptr_ibis_isgr_energy_settings,
+                                           ptr_ISGRI_energy_caldb_dols, &cal_cache,
+                                           chatter, jobStatus);
+            jobStatus=CommonCloseSWG(workGRP, jobStatus);
+            jobStatus=ibis_isgr_energyCompressOut(ptr_ibis_isgr_energy_settings, chatter, jobStatus);
+        }
+        numRun++;
+
+        /* the queue may have changed: find the job again */
+        if ((queueFile=ibis_isgr_energyQueueLock(queueName)) == NULL) {
+            RILlogMessage(NULL, Error_2, "Worker %ld: cannot lock %s", (long)getpid(), queueName);
+            fflush(NULL);
+            _exit(1);
+        }
+        numJobs=ibis_isgr_energyQueueRead(queueFile, jobs, maxJobs);
+        for (i=0; i < numJobs; i++) {
+            if (jobs[i].state != ISGRI_JOB_RUNNING || jobs[i].pid != (long)getpid()
+                || strcmp(jobs[i].DOL, DOL) != 0)
+                continue;
+            jobs[i].status=jobStatus;
+            jobs[i].wall=ibis_isgr_energyDriverWall()-wallStart;
+            if (jobStatus == ISDC_OK)
+                jobs[i].state=ISGRI_JOB_DONE;
+            else if (ibis_isgr_energyRetryable(jobStatus) && jobs[i].attempts < ISGRI_JOB_ATTEMPTS)
+                jobs[i].state=ISGRI_JOB_PENDING;
+            else
+                jobs[i].state=ISGRI_JOB_FAILED;
+            if (jobStatus != ISDC_OK)
+                RILlogMessage(NULL, Warning_1, "%s: attempt %d failed with status %d%s", DOL,
+                              jobs[i].attempts, jobStatus,
+                              jobs[i].state == ISGRI_JOB_PENDING ? ", queued again" : "");
+            break;
+        }
+        jobStatus=ibis_isgr_energyQueueWrite(queueFile, jobs, numJobs);
+        jobStatus=ibis_isgr_energyQueueUnlock(queueFile) != ISDC_OK ? I_ISGR_ERR_DRIVER : jobStatus;
+        if (jobStatus != ISDC_OK) {
+            RILlogMessage(NULL, Error_2, "Worker %ld: cannot update %s", (long)getpid(), queueName);
+            fflush(NULL);
+            _exit(1);
+        }
+    }
+
+    ibis_isgr_energyCalRelease(&cal_cache, ISDC_OK);
+    if (chatter > 1)
+        RILlogMessage(NULL, Log_1, "Worker %ld: %ld Science Windows, %ld calibration tables loaded, %ld kept loaded",
+                      (long)getpid(), numRun, cal_cache.nLoads, cal_cache.nReuses);
+    fflush(NULL);
+    /* no exit handlers: they belong to the driver */
+    _exit(0);
+}
+
+
+/* starts a worker, returns its pid (-1 on failure) */
+static pid_t ibis_isgr_energyDriverStart(char                             *queueName,
+                                         long                              maxJobs,
+                                         ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                                         ISGRI_energy_caldb_dols_struct   *ptr_ISGRI_energy_caldb_dols,
+                                         ISGRI_energy_job_struct          *jobs,
+                                         int                               chatter)
+{
+    pid_t pid;
+
+    fflush(NULL);
+    pid=fork();
+    if (pid == 0)
+        ibis_isgr_energyDriverWorker(queueName, maxJobs, ptr_ibis_isgr_energy_settings,
+                                     ptr_ISGRI_energy_caldb_dols, jobs, chatter);
+    if (pid < 0)
+        RILlogMessage(NULL, Error_2, "Cannot start a worker process (errno %d)", errno);
+
+    return pid;
+}
+
+
+/* requeues (or fails) the jobs left running by a worker which died,
+   returns the number of pending jobs */
+static long ibis_isgr_energyDriverReclaim(char                    *queueName,
+                                          ISGRI_energy_job_struct *jobs,
+                                          long                     maxJobs,
+                                          pid_t                    pid)
+{
+    long  i,
+          numJobs,
+          numPending = 0;
+    FILE *queueFile;
+
+    if ((queueFile=ibis_isgr_energyQueueLock(queueName)) == NULL) return 0;
+    numJobs=ibis_isgr_energyQueueRead(queueFile, jobs, maxJobs);
+    for (i=0; i < numJobs; i++) {
+        if (pid > 0 && jobs[i].state == ISGRI_JOB_RUNNING && jobs[i].pid == (long)pid) {
+            jobs[i].status=I_ISGR_ERR_DRIVER;
+            jobs[i].state= jobs[i].attempts < ISGRI_JOB_ATTEMPTS ? ISGRI_JOB_PENDING : ISGRI_JOB_FAILED;
+            RILlogMessage(NULL, Warning_1, "%s: worker %ld died during attempt %d%s", jobs[i].DOL,
+                          (long)pid, jobs[i].attempts,
+                          jobs[i].state == ISGRI_JOB_PENDING ? ", queued again" : "");
+        }
+        if (jobs[i].state == ISGRI_JOB_PENDING) numPending++;
+    }
+    if (pid > 0)
+        ibis_isgr_energyQueueWrite(queueFile, jobs, numJobs);
+    ibis_isgr_energyQueueUnlock(queueFile);
+
+    return numPending;
+}
+
+
+/* consolidated report of the queue: JSON file and log */
+static int ibis_isgr_energyDriverReport(char                    *reportName,
+                                        ISGRI_energy_job_struct *jobs,
+                                        long                     numJobs,
+                                        int                      nProcs,
+                                        double                   wall,
+                                        int                      chatter)
+{
+    long   i,
+           numDone = 0,
+           numFailed = 0,
+           numRetries = 0;
+    double events = 0.,
+           busy = 0.;
+    FILE  *reportFile;
+
+    for (i=0; i < numJobs; i++) {
+        if (jobs[i].state == ISGRI_JOB_DONE) {
+            numDone++;
+            events+=jobs[i].numEvents;
+        } else {
+            numFailed++;
+        }
+        if (jobs[i].attempts > 1) numRetries+=jobs[i].attempts-1;
+        busy+=jobs[i].wall;
+    }
+    if (wall <= 0.) wall=1.0e-6;
+
+    RILlogMessage(NULL, Log_1, "Driver: %ld Science Windows, %ld failed, %ld retries, %d workers",
+                  numJobs, numFailed, numRetries, nProcs);
+    RILlogMessage(NULL, Log_1, "Driver: %.0f events in %.1f s (%.0f events/s), workers busy %.0f%%",
+                  events, wall, events/wall, 100.*busy/(nProcs*wall));
+    if (chatter > 2)
+        for (i=0; i < numJobs; i++)
+            RILlogMessage(NULL, Log_0, "  %c %9ld events %8.1f s  %d attempt(s)  status %d  %s",
+                          jobs[i].state, jobs[i].numEvents, jobs[i].wall,
+                          jobs[i].attempts, jobs[i].status, jobs[i].DOL);
+
+    if ((reportFile=fopen(reportName, "w")) == NULL) {
+        RILlogMessage(NULL, Warning_1, "Cannot write the report %s", reportName);
+        return ISDC_OK;
+    }
+    fprintf(reportFile, "{\"component\":\"%s\",\"version\":\"%s\",\"workers\":%d,"
+                        "\"jobs\":%ld,\"done\":%ld,\"failed\":%ld,\"retries\":%ld,"
+                        "\"wall_s\":%.3f,\"busy_s\":%.3f,\"utilization\":%.4f,"
+                        "\"events\":%.0f,\"events_per_s\":%.1f,\"scw\":[",
+            COMPONENT_NAME, COMPONENT_VERSION, nProcs, numJobs, numDone, numFailed, numRetries,
+            wall, busy, busy/(nProcs*wall), events, events/wall);
+    for (i=0; i < numJobs; i++) {
+        fprintf(reportFile, "%s{\"dol\":", i > 0 ? "," : "");
+        ibis_isgr_energyStatsJsonString(reportFile, jobs[i].DOL);
+        fprintf(reportFile, ",\"state\":\"%c\",\"events\":%ld,\"wall_s\":%.3f,\"attempts\":%d,\"status\":%d}",
+                jobs[i].state, jobs[i].numEvents, jobs[i].wall, jobs[i].attempts, jobs[i].status);
+    }
+    fprintf(reportFile, "]}\n");
+    if (fclose(reportFile) != 0)
+        RILlogMessage(NULL, Warning_1, "Cannot write the report %s", reportName);
+
+    return ISDC_OK;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyDriver
+ * DESCRIPTION:
+ *  Batch mode by nProcs worker processes. The groups of the list are
+ *  opened once as by a single run (ibis_isgr_energyOpenGroup, so that
+ *  inRawEvts and hkCnvDOL apply) to count the rows of ISGR-EVTS-ALL,
+ *  and written to the
+ *  job queue file (jobQueue, else <inGRPList>.queue) with the most events
+ *  first. Each worker takes the first pending job of the queue under an
+ *  exclusive lock of the file, processes it with its own calibration
+ *  selection, records the result, and takes the next one until none is
+ *  left, so that the long Science Windows start first and the short ones
+ *  fill the idle workers at the end. A job failing with a retryable
+ *  status (memory or worker failure, ibis_isgr_energyRetryable), or
+ *  whose worker died, is queued
+ *  again, at most ISGRI_JOB_ATTEMPTS times; a dead worker is replaced
+ *  while jobs are pending. The consolidated throughput report is written
+ *  to <queue>.json.
+ * ERROR CODES:
+ *  I_ISGR_ERR_BATCH_LIST     if the list cannot be read or is empty
+ *  I_ISGR_ERR_DRIVER         if the queue cannot be written or no worker
+ *                            can be started
+ *  status of the first failed job (in queue order)
+ *
+ * PARAMETERS:
+ *  ptr_ibis_isgr_energy_settings  in  settings (grpList, nProcs, jobQueue)
+ *  ptr_ISGRI_energy_caldb_dols    in  calibration DOLs
+ *  chatter           int      in   verbosity level
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyDriver(ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                           ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                           int chatter,
+                           int status)
+{
+    FILE   *listFile,
+           *queueFile;
+    char    line[DAL_FILE_NAME_STRING],
+            queueName[DAL_FILE_NAME_STRING],
+            reportName[DAL_FILE_NAME_STRING+8],
+           *grpName;
+    long    i,
+            numJobs = 0,
+            maxJobs = 0,
+            numPending;
+    int     nProcs,
+            numRunning = 0,
+            exitStatus,
+            firstError = ISDC_OK;
+    pid_t   pid,
+           *workers = NULL;
+    double  wallStart;
+
+    ISGRI_energy_job_struct *jobs = NULL;
+
+    if (status != ISDC_OK) return status;
+
+    wallStart=ibis_isgr_energyDriverWall();
+
+    if (strlen(ptr_ibis_isgr_energy_settings->jobQueue) > 0)
+        snprintf(queueName, DAL_FILE_NAME_STRING, "%s", ptr_ibis_isgr_energy_settings->jobQueue);
+    else
+        snprintf(queueName, DAL_FILE_NAME_STRING, "%s.queue", ptr_ibis_isgr_energy_settings->grpList);
+    snprintf(reportName, sizeof(reportName), "%s.json", queueName);
+
+    listFile=fopen(ptr_ibis_isgr_energy_settings->grpList, "r");
+    if (listFile == NULL) {
+        RILlogMessage(NULL, Error_2, "Cannot open list of groups %s",
+                      ptr_ibis_isgr_energy_settings->grpList);
+        return I_ISGR_ERR_BATCH_LIST;
+    }
+    while (fgets(line, DAL_FILE_NAME_STRING, listFile) != NULL) maxJobs++;
+
+    do {
+        jobs=(ISGRI_energy_job_struct *)calloc(maxJobs+1, sizeof(ISGRI_energy_job_struct));
+        if (jobs == NULL) {
+            status=I_ISGR_ERR_MEMORY;
+            break;
+        }
+
+        /* jobs, with the most events first */
+        rewind(listFile);
+        while (numJobs < maxJobs && fgets(line, DAL_FILE_NAME_STRING, listFile) != NULL) {
+            if ((grpName=ibis_isgr_energyListEntry(line)) == NULL) continue;
+            snprintf(jobs[numJobs].DOL, DAL_FILE_NAME_STRING, "%s", grpName);
+            jobs[numJobs].state=ISGRI_JOB_PENDING;
+            jobs[numJobs].status=ibis_isgr_energyJobEvents(grpName, ptr_ibis_isgr_energy_settings, &jobs[numJobs].numEvents, ISDC_OK);
+            if (jobs[numJobs].status != ISDC_OK) {
+                RILlogMessage(NULL, Error_2, "Cannot read %s of %s. Status=%d",
+                              DS_ISGR_RAW, grpName, jobs[numJobs].status);
+                jobs[numJobs].state=ISGRI_JOB_FAILED;
+            }
+            numJobs++;
+        }
+        if (numJobs == 0) {
+            RILlogMessage(NULL, Error_2, "No group found in %s", ptr_ibis_isgr_energy_settings->grpList);
+            status=I_ISGR_ERR_BATCH_LIST;
+            break;
+        }
+        qsort(jobs, numJobs, sizeof(ISGRI_energy_job_struct), ibis_isgr_energyJobCompare);
+
+        if ((queueFile=fopen(queueName, "w")) == NULL
+            || ibis_isgr_energyQueueWrite(queueFile, jobs, numJobs) != ISDC_OK
+            || fclose(queueFile) != 0) {
+            RILlogMessage(NULL, Error_2, "Cannot write the job queue %s", queueName);
+            status=I_ISGR_ERR_DRIVER;
+            break;
+        }
+
+        nProcs=ptr_ibis_isgr_energy_settings->nProcs;
+        if (nProcs > numJobs) nProcs=(int)numJobs;
+        RILlogMessage(NULL, Log_1, "Driver: %ld Science Windows in %s, %d workers",
+                      numJobs, queueName, nProcs);
+
+        workers=(pid_t *)calloc(nProcs, sizeof(pid_t));
+        if (workers == NULL) {
+            status=I_ISGR_ERR_MEMORY;
+            break;
+        }
+        for (i=0; i < nProcs; i++) {
+            workers[i]=ibis_isgr_energyDriverStart(queueName, maxJobs, ptr_ibis_isgr_energy_settings,
+                                                   ptr_ISGRI_energy_caldb_dols, jobs, chatter);
+            if (workers[i] > 0) numRunning++;
+        }
+        if (numRunning == 0) {
+            status=I_ISGR_ERR_DRIVER;
+            break;
+        }
+
+        while (numRunning > 0) {
+            pid=waitpid(-1, &exitStatus, 0);
+            if (pid < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            for (i=0; i < nProcs && workers[i] != pid; i++) ;
+            if (i == nProcs) continue;
+            workers[i]=0;
+            numRunning--;
+
+            if (WIFEXITED(exitStatus) && WEXITSTATUS(exitStatus) == 0) {
+                numPending=ibis_isgr_energyDriverReclaim(queueName, jobs, maxJobs, 0);
+            } else {
+                RILlogMessage(NULL, Warning_1, "Worker %ld ended abnormally (%s %d)", (long)pid,
+                              WIFSIGNALED(exitStatus) ? "signal" : "exit",
+                              WIFSIGNALED(exitStatus) ? WTERMSIG(exitStatus) : WEXITSTATUS(exitStatus));
+                numPending=ibis_isgr_energyDriverReclaim(queueName, jobs, maxJobs, pid);
+            }
+            /* replace it while jobs are left for it */
+            if (numPending > numRunning) {
+                workers[i]=ibis_isgr_energyDriverStart(queueName, maxJobs, ptr_ibis_isgr_energy_settings,
+                                                       ptr_ISGRI_energy_caldb_dols, jobs, chatter);
+                if (workers[i] > 0) numRunning++;
+                else                workers[i]=0;
+            }
+        }
+
+        if ((queueFile=ibis_isgr_energyQueueLock(queueName)) == NULL) {
+            RILlogMessage(NULL, Error_2, "Cannot read the job queue %s", queueName);
+            status=I_ISGR_ERR_DRIVER;
+            break;
+        }
+        numJobs=ibis_isgr_energyQueueRead(queueFile, jobs, maxJobs);
+        ibis_isgr_energyQueueUnlock(queueFile);
+
+        ibis_isgr_energyDriverReport(reportName, jobs, numJobs, nProcs,
+                                     ibis_isgr_energyDriverWall()-wallStart, chatter);
+
+        for (i=0; i < numJobs && firstError == ISDC_OK; i++) {
+            if (jobs[i].state == ISGRI_JOB_DONE) continue;
+            firstError= jobs[i].status != ISDC_OK ? jobs[i].status : I_ISGR_ERR_DRIVER;
+        }
+        status=firstError;
+    } while(0);
+
+    fclose(listFile);
+    free(workers);
+    free(jobs);
+
+    return status;
+}
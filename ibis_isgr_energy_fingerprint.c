@@ -0,0 +1,246 @@
+/************************************************************************
+ * FILE:        ibis_isgr_energy_fingerprint.c
+ * VERSION:     9.1
+ * COMPONENT:   ibis_isgr_energy
+ * AUTHOR:      V. Savchenko,   APC & ISDC
+ * DESCRIPTION: fingerprint of the inputs of a Science Window (calibration
+ *              and event checksums, version, randSeed, useGTI, modes),
+ *              recorded in ISGR-EVTS-COR and compared in incremental mode
+ * HISTORY:
+ *   VS, 9.1  first version
+ *   VS, 9.1  stage fingerprint (checkpointDir)
+ *   VS, 9.1  HK, GTI and PRP sums, members selected as loaded
+ *   VS, 9.1  stage fingerprint of the raw inputs only
+ *   VS, 9.1  stage fingerprint removed with the event checkpoint
+ ************************************************************************/
+
+#include "ibis_isgr_energy.h"
+
+
+/* FNV-1a, 64 bits */
+unsigned long long ibis_isgr_energyFingerprintHash(const char *string)
+{
+    unsigned long long hash = 0xCBF29CE484222325ull;
+
+    for (; *string != '\0'; string++) {
+        hash^=(unsigned char)*string;
+        hash*=0x100000001B3ull;
+    }
+    return hash;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyTableSum
+ * DESCRIPTION:
+ *  DATASUM of the calibration table used for the Science Window: the
+ *  table itself, or the member of an index selected as in batch mode
+ *  (ibis_isgr_energyCalMember).
+ *
+ * PARAMETERS:
+ *  DOL              char *    in   DOL of the table or index
+ *  dsName           char *    in   data structure name
+ *  haveTime          int      in   0 if tStart/tStop are unknown
+ *  tStart, tStop  double      in   time range of the Science Window (IJD)
+ *  sum              char *   out   DATASUM, DAL_BIG_STRING
+ * RETURN:            int     0 if the sum is known
+ ************************************************************************/
+static int ibis_isgr_energyTableSum(char   *DOL,
+                                    char   *dsName,
+                                    int     haveTime,
+                                    double  tStart,
+                                    double  tStop,
+                                    char   *sum)
+{
+    int          status = ISDC_OK;
+    double       vStart = 0.,
+                 vStop = 0.;
+    char         member[DAL_FILE_NAME_STRING];
+    dal_element *tablePtr = NULL;
+
+    sum[0]='\0';
+
+    if (!haveTime) tStart=tStop=0.;
+    status=ibis_isgr_energyCalMember(DOL, dsName, tStart, tStop, member, &vStart, &vStop, status);
+    if (status == ISDC_OK && vStart == 0. && vStop == 0.)
+        status=I_ISGR_ERR_BAD_INPUT;                /* no member for the Science Window */
+    status=DALobjectOpen(member, &tablePtr, status);
+    status=DALattributeGetChar(tablePtr, "DATASUM", sum, NULL, NULL, status);
+
+    if (tablePtr != NULL)
+        DALobjectClose(tablePtr, DAL_SAVE, ISDC_OK);
+
+    if (status != ISDC_OK) sum[0]='\0';
+    return sum[0] == '\0';
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyElementSum
+ * DESCRIPTION:
+ *  DATASUM and rows of a table of the Science Window: the one given by
+ *  DOL (a table, or a group holding it), else the one of the group.
+ *
+ * PARAMETERS:
+ *  workGRP  dal_element *    in   working group
+ *  DOL              char *    in   DOL replacing the group's table, "" for none
+ *  name             char *    in   data structure name
+ *  sum              char *   out   DATASUM, DAL_BIG_STRING
+ *  numRows          long *   out   rows
+ * RETURN:            int     0 if the sum is known
+ ************************************************************************/
+static int ibis_isgr_energyElementSum(dal_element *workGRP,
+                                      char        *DOL,
+                                      char        *name,
+                                      char        *sum,
+                                      long        *numRows)
+{
+    int             status = ISDC_OK;
+    dal_element    *openPtr = NULL,
+                   *tablePtr = NULL;
+    dal_objectType  type;
+
+    sum[0]='\0';
+    *numRows=0;
+
+    if (DOL[0] != '\0') {
+        status=DALobjectOpen(DOL, &openPtr, status);
+        status=DALobjectGetType(openPtr, &type, status);
+        if (status == ISDC_OK && type == DAL_GROUP)
+            status=DALobjectFindElement(openPtr, name, &tablePtr, status);
+        else
+            tablePtr=openPtr;
+    }
+    else
+        status=DALobjectFindElement(workGRP, name, &tablePtr, status);
+
+    status=DALtableGetNumRows(tablePtr, numRows, status);
+    status=DALattributeGetChar(tablePtr, "DATASUM", sum, NULL, NULL, status);
+
+    if (openPtr != NULL)
+        DALobjectClose(openPtr, DAL_SAVE, ISDC_OK);
+
+    if (status != ISDC_OK) sum[0]='\0';
+    return sum[0] == '\0';
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyFingerprint
+ * DESCRIPTION:
+ *  Computes the fingerprint of everything the output of a Science Window
+ *  depends on: DATASUM of the LUT1, MCEC, LUT2 and L2RE tables used for
+ *  the Science Window (ibis_isgr_energyCalMember, the members loaded in
+ *  batch mode), DATASUM and rows of ISGR-EVTS-ALL and of the converted HK
+ *  (hkCnvDOL or the group's), with useGTI those of IBIS-GNRL-GTI and
+ *  ISGR-EVTS-PRP, component version, randSeed, useGTI, gtiRows. The
+ *  fingerprint is empty if one of the sums is not available: such an
+ *  output is never skipped.
+ *  Problems are not errors: the status is not changed.
+ *
+ * PARAMETERS:
+ *  workGRP  dal_element *    in   working group
+ *  ptr_ibis_isgr_energy_settings  in   modes
+ *  fingerprint      char *  out   16 hex digits or "", DAL_BIG_STRING
+ *  chatter           int     in   verbosity level
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyFingerprint(dal_element *workGRP,
+                                ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                                ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                                char        *fingerprint,
+                                int          chatter,
+                                int          status)
+{
+    int    i,
+           haveTime,
+           unknown = 0;
+    long   numRows = 0;
+    double tStart = 0.,
+           tStop = 0.;
+    char   sum[DAL_BIG_STRING],
+           inputs[4*DAL_BIG_STRING+4*DAL_FILE_NAME_STRING];
+    char  *DOLs[4],
+          *dsNames[4] = { DS_ISGR_LUT1, DS_ISGR_MCEC, DS_ISGR_LUT2, DS_ISGR_L2RE },
+          *elements[4] = { DS_ISGR_RAW, DS_ISGR_HK, DS_IBIS_GTI, DS_ISGR_PRP };
+    size_t length;
+
+    fingerprint[0]='\0';
+    if (status != ISDC_OK) return status;
+
+    DOLs[0]=ptr_ISGRI_energy_caldb_dols->lut1_DOL;
+    DOLs[1]=ptr_ISGRI_energy_caldb_dols->mcec_DOL;
+    DOLs[2]=ptr_ISGRI_energy_caldb_dols->lut2_DOL;
+    DOLs[3]=ptr_ISGRI_energy_caldb_dols->l2re_DOL;
+
+    haveTime=(ibis_isgr_energyScwTime(workGRP, &tStart, &tStop, ISDC_OK) == ISDC_OK);
+
+    length=snprintf(inputs, sizeof(inputs), "%s %s|seed=%lu:%d|gti=%d|gtirows=%d",
+                    COMPONENT_NAME, COMPONENT_VERSION,
+                    ptr_ibis_isgr_energy_settings->seed, ptr_ibis_isgr_energy_settings->seedSet,
+                    ptr_ibis_isgr_energy_settings->gti,
+                    ptr_ibis_isgr_energy_settings->gtiRows);
+
+    for (i=0; i < 4; i++) {
+        if (ibis_isgr_energyTableSum(DOLs[i], dsNames[i], haveTime, tStart, tStop, sum)) {
+            if (chatter > 1)
+                RILlogMessage(NULL, Log_1, "No DATASUM for %s (%s): output not fingerprinted", dsNames[i], DOLs[i]);
+            unknown=1;
+        }
+        if (length < sizeof(inputs))
+            length+=snprintf(inputs+length, sizeof(inputs)-length, "|%s=%s", dsNames[i], sum);
+    }
+
+    /* the events; the HK of the LUT1 correction; with useGTI, the GTI and
+       the times (PRP) selecting the events */
+    for (i=0; i < 4; i++) {
+        if (i >= 2 && !ptr_ibis_isgr_energy_settings->gti) break;
+        if (ibis_isgr_energyElementSum(workGRP, i == 1 ? ptr_ibis_isgr_energy_settings->hkCnvDOL : "",
+                                       elements[i], sum, &numRows)) {
+            if (chatter > 1)
+                RILlogMessage(NULL, Log_1, "No DATASUM for %s: output not fingerprinted", elements[i]);
+            unknown=1;
+        }
+        if (length < sizeof(inputs))
+            length+=snprintf(inputs+length, sizeof(inputs)-length, "|%s=%s:%ld", elements[i], sum, numRows);
+    }
+
+    if (!unknown)
+        snprintf(fingerprint, DAL_BIG_STRING, "%016llx", ibis_isgr_energyFingerprintHash(inputs));
+
+    if (chatter > 3)
+        RILlogMessage(NULL, Log_0, "Fingerprint '%s' of %s", fingerprint, inputs);
+
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyUpToDate
+ * DESCRIPTION:
+ *  Tells if the output table was produced from the inputs of the given
+ *  fingerprint (keyword KEY_FINGERPRINT, written after a complete output).
+ *
+ * PARAMETERS:
+ *  workGRP  dal_element *    in   working group
+ *  outName          char *    in   output table
+ *  fingerprint      char *    in   current fingerprint
+ * RETURN:            int     1 if up to date
+ ************************************************************************/
+int ibis_isgr_energyUpToDate(dal_element *workGRP,
+                             char        *outName,
+                             char        *fingerprint)
+{
+    int   status = ISDC_OK;
+    char  previous[DAL_BIG_STRING];
+
+    dal_element *outTable = NULL;
+
+    if (fingerprint[0] == '\0') return 0;
+
+    previous[0]='\0';
+    status=DALobjectFindElement(workGRP, outName, &outTable, status);
+    status=DALattributeGetChar(outTable, KEY_FINGERPRINT, previous, NULL, NULL, status);
+
+    return status == ISDC_OK && strcmp(previous, fingerprint) == 0;
+}
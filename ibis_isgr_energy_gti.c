@@ -0,0 +1,233 @@
+/************************************************************************
+ * FILE:        ibis_isgr_energy_gti.c
+ * VERSION:     9.1
+ * COMPONENT:   ibis_isgr_energy
+ * AUTHOR:      V. Savchenko,   APC & ISDC
+ * DESCRIPTION: rows of ISGR-EVTS-ALL inside the GTI of the Science Window,
+ *              found by binary search on the OBT of the (time ordered)
+ *              events in ISGR-EVTS-PRP, so that only those rows are read
+ *              and corrected (streaming mode)
+ * HISTORY:
+ *   VS, 9.1  first version
+ *   VS, 9.1  OBT of the events from ISGR-EVTS-PRP, GTI read as OBT
+ *   VS, 9.1  OBT range of the streamed events (ibis_isgr_energyPrpObt)
+ *   VS, 9.1  GTI sorted by start before the search
+ ************************************************************************/
+
+#include "ibis_isgr_energy.h"
+
+
+/* one GTI, OBT */
+typedef struct {
+    OBTime start,
+           stop;
+} ISGRI_energy_gti_struct;
+
+/* orders GTI by start, then stop */
+static int ibis_isgr_energyGtiCompare(const void *a, const void *b)
+{
+    const ISGRI_energy_gti_struct *gtiA = (const ISGRI_energy_gti_struct *)a,
+                                  *gtiB = (const ISGRI_energy_gti_struct *)b;
+
+    if (gtiA->start != gtiB->start) return gtiA->start < gtiB->start ? -1 : 1;
+    if (gtiA->stop  != gtiB->stop)  return gtiA->stop  < gtiB->stop  ? -1 : 1;
+    return 0;
+}
+
+
+/* OBT of a column in the OBT format (4 x 16 bits, most significant
+   first) of one row (0-based), without going through a double */
+static int ibis_isgr_energyRowObt(dal_element *table,
+                                  char        *column,
+                                  long         row,
+                                  OBTime      *obt,
+                                  int          status)
+{
+    int          i;
+    DAL3_Word    words[4];
+    dal_dataType type = DAL_USHORT;
+
+    status=DALtableGetColBins(table, column, 0, &type, row+1, 1, words, status);
+    *obt=0;
+    for (i=0; i < 4; i++)
+        *obt=(*obt << 16) | words[i];
+
+    return status;
+}
+
+
+/* first row with an OB_TIME >= obt (numEvents if none) */
+static int ibis_isgr_energyRowSearch(dal_element *prpTable,
+                                     long         numEvents,
+                                     OBTime       obt,
+                                     long        *row,
+                                     int          status)
+{
+    long   low = 0,
+           high = numEvents,
+           middle;
+    OBTime rowObt;
+
+    while (low < high && status == ISDC_OK) {
+        middle=low+(high-low)/2;
+        status=ibis_isgr_energyRowObt(prpTable, KEY_EVT_OBT, middle, &rowObt, status);
+        if (rowObt < obt) low=middle+1;
+        else              high=middle;
+    }
+    *row=low;
+
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyPrpObt
+ * DESCRIPTION:
+ *  OB_TIME of two events (rows of ISGR-EVTS-PRP, 0-based), the first and
+ *  the last events of a selection.
+ * ERROR CODES:
+ *  DAL error codes
+ *
+ * PARAMETERS:
+ *  workGRP   dal_element *     in  working group
+ *  firstRow, lastRow long      in  rows of the events
+ *  obtStart, obtEnd OBTime *  out  their OB_TIME
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyPrpObt(dal_element *workGRP,
+                           long         firstRow,
+                           long         lastRow,
+                           OBTime      *obtStart,
+                           OBTime      *obtEnd,
+                           int          status)
+{
+    dal_element *prpTable = NULL;
+
+    status=DALobjectFindElement(workGRP, DS_ISGR_PRP, &prpTable, status);
+    status=ibis_isgr_energyRowObt(prpTable, KEY_EVT_OBT, firstRow, obtStart, status);
+    status=ibis_isgr_energyRowObt(prpTable, KEY_EVT_OBT, lastRow,  obtEnd,   status);
+
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyGtiRows
+ * DESCRIPTION:
+ *  Converts the GTI of the Science Window (START/STOP of IBIS-GNRL-GTI,
+ *  OBT) into ranges of rows of ISGR-EVTS-ALL: each GTI boundary is found
+ *  by a binary search on OB_TIME of ISGR-EVTS-PRP, row for row with
+ *  ISGR-EVTS-ALL, i.e. a few single-row reads. The GTI are sorted by
+ *  start first (the table need not be time ordered), so that a range can
+ *  only overlap the previous one, and overlapping ranges are merged; the
+ *  ranges are in increasing row order. Without GTI table, nothing is selected (ptr_rows gets one
+ *  range with all the rows). Used in streaming mode only: the first and
+ *  last rows give the OBT range of the events (ibis_isgr_energyStreamHeader)
+ *  and, with gtiRows, only the rows of the ranges are read.
+ * ERROR CODES:
+ *  DAL error codes
+ *  I_ISGR_ERR_MEMORY         Memory allocation error
+ *  I_ISGR_ERR_BAD_INPUT      if ISGR-EVTS-PRP is missing or has other rows
+ *
+ * PARAMETERS:
+ *  workGRP   dal_element *     in  working group
+ *  numEvents        long       in  rows of ISGR-EVTS-ALL
+ *  ptr_arena                   in  arena of the Science Window
+ *  ptr_rows                   out  selected rows (ranges in the arena)
+ *  chatter           int      in   verbosity level
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyGtiRows(dal_element               *workGRP,
+                            long                       numEvents,
+                            ISGRI_energy_arena_struct *ptr_arena,
+                            ISGRI_energy_rows_struct  *ptr_rows,
+                            int                        chatter,
+                            int                        status)
+{
+    long    i,
+            numGti = 0,
+            numPrp = 0,
+            first,
+            last;
+    ISGRI_energy_gti_struct *gti;
+
+    dal_element   *gtiTable = NULL,
+                  *prpTable = NULL;
+    ISGRI_energy_arena_mark_struct mark;
+
+    if (status != ISDC_OK) return status;
+
+    memset(ptr_rows, 0, sizeof(ISGRI_energy_rows_struct));
+
+    status=DALobjectFindElement(workGRP, DS_ISGR_PRP, &prpTable, status);
+    status=DALtableGetNumRows(prpTable, &numPrp, status);
+    if (status != ISDC_OK || numPrp != numEvents) {
+        RILlogMessage(NULL, Error_2, "gtiRows needs %s with the OB_TIME of the %ld events of %s (%ld rows). Status=%d",
+                      DS_ISGR_PRP, numEvents, DS_ISGR_RAW, numPrp, status);
+        return status != ISDC_OK ? status : I_ISGR_ERR_BAD_INPUT;
+    }
+
+    if (DALobjectFindElement(workGRP, DS_IBIS_GTI, &gtiTable, ISDC_OK) != ISDC_OK
+        || DALtableGetNumRows(gtiTable, &numGti, ISDC_OK) != ISDC_OK) {
+        RILlogMessage(NULL, Warning_1, "%s not found: all events are corrected", DS_IBIS_GTI);
+        numGti=0;
+    }
+
+    /* ranges, at most one per GTI; GTI times only needed here */
+    ptr_rows->first=(long *)ibis_isgr_energyArenaAlloc(ptr_arena, (numGti+1)*sizeof(long));
+    ptr_rows->last= (long *)ibis_isgr_energyArenaAlloc(ptr_arena, (numGti+1)*sizeof(long));
+    ibis_isgr_energyArenaMark(ptr_arena, &mark);
+    gti=(ISGRI_energy_gti_struct *)ibis_isgr_energyArenaAlloc(ptr_arena, (numGti+1)*sizeof(ISGRI_energy_gti_struct));
+    if (ptr_rows->first == NULL || ptr_rows->last == NULL || gti == NULL) {
+        RILlogMessage(NULL, Error_2, "Cannot allocate %ld GTI", numGti);
+        return I_ISGR_ERR_MEMORY;
+    }
+
+    if (numGti == 0) {
+        ptr_rows->first[0]=0;
+        ptr_rows->last[0]=numEvents;
+        ptr_rows->numRanges=1;
+        ptr_rows->numRows=numEvents;
+        ibis_isgr_energyArenaRewind(ptr_arena, &mark);
+        return status;
+    }
+
+    for (i=0; i < numGti && status == ISDC_OK; i++) {
+        status=ibis_isgr_energyRowObt(gtiTable, "START", i, &gti[i].start, status);
+        status=ibis_isgr_energyRowObt(gtiTable, "STOP",  i, &gti[i].stop,  status);
+    }
+    if (status == ISDC_OK)
+        qsort(gti, numGti, sizeof(ISGRI_energy_gti_struct), ibis_isgr_energyGtiCompare);
+
+    for (i=0; i < numGti && status == ISDC_OK; i++) {
+        if (gti[i].stop < gti[i].start) continue;
+        status=ibis_isgr_energyRowSearch(prpTable, numEvents, gti[i].start, &first, status);
+        status=ibis_isgr_energyRowSearch(prpTable, numEvents, gti[i].stop+1, &last, status);
+        if (status != ISDC_OK || last <= first) continue;
+
+        /* GTI sorted by start: a range overlaps only the previous one */
+        if (ptr_rows->numRanges > 0 && first <= ptr_rows->last[ptr_rows->numRanges-1]) {
+            if (last > ptr_rows->last[ptr_rows->numRanges-1])
+                ptr_rows->last[ptr_rows->numRanges-1]=last;
+        } else {
+            ptr_rows->first[ptr_rows->numRanges]=first;
+            ptr_rows->last[ptr_rows->numRanges]=last;
+            ptr_rows->numRanges++;
+        }
+    }
+    ibis_isgr_energyArenaRewind(ptr_arena, &mark);
+
+    if (status != ISDC_OK) {
+        RILlogMessage(NULL, Error_2, "Cannot find the events of the GTI. Status=%d", status);
+        return status;
+    }
+
+    for (i=0; i < ptr_rows->numRanges; i++)
+        ptr_rows->numRows+=ptr_rows->last[i]-ptr_rows->first[i];
+
+    if (chatter > 1)
+        RILlogMessage(NULL, Log_1, "GTI: %ld of %ld events in %ld ranges (%ld GTI)",
+                      ptr_rows->numRows, numEvents, ptr_rows->numRanges, numGti);
+
+    return status;
+}
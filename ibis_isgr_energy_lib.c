@@ -0,0 +1,201 @@
+/************************************************************************
+ * FILE:        ibis_isgr_energy_lib.c
+ * VERSION:     9.1
+ * COMPONENT:   ibis_isgr_energy
+ * AUTHOR:      V. Savchenko,   APC & ISDC
+ * DESCRIPTION: library interface (libibis_isgr_energy): energy correction
+ *              of events given as arrays owned by the caller, written in
+ *              place into the caller's PI and energy arrays
+ * HISTORY:
+ *   VS, 9.1  first version
+ ************************************************************************/
+
+#include "ibis_isgr_energy.h"
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyLibOpen
+ * DESCRIPTION:
+ *  Creates a calibration handle. The tables are read at the first
+ *  correction, for the OBT range of its events, and kept for the next
+ *  corrections inside that range. Without hkDOL, LUT1 is not corrected
+ *  for the MDU temperature and bias.
+ * ERROR CODES:
+ *  I_ISGR_ERR_MEMORY       if no memory for the handle
+ *  I_ISGR_ERR_BAD_INPUT    if a calibration DOL is missing
+ *
+ * PARAMETERS:
+ *  ptr_library                 out  handle, to free with ibis_isgr_energyLibClose
+ *  lut1DOL, mcecDOL,
+ *  lut2DOL, l2reDOL   char *    in  as GODOL, mcecDOL, riseDOL, l2reDOL
+ *  hkDOL              char *    in  group with IBIS-DPE.-CNV, NULL or "" for none
+ *  nThreads            int      in  as the nThreads parameter
+ *  chatter             int      in  verbosity level
+ * RETURN:              int     current status
+ ************************************************************************/
+int ibis_isgr_energyLibOpen(ISGRI_energy_library_struct **ptr_library,
+                            const char *lut1DOL,
+                            const char *mcecDOL,
+                            const char *lut2DOL,
+                            const char *l2reDOL,
+                            const char *hkDOL,
+                            int         nThreads,
+                            int         chatter,
+                            int         status)
+{
+    ISGRI_energy_library_struct *ptr_lib;
+
+    *ptr_library=NULL;
+    if (status != ISDC_OK) return status;
+
+    if (lut1DOL == NULL || mcecDOL == NULL || lut2DOL == NULL || l2reDOL == NULL
+        || lut1DOL[0] == '\0' || mcecDOL[0] == '\0' || lut2DOL[0] == '\0' || l2reDOL[0] == '\0') {
+        RILlogMessage(NULL, Error_2, "Calibration DOLs missing");
+        return I_ISGR_ERR_BAD_INPUT;
+    }
+    if (nThreads < 0) {
+        RILlogMessage(NULL, Error_2, "Number of workers must be >= 0");
+        return I_ISGR_ERR_BAD_INPUT;
+    }
+
+    ptr_lib=(ISGRI_energy_library_struct *)calloc(1, sizeof(ISGRI_energy_library_struct));
+    if (ptr_lib == NULL) return I_ISGR_ERR_MEMORY;
+
+    snprintf(ptr_lib->dols.lut1_DOL, DAL_FILE_NAME_STRING, "%s", lut1DOL);
+    snprintf(ptr_lib->dols.mcec_DOL, DAL_FILE_NAME_STRING, "%s", mcecDOL);
+    snprintf(ptr_lib->dols.lut2_DOL, DAL_FILE_NAME_STRING, "%s", lut2DOL);
+    snprintf(ptr_lib->dols.l2re_DOL, DAL_FILE_NAME_STRING, "%s", l2reDOL);
+    snprintf(ptr_lib->hkDOL, DAL_FILE_NAME_STRING, "%s", hkDOL == NULL ? "" : hkDOL);
+    ptr_lib->settings.nThreads=nThreads;
+    ptr_lib->chatter=chatter;
+
+    *ptr_library=ptr_lib;
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyLibCorrect
+ * DESCRIPTION:
+ *  Corrects numEvents events: ISGRI_PI and ISGRI_ENERGY are written into
+ *  the caller's arrays, the input arrays are read in place (no copy). The calibration is loaded if the
+ *  OBT range of the events is not inside that of the loaded one. The
+ *  random sequence is given by seed: the same call gives the same
+ *  result, as a run with randSeed=seed. The tables are selected by
+ *  DAL3IBIS for the OBT range of the events, and the HK group only
+ *  serves the temperature and bias correction of LUT1. The correction
+ *  is the one of the program, ibis_isgr_energyCorrectEvents.
+ *  Not thread-safe: the call seeds the global random generator of
+ *  DAL3GEN and goes through DAL, which are shared by the process, and
+ *  with nThreads > 1 it forks worker processes (only if no other thread
+ *  runs). Calls must not overlap, whatever their handle: a caller with
+ *  threads serializes them.
+ * ERROR CODES:
+ *  I_ISGR_ERR_BAD_INPUT            if an array is missing
+ *  ibis_isgr_energyCorrectEvents() error codes
+ *
+ * PARAMETERS:
+ *  ptr_library                  in/out  handle of ibis_isgr_energyLibOpen
+ *  numEvents         long        in  number of events
+ *  isgriPha, riseTime,
+ *  isgriY, isgriZ                in  columns of ISGR-EVTS-ALL
+ *  obt             OBTime *      in  OBT of the events
+ *  seed     unsigned long        in  seed of the random sequence
+ *  isgriPi     DAL3_Byte *      out  ISGRI_PI
+ *  isgriEnergy     float *      out  ISGRI_ENERGY
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyLibCorrect(ISGRI_energy_library_struct *ptr_library,
+                               long             numEvents,
+                               const DAL3_Word *isgriPha,
+                               const DAL3_Byte *riseTime,
+                               const DAL3_Byte *isgriY,
+                               const DAL3_Byte *isgriZ,
+                               const OBTime    *obt,
+                               unsigned long    seed,
+                               DAL3_Byte       *isgriPi,
+                               float           *isgriEnergy,
+                               int              status)
+{
+    long i;
+    int  calibrate;
+
+    dal_element *hkGRP = NULL;
+    IBIS_events_struct IBIS_events;
+    ISGRI_energy_stats_struct stats;
+
+    if (status != ISDC_OK) return status;
+    if (numEvents <= 0) return status;
+
+    if (ptr_library == NULL || isgriPha == NULL || riseTime == NULL || isgriY == NULL
+        || isgriZ == NULL || obt == NULL || isgriPi == NULL || isgriEnergy == NULL) {
+        RILlogMessage(NULL, Error_2, "Events or output arrays missing");
+        return I_ISGR_ERR_BAD_INPUT;
+    }
+
+    memset(&IBIS_events, 0, sizeof(IBIS_events));
+    memset(&stats, 0, sizeof(stats));
+
+    /* the caller's arrays are only read */
+    IBIS_events.numEvents=numEvents;
+    IBIS_events.isgri_pha=(DAL3_Word *)isgriPha;
+    IBIS_events.riseTime=(DAL3_Byte *)riseTime;
+    IBIS_events.isgri_y=(DAL3_Byte *)isgriY;
+    IBIS_events.isgri_z=(DAL3_Byte *)isgriZ;
+    IBIS_events.isgri_pi=isgriPi;
+    IBIS_events.isgri_energy=isgriEnergy;
+    IBIS_events.obtStart=IBIS_events.obtEnd=obt[0];
+    for (i=1; i < numEvents; i++) {
+        if (obt[i] < IBIS_events.obtStart) IBIS_events.obtStart=obt[i];
+        if (obt[i] > IBIS_events.obtEnd)   IBIS_events.obtEnd=obt[i];
+    }
+
+    /* the calibration loaded is kept for the events inside its OBT range;
+       ibis_isgr_energyCalibrate frees it before loading another one */
+    calibrate= !ptr_library->calibrated
+               || IBIS_events.obtStart < ptr_library->obtStart
+               || IBIS_events.obtEnd > ptr_library->obtEnd;
+
+    TRY_BLOCK_BEGIN
+
+        if (calibrate) {
+            ptr_library->calibrated=0;
+            if (ptr_library->hkDOL[0] != '\0')
+                TRY( DALobjectOpen(ptr_library->hkDOL, &hkGRP, status), status, "opening HK group %s", ptr_library->hkDOL );
+        }
+
+        DAL3GENrandomSeed(seed);
+        ptr_library->settings.seed=seed;
+        ptr_library->settings.seedSet=1;
+
+        TRY( ibis_isgr_energyCorrectEvents(NULL, hkGRP, &IBIS_events, &ptr_library->dols, &ptr_library->cache,
+                                           &ptr_library->settings, calibrate, &stats, ptr_library->chatter, status),
+             status, "correcting ISGRI energies" );
+
+        if (calibrate) {
+            ptr_library->obtStart=IBIS_events.obtStart;
+            ptr_library->obtEnd=IBIS_events.obtEnd;
+            ptr_library->calibrated=1;
+        }
+
+    TRY_BLOCK_END
+
+    if (hkGRP != NULL)
+        DALobjectClose(hkGRP, DAL_SAVE, ISDC_OK);
+
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyLibClose
+ * DESCRIPTION:
+ *  Frees the handle of ibis_isgr_energyLibOpen and its calibration.
+ ************************************************************************/
+void ibis_isgr_energyLibClose(ISGRI_energy_library_struct *ptr_library)
+{
+    if (ptr_library == NULL) return;
+
+    ibis_isgr_energyCalRelease(&ptr_library->cache, ISDC_OK);
+    free(ptr_library);
+}
@@ -42,6 +42,24 @@
  *  PL, 8.0  02/02/2012,   remove IREM counters, Temperature correction by MDU
  *  PL, 8.2  02/04/2012,   modify coefficients PAR1_..._corrPH1 to correct <50 keV behavior
  *  VS, 9.0. 27/01/2017, most of the functionality moved to DAL3IBIS
+ *  VS, 9.1              batch mode (inGRPList) with calibration kept in memory
+ *                       calibration snapshot (calSnapshot)
+ *                       parallel reconstruction by blocks (nThreads)
+ *                       streaming mode (streamRows), pipelined (pipeline)
+ *                       per-stage statistics (statsFile)
+ *                       inputs fingerprint, incremental mode (incremental)
+ *                       daemon mode and its client (daemon, daemonSocket)
+ *                       library interface (libibis_isgr_energy.so)
+ *                       only the rows in the GTI read and corrected (gtiRows)
+ *                       revolution driver with worker processes (nProcs, jobQueue)
+ *                       spectra accumulated during the reconstruction (spectraFile)
+ *                       calibration files read ahead during event reading (calPrefetch)
+ *                       event checkpoint reused when only LUT2/L2RE change (checkpointDir)
+ *                       checkpoint of the raw events, oldest removed (checkpointMB)
+ *                       tile-compressed copy of the output (outCompressed, energyTolerance)
+ *                       output compressed in its own file, not copied (outCompressed)
+ *                       event checkpoint removed (checkpointDir, checkpointMB)
+ *                       compressed output in a separate file, incremental allowed (outCompressed)
  *  see also https://github.com/volodymyrss/osa-ibis_isgr_energy
  ************************************************************************/
 
@@ -65,9 +83,11 @@ int get_all_PIL(dal_element **ptr_workGRP,
                 ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
                 int *ptr_chatter,
                 int status) {
-    char  randName[DAL_BIG_STRING];
+    char  randName[DAL_BIG_STRING],
+          outName[DAL_FILE_NAME_STRING];
     unsigned long seed;
-    int chatter;
+    int chatter,
+        i;
 
     TRY_BLOCK_BEGIN
 
@@ -102,7 +122,14 @@ int get_all_PIL(dal_element **ptr_workGRP,
             }
             RILlogMessage(NULL, Log_2, "Seed for random number generator: %010lu", seed);
             DAL3GENrandomSeed(seed);
+            ptr_ibis_isgr_energy_settings->seed=seed;
+            ptr_ibis_isgr_energy_settings->seedSet=1;
         }
+
+        TRY( PILGetInt("nThreads", &ptr_ibis_isgr_energy_settings->nThreads), status, "reading nThreads parameter" );
+        if (ptr_ibis_isgr_energy_settings->nThreads < 0) FAIL(I_ISGR_ERR_BAD_INPUT,"The parameter 'nThreads' must be >= 0");
+        if (chatter > 0 && ptr_ibis_isgr_energy_settings->nThreads > 0)
+            RILlogMessage(NULL, Log_2, "Reconstruction by blocks with %d workers", ptr_ibis_isgr_energy_settings->nThreads);
         
         TRY( PILGetString("GODOL", ptr_ISGRI_energy_caldb_dols->lut1_DOL), status, "reading GODOL parameter" );
         if (strlen(ptr_ISGRI_energy_caldb_dols->lut1_DOL) == 0) FAIL(I_ISGR_ERR_BAD_INPUT,"The parameter 'GODOL' is empty");
@@ -116,31 +143,172 @@ int get_all_PIL(dal_element **ptr_workGRP,
         TRY( PILGetString("l2reDOL", ptr_ISGRI_energy_caldb_dols->l2re_DOL), status, "reading mcecDOL parameter");
         if (strlen(ptr_ISGRI_energy_caldb_dols->l2re_DOL) == 0) FAIL(I_ISGR_ERR_BAD_INPUT,"The parameter 'l2reDOL' is empty");
 
-        TRY( CommonPreparePARsStrings("inGRP",
-                "inRawEvts,hkCnvDOL",
-                "outGRP",
-                "outCorEvts",
-                ptr_ibis_isgr_energy_settings->makeUnique,
-                ptr_workGRP,
-                &ptr_ibis_isgr_energy_settings->clobber,
-                status),
-                    status,"CommonPreparePARsStrings"
-                );
+        TRY( PILGetInt("streamRows", &i), status, "reading streamRows parameter" );
+        if (i < 0) FAIL(I_ISGR_ERR_BAD_INPUT,"The parameter 'streamRows' must be >= 0");
+        ptr_ibis_isgr_energy_settings->streamRows=i;
+        if (chatter > 0 && i > 0)
+            RILlogMessage(NULL, Log_2, "Streaming mode: blocks of %ld events",
+                          ibis_isgr_energyBlockRows(ptr_ibis_isgr_energy_settings->streamRows));
+
+        TRY( PILGetBool("pipeline", &ptr_ibis_isgr_energy_settings->pipeline), status, "reading pipeline parameter" );
+        if (ptr_ibis_isgr_energy_settings->pipeline) {
+            if (ptr_ibis_isgr_energy_settings->streamRows == 0)
+                ptr_ibis_isgr_energy_settings->streamRows=ISGRI_PIPE_ROWS;
+            if (chatter > 0)
+                RILlogMessage(NULL, Log_2, "Pipelined mode: blocks of %ld events",
+                              ibis_isgr_energyBlockRows(ptr_ibis_isgr_energy_settings->streamRows));
+        }
+
+        TRY( PILGetBool("gtiRows", &ptr_ibis_isgr_energy_settings->gtiRows), status, "reading gtiRows parameter" );
+        if (ptr_ibis_isgr_energy_settings->gtiRows) {
+            if (!ptr_ibis_isgr_energy_settings->gti) {
+                RILlogMessage(NULL, Warning_1, "gtiRows ignored with useGTI=no");
+                ptr_ibis_isgr_energy_settings->gtiRows=0;
+            } else if (ptr_ibis_isgr_energy_settings->streamRows == 0) {
+                FAIL(I_ISGR_ERR_BAD_INPUT, "gtiRows needs the streaming mode (streamRows > 0)");
+            } else if (chatter > 0)
+                RILlogMessage(NULL, Log_2, "Only the events in the GTI are read and corrected");
+        }
+
+        TRY( PILGetBool("incremental", &ptr_ibis_isgr_energy_settings->incremental), status, "reading incremental parameter" );
+        if (chatter > 0 && ptr_ibis_isgr_energy_settings->incremental)
+            RILlogMessage(NULL, Log_2, "Incremental mode: up-to-date outputs are kept");
+
+        TRY( PILGetString("statsFile", ptr_ibis_isgr_energy_settings->statsFile), status, "reading statsFile parameter");
+
+        TRY( PILGetString("spectraFile", ptr_ibis_isgr_energy_settings->spectraFile), status, "reading spectraFile parameter");
+        if (chatter > 0 && strlen(ptr_ibis_isgr_energy_settings->spectraFile) > 0)
+            RILlogMessage(NULL, Log_2, "Spectra of the corrected events appended to %s", ptr_ibis_isgr_energy_settings->spectraFile);
+
+        TRY( PILGetString("hkCnvDOL", ptr_ibis_isgr_energy_settings->hkCnvDOL), status, "reading hkCnvDOL parameter");
+
+        TRY( PILGetString("calSnapshot", ptr_ibis_isgr_energy_settings->calSnapshot), status, "reading calSnapshot parameter");
+
+        TRY( PILGetBool("calPrefetch", &ptr_ibis_isgr_energy_settings->calPrefetch), status, "reading calPrefetch parameter" );
+        if (chatter > 0 && ptr_ibis_isgr_energy_settings->calPrefetch)
+            RILlogMessage(NULL, Log_2, "Calibration files read ahead during the event reading");
+
+        TRY( PILGetBool("outCompressed", &ptr_ibis_isgr_energy_settings->outCompressed), status, "reading outCompressed parameter" );
+        TRY( PILGetReal("energyTolerance", &ptr_ibis_isgr_energy_settings->energyTolerance), status, "reading energyTolerance parameter" );
+        if (ptr_ibis_isgr_energy_settings->energyTolerance < 0.) FAIL(I_ISGR_ERR_BAD_INPUT,"The parameter 'energyTolerance' must be >= 0");
+        if (chatter > 0 && ptr_ibis_isgr_energy_settings->outCompressed)
+            RILlogMessage(NULL, Log_2, "Output also tile-compressed to its file%s (ISGRI_ENERGY rounded to %g keV)",
+                          ISGRI_COMPRESS_SUFFIX,
+                          ibis_isgr_energyQuantumStep(ptr_ibis_isgr_energy_settings->energyTolerance));
+
+        TRY( PILGetString("inGRPList", ptr_ibis_isgr_energy_settings->grpList), status, "reading inGRPList parameter");
+        if (strlen(ptr_ibis_isgr_energy_settings->grpList) > 0) {
+            /* groups are opened one by one in ibis_isgr_energyBatch */
+            RILlogMessage(NULL, Log_2, "Batch mode: groups listed in %s", ptr_ibis_isgr_energy_settings->grpList);
+            *ptr_workGRP=NULL;
+
+            /* each group is updated in place (ibis_isgr_energyOpenGroup) */
+            TRY( PILGetString("outGRP", outName), status, "reading outGRP parameter");
+            if (strlen(outName) > 0) FAIL(I_ISGR_ERR_BAD_INPUT,"The parameter 'outGRP' must be empty in batch mode");
+            TRY( PILGetString("outCorEvts", outName), status, "reading outCorEvts parameter");
+            if (strlen(outName) > 0) FAIL(I_ISGR_ERR_BAD_INPUT,"The parameter 'outCorEvts' must be empty in batch mode");
+
+            TRY( PILGetInt("nProcs", &ptr_ibis_isgr_energy_settings->nProcs), status, "reading nProcs parameter" );
+            if (ptr_ibis_isgr_energy_settings->nProcs < 0) FAIL(I_ISGR_ERR_BAD_INPUT,"The parameter 'nProcs' must be >= 0");
+            TRY( PILGetString("jobQueue", ptr_ibis_isgr_energy_settings->jobQueue), status, "reading jobQueue parameter");
+            if (chatter > 0 && ptr_ibis_isgr_energy_settings->nProcs > 0)
+                RILlogMessage(NULL, Log_2, "Revolution driver: %d worker processes", ptr_ibis_isgr_energy_settings->nProcs);
+        } else {
+            TRY( CommonPreparePARsStrings("inGRP",
+                    "inRawEvts,hkCnvDOL",
+                    "outGRP",
+                    "outCorEvts",
+                    ptr_ibis_isgr_energy_settings->makeUnique,
+                    ptr_workGRP,
+                    &ptr_ibis_isgr_energy_settings->clobber,
+                    status),
+                        status,"CommonPreparePARsStrings"
+                    );
+        }
 
     TRY_BLOCK_END
     return status;
 }
   
 
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyRun
+ * DESCRIPTION:
+ *  Runs one job: reads the parameters, opens the group (or the list of
+ *  groups of the batch mode, processed by worker processes with nProcs),
+ *  corrects the events and closes the group; with outCompressed, then
+ *  writes a compressed copy of the output to a separate file (ibis_isgr_energyCompressOut).
+ *  Called once by main, or for each job of the daemon. The group is
+ *  closed even after a failure, as the daemon goes on with other jobs.
+ * ERROR CODES:
+ *  get_all_PIL()             error codes
+ *  ibis_isgr_energyWork()    error codes
+ *  ibis_isgr_energyCompressOut() error codes
+ *  ibis_isgr_energyBatch()   error codes
+ *  ibis_isgr_energyDriver()  error codes
+ *
+ * PARAMETERS:
+ *  ptr_ibis_isgr_energy_settings  out  settings of the job
+ *  ptr_ISGRI_energy_caldb_dols    out  calibration DOLs
+ *  ptr_cal_cache                  in/out  calibration kept between calls
+ *  ptr_chatter       int *   out   verbosity level
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyRun(ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                        ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                        ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                        int *ptr_chatter,
+                        int status)
+{
+  int chatter = 0;
+  dal_element *workGRP = NULL;
+
+  TRY_BLOCK_BEGIN
+
+      TRY( get_all_PIL(&workGRP,ptr_ibis_isgr_energy_settings,ptr_ISGRI_energy_caldb_dols,ptr_chatter,status), status, "get_all_PIL" );
+      chatter=*ptr_chatter;
+
+      TRY( ibis_isgr_energyCalSnapshot(ptr_ibis_isgr_energy_settings->calSnapshot, ptr_ISGRI_energy_caldb_dols, chatter, status), status, "ibis_isgr_energyCalSnapshot" );
+
+      if (strlen(ptr_ibis_isgr_energy_settings->grpList) > 0) {
+          if (ptr_ibis_isgr_energy_settings->nProcs > 0) {
+              TRY( ibis_isgr_energyDriver(ptr_ibis_isgr_energy_settings, ptr_ISGRI_energy_caldb_dols, chatter, status), status, "ibis_isgr_energyDriver" );
+          } else {
+              TRY( ibis_isgr_energyBatch(ptr_ibis_isgr_energy_settings, ptr_ISGRI_energy_caldb_dols, ptr_cal_cache, chatter, status), status, "ibis_isgr_energyBatch" );
+          }
+      } else {
+          TRY( ibis_isgr_energyWork(workGRP, ptr_ibis_isgr_energy_settings, ptr_ISGRI_energy_caldb_dols, ptr_cal_cache, chatter,status), status, "ibis_isgr_energyWork" );
+      }
+
+      if (workGRP != NULL) {
+          TRY( CommonCloseSWG(workGRP, status), status, "CommonCloseSWG");
+          workGRP=NULL;
+          TRY( ibis_isgr_energyCompressOut(ptr_ibis_isgr_energy_settings, chatter, status), status, "ibis_isgr_energyCompressOut" );
+      }
+
+  TRY_BLOCK_END
+
+  if (workGRP != NULL)
+      CommonCloseSWG(workGRP, ISDC_OK);
+
+  return status;
+}
+
+
 int main (int argc, char *argv[])
 {
   int  status = ISDC_OK;
-  int chatter;
+  int chatter = 0,
+      daemonMode = 0,
+      served = 0;
+  char socketName[DAL_FILE_NAME_STRING];
 
   ibis_isgr_energy_settings_struct ibis_isgr_energy_settings;
   ISGRI_energy_caldb_dols_struct ISGRI_energy_caldb_dols;
-  dal_element  *workGRP = NULL;
+  ISGRI_energy_cal_cache_struct cal_cache;
   
+  memset(&ibis_isgr_energy_settings, 0, sizeof(ibis_isgr_energy_settings));
+  memset(&cal_cache, 0, sizeof(cal_cache));
   ibis_isgr_energy_settings.makeUnique = 1;
 
   TRY_BLOCK_BEGIN
@@ -154,12 +322,18 @@ int main (int argc, char *argv[])
         CommonExit(status);
       }
 
-      TRY( get_all_PIL(&workGRP,&ibis_isgr_energy_settings,&ISGRI_energy_caldb_dols,&chatter,status), status, "get_all_PIL" );
-
-      TRY( ibis_isgr_energyWork(workGRP, &ibis_isgr_energy_settings, &ISGRI_energy_caldb_dols,chatter,status), status, "ibis_isgr_energyWork" );
+      TRY( PILGetString("daemonSocket", socketName), status, "reading daemonSocket parameter");
+      TRY( PILGetBool("daemon", &daemonMode), status, "reading daemon parameter");
 
-      if (workGRP != NULL)
-          TRY( CommonCloseSWG(workGRP, status), status, "CommonCloseSWG");
+      if (daemonMode) {
+          if (strlen(socketName) == 0) FAIL(I_ISGR_ERR_BAD_INPUT, "The parameter 'daemonSocket' is empty");
+          TRY( ibis_isgr_energyDaemon(socketName, &cal_cache, status), status, "ibis_isgr_energyDaemon" );
+      } else {
+          if (strlen(socketName) > 0)
+              TRY( ibis_isgr_energyClient(socketName, &served, status), status, "ibis_isgr_energyClient" );
+          if (!served)
+              TRY( ibis_isgr_energyRun(&ibis_isgr_energy_settings, &ISGRI_energy_caldb_dols, &cal_cache, &chatter, status), status, "ibis_isgr_energyRun" );
+      }
 
       CommonExit(status);
 
@@ -0,0 +1,359 @@
+/************************************************************************
+ * FILE:        ibis_isgr_energy_parallel.c
+ * VERSION:     9.1
+ * COMPONENT:   ibis_isgr_energy
+ * AUTHOR:      V. Savchenko,   APC & ISDC
+ * DESCRIPTION: energy reconstruction by blocks of events, optionally
+ *              shared between forked worker processes. Each block has its own
+ *              random sequence, seeded from randSeed and the block number,
+ *              so that the result does not depend on the number of workers.
+ *              Spectra of the events (spectraFile) are accumulated per
+ *              block, or once all workers are done.
+ * HISTORY:
+ *   VS, 9.1  first version
+ *   VS, 9.1  no spectra in the shared memory of the workers
+ *   VS, 9.1  blocks with their own seeds also without workers (nThreads=0)
+ ************************************************************************/
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "ibis_isgr_energy.h"
+
+
+/* CPU time of the workers waited for so far, s */
+static double ibis_isgr_energyWorkersCpuTotal = 0.;
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyWorkersCpu
+ * DESCRIPTION:
+ *  CPU time (user and system) of all the reconstruction workers that
+ *  ended so far in this process, as given by wait4. Other children of
+ *  the process (e.g. of the revolution driver) are not counted.
+ *
+ * RETURN:   double   s
+ ************************************************************************/
+double ibis_isgr_energyWorkersCpu(void)
+{
+    return ibis_isgr_energyWorkersCpuTotal;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyBlockSeed
+ * DESCRIPTION:
+ *  Seed of the random generator for one block of events (splitmix64 of
+ *  the user seed and block number), below 2^32-1 as DAL3GENrandomSeed
+ *  requires.
+ *
+ * PARAMETERS:
+ *  seed     unsigned long   in   randSeed (0 if not given)
+ *  block             long   in   block number
+ * RETURN:   unsigned long   seed of the block
+ ************************************************************************/
+unsigned long ibis_isgr_energyBlockSeed(unsigned long seed,
+                                        long          block)
+{
+    unsigned long long z;
+
+    z=(unsigned long long)seed + 0x9E3779B97F4A7C15ull*(unsigned long long)(block+1);
+    z=(z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z=(z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z= z ^ (z >> 31);
+
+    return (unsigned long)((z >> 32) % 0xFFFFFFFEull);
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyThreads
+ * DESCRIPTION:
+ *  Number of threads of the process (Threads of /proc/self/status),
+ *  0 if unknown.
+ ************************************************************************/
+static int ibis_isgr_energyThreads(void)
+{
+    int   threads = 0;
+    char  line[DAL_BIG_STRING];
+    FILE *fp;
+
+    fp=fopen("/proc/self/status", "r");
+    if (fp == NULL) return 0;
+    while (fgets(line, sizeof(line), fp) != NULL)
+        if (sscanf(line, "Threads: %d", &threads) == 1) break;
+    fclose(fp);
+    return threads;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyReconstructBlock
+ * DESCRIPTION:
+ *  Reconstructs the energies of one block of ISGRI_RECON_BLOCK events and
+ *  writes them at the block position in the output arrays, then adds
+ *  the block to the spectra while it is in cache.
+ *
+ * PARAMETERS:
+ *  seed     unsigned long     in   randSeed
+ *  firstBlock        long     in   number of the first block of the list
+ *  block             long     in   block number in the list
+ *  isgriPi      DAL3_Byte *  out   ISGRI_PI of the whole list
+ *  isgriEnergy      float *  out   ISGRI_ENERGY of the whole list
+ *  ptr_spectra             in/out  spectra of the worker, NULL for none
+ * RETURN:            int     current status
+ ************************************************************************/
+static int ibis_isgr_energyReconstructBlock(ISGRI_energy_calibration_struct *ptr_ISGRI_energy_calibration,
+                                            IBIS_events_struct *ptr_IBIS_events,
+                                            unsigned long       seed,
+                                            long                firstBlock,
+                                            long                block,
+                                            DAL3_Byte          *isgriPi,
+                                            float              *isgriEnergy,
+                                            ISGRI_energy_spectra_struct *ptr_spectra,
+                                            int                 chatter,
+                                            int                 status)
+{
+    long first,
+         numEvents;
+
+    IBIS_events_struct view;
+
+    if (status != ISDC_OK) return status;
+
+    first=block*ISGRI_RECON_BLOCK;
+    numEvents=ptr_IBIS_events->numEvents-first;
+    if (numEvents > ISGRI_RECON_BLOCK) numEvents=ISGRI_RECON_BLOCK;
+
+    ibis_isgr_energyEventsView(ptr_IBIS_events, first, numEvents, &view);
+
+    DAL3GENrandomSeed(ibis_isgr_energyBlockSeed(seed, firstBlock+block));
+    status=DAL3IBIS_reconstruct_ISGRI_energies(ptr_ISGRI_energy_calibration, &view, chatter, status);
+    if (status != ISDC_OK) return status;
+
+    if (view.isgri_pi != isgriPi+first)
+        memcpy(isgriPi+first, view.isgri_pi, numEvents*sizeof(DAL3_Byte));
+    if (view.isgri_energy != isgriEnergy+first)
+        memcpy(isgriEnergy+first, view.isgri_energy, numEvents*sizeof(float));
+
+    if (ptr_spectra != NULL)
+        ibis_isgr_energySpectraAdd(ptr_spectra, numEvents, view.isgri_y, view.isgri_z,
+                                   view.riseTime, isgriPi+first, isgriEnergy+first);
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyCorrect
+ * DESCRIPTION:
+ *  Energy reconstruction of a list (or a block) of events with the seed
+ *  and the DAL lock of the settings (ibis_isgr_energyReconstruct).
+ * ERROR CODES:
+ *  ibis_isgr_energyReconstruct() error codes
+ *
+ * PARAMETERS:
+ *  ptr_ibis_isgr_energy_settings   in  seed, dalLock
+ *  ptr_spectra                 in/out  spectra, NULL for none (not
+ *                                      necessarily those of the settings)
+ *  others as ibis_isgr_energyReconstruct
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyCorrect(ISGRI_energy_calibration_struct *ptr_ISGRI_energy_calibration,
+                            IBIS_events_struct *ptr_IBIS_events,
+                            ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                            long                firstBlock,
+                            int                 numWorkers,
+                            ISGRI_energy_spectra_struct *ptr_spectra,
+                            int                 chatter,
+                            int                 status)
+{
+    return ibis_isgr_energyReconstruct(ptr_ISGRI_energy_calibration, ptr_IBIS_events,
+                                       ptr_ibis_isgr_energy_settings->seed, firstBlock,
+                                       numWorkers, ptr_ibis_isgr_energy_settings->dalLock,
+                                       ptr_spectra, chatter, status);
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyReconstruct
+ * DESCRIPTION:
+ *  Reconstructs ISGRI_PI and ISGRI_ENERGY of all events.
+ *  The list is cut into blocks of ISGRI_RECON_BLOCK events, each with its
+ *  own seed, processed by min(numWorkers, blocks) workers; with
+ *  numWorkers 0 or 1, by the calling process. Workers are forked
+ *  processes: the random generator of DAL3GEN is global, so threads could
+ *  not have independent sequences. Calibration and events are shared
+ *  copy-on-write, results come back through shared memory.
+ *  For a given randSeed, the output is identical for any numWorkers.
+ *  A process with other threads running (or an unknown number of them)
+ *  is not forked: a thread could hold a lock of DAL or of the C library
+ *  that the worker would then wait for forever. The blocks are then
+ *  corrected one after the other in the calling process, with the same
+ *  seeds and so the same result.
+ *  Unless those threads make their DAL calls holding dalLock (pipeline):
+ *  DAL3IBIS is then called, and the workers forked, holding it, and the
+ *  other threads go on while the workers run.
+ *  A part of the event list (streaming) starts at block firstBlock, and
+ *  gets the same seeds as in the whole list.
+ *  With ptr_spectra, the corrected events are added to the spectra, block
+ *  by block without workers; with forked workers, once they are all done,
+ *  so that the workers need no spectra of their own in shared memory.
+ * ERROR CODES:
+ *  I_ISGR_ERR_MEMORY         if output arrays cannot be allocated
+ *  I_ISGR_ERR_PARALLEL       if a worker died
+ *  DAL3IBIS_reconstruct_ISGRI_energies() error codes
+ *
+ * PARAMETERS:
+ *  ptr_ISGRI_energy_calibration    in      calibration
+ *  ptr_IBIS_events                 in/out  events
+ *  seed     unsigned long     in   randSeed (0 if not given)
+ *  firstBlock        long     in   block number of the first event
+ *  numWorkers         int     in   number of worker processes, 0 for none
+ *  dalLock pthread_mutex_t *  in   lock of the DAL calls of the other
+ *                                  threads, NULL if there are none
+ *  ptr_spectra                in/out  spectra, NULL for none
+ *  chatter           int      in   verbosity level
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyReconstruct(ISGRI_energy_calibration_struct *ptr_ISGRI_energy_calibration,
+                                IBIS_events_struct *ptr_IBIS_events,
+                                unsigned long       seed,
+                                long                firstBlock,
+                                int                 numWorkers,
+                                pthread_mutex_t    *dalLock,
+                                ISGRI_energy_spectra_struct *ptr_spectra,
+                                int                 chatter,
+                                int                 status)
+{
+    int        w,
+               waitStatus,
+               blockChatter,
+              *workerStatus;
+    long       b,
+               numBlocks,
+               numEvents;
+    size_t     sharedSize;
+    void      *shared;
+    pid_t     *pids;
+    struct rusage usage;
+    DAL3_Byte *sharedPi;
+    float     *sharedEnergy;
+
+    if (status != ISDC_OK) return status;
+
+    numEvents=ptr_IBIS_events->numEvents;
+    if (numEvents <= 0) return status;
+
+    numBlocks=(numEvents+ISGRI_RECON_BLOCK-1)/ISGRI_RECON_BLOCK;
+    if (numWorkers > numBlocks) numWorkers=(int)numBlocks;
+    blockChatter= chatter > 3 ? chatter : 0;
+
+    /* same allocator as the columns of DAL3IBIS_read_IBIS_events */
+    if (ptr_IBIS_events->isgri_pi == NULL)
+        status=DALallocateDataBuffer((void **)&ptr_IBIS_events->isgri_pi,
+                                     numEvents*sizeof(DAL3_Byte), status);
+    if (ptr_IBIS_events->isgri_energy == NULL)
+        status=DALallocateDataBuffer((void **)&ptr_IBIS_events->isgri_energy,
+                                     numEvents*sizeof(float), status);
+    if (status != ISDC_OK) {
+        RILlogMessage(NULL, Error_2, "Cannot allocate output for %ld events", numEvents);
+        return I_ISGR_ERR_MEMORY;
+    }
+
+    if (numWorkers > 1 && dalLock == NULL && ibis_isgr_energyThreads() != 1) {
+        RILlogMessage(NULL, Warning_1, "Other threads are running: %ld blocks corrected without workers",
+                      numBlocks);
+        numWorkers=1;
+    }
+
+    if (numWorkers < 1) numWorkers=1;
+
+    if (chatter > 2)
+        RILlogMessage(NULL, Log_0, "Reconstruction: %ld blocks of %ld events, %d workers",
+                      numBlocks, ISGRI_RECON_BLOCK, numWorkers);
+
+    if (numWorkers <= 1) {
+        for (b=0; b < numBlocks && status == ISDC_OK; b++) {
+            if (dalLock != NULL) pthread_mutex_lock(dalLock);
+            status=ibis_isgr_energyReconstructBlock(ptr_ISGRI_energy_calibration, ptr_IBIS_events,
+                                                    seed, firstBlock, b,
+                                                    ptr_IBIS_events->isgri_pi, ptr_IBIS_events->isgri_energy,
+                                                    ptr_spectra, blockChatter, status);
+            if (dalLock != NULL) pthread_mutex_unlock(dalLock);
+        }
+        return status;
+    }
+
+    /* worker status, energies, then PI: all naturally aligned */
+    sharedSize=numWorkers*sizeof(int) + numEvents*(sizeof(float)+sizeof(DAL3_Byte));
+    shared=mmap(NULL, sharedSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    pids=(pid_t *)malloc(numWorkers*sizeof(pid_t));
+    if (shared == MAP_FAILED || pids == NULL) {
+        RILlogMessage(NULL, Error_2, "Cannot allocate %lu bytes of shared memory", (unsigned long)sharedSize);
+        if (shared != MAP_FAILED) munmap(shared, sharedSize);
+        free(pids);
+        return I_ISGR_ERR_MEMORY;
+    }
+    workerStatus=(int *)shared;
+    sharedEnergy=(float *)(workerStatus+numWorkers);
+    sharedPi=(DAL3_Byte *)(sharedEnergy+numEvents);
+
+    /* no DAL call of another thread in progress while forking */
+    if (dalLock != NULL) pthread_mutex_lock(dalLock);
+    fflush(NULL);
+    for (w=0; w < numWorkers; w++) {
+        workerStatus[w]=ISDC_OK;
+        pids[w]=fork();
+        if (pids[w] == 0) {
+            for (b=w; b < numBlocks && workerStatus[w] == ISDC_OK; b+=numWorkers)
+                workerStatus[w]=ibis_isgr_energyReconstructBlock(ptr_ISGRI_energy_calibration, ptr_IBIS_events,
+                                                                 seed, firstBlock, b,
+                                                                 sharedPi, sharedEnergy, NULL,
+                                                                 blockChatter, ISDC_OK);
+            _exit(workerStatus[w] == ISDC_OK ? 0 : 1);
+        }
+        if (pids[w] < 0) {
+            /* no more processes: this share is done here, with the same seeds */
+            RILlogMessage(NULL, Warning_1, "Cannot start worker %d, running its blocks in the main process", w);
+            for (b=w; b < numBlocks && workerStatus[w] == ISDC_OK; b+=numWorkers)
+                workerStatus[w]=ibis_isgr_energyReconstructBlock(ptr_ISGRI_energy_calibration, ptr_IBIS_events,
+                                                                 seed, firstBlock, b,
+                                                                 sharedPi, sharedEnergy, NULL,
+                                                                 blockChatter, ISDC_OK);
+        }
+    }
+    if (dalLock != NULL) pthread_mutex_unlock(dalLock);
+
+    for (w=0; w < numWorkers; w++) {
+        if (pids[w] > 0) {
+            memset(&usage, 0, sizeof(usage));
+            if (wait4(pids[w], &waitStatus, 0, &usage) != pids[w]
+                || !WIFEXITED(waitStatus)
+                || (WEXITSTATUS(waitStatus) != 0 && workerStatus[w] == ISDC_OK))
+                workerStatus[w]=I_ISGR_ERR_PARALLEL;
+            ibis_isgr_energyWorkersCpuTotal+=usage.ru_utime.tv_sec + 1.0e-6*usage.ru_utime.tv_usec
+                                            +usage.ru_stime.tv_sec + 1.0e-6*usage.ru_stime.tv_usec;
+        }
+        if (workerStatus[w] != ISDC_OK) {
+            RILlogMessage(NULL, Error_2, "Reconstruction worker %d failed with status=%d", w, workerStatus[w]);
+            if (status == ISDC_OK) status=workerStatus[w];
+        }
+    }
+
+    if (status == ISDC_OK) {
+        memcpy(ptr_IBIS_events->isgri_pi, sharedPi, numEvents*sizeof(DAL3_Byte));
+        memcpy(ptr_IBIS_events->isgri_energy, sharedEnergy, numEvents*sizeof(float));
+        if (ptr_spectra != NULL)
+            ibis_isgr_energySpectraAdd(ptr_spectra, numEvents,
+                                       ptr_IBIS_events->isgri_y, ptr_IBIS_events->isgri_z,
+                                       ptr_IBIS_events->riseTime, ptr_IBIS_events->isgri_pi,
+                                       ptr_IBIS_events->isgri_energy);
+    }
+
+    munmap(shared, sharedSize);
+    free(pids);
+    return status;
+}
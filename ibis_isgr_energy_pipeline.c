@@ -0,0 +1,275 @@
+/************************************************************************
+ * FILE:        ibis_isgr_energy_pipeline.c
+ * VERSION:     9.1
+ * COMPONENT:   ibis_isgr_energy
+ * AUTHOR:      V. Savchenko,   APC & ISDC
+ * DESCRIPTION: pipelined streaming mode: a reader thread, the correction
+ *              and a writer thread exchange blocks of events through
+ *              queues, so that reading block N+1 and writing block N-1
+ *              overlap the correction of block N
+ * HISTORY:
+ *   VS, 9.1  first version
+ ************************************************************************/
+
+#include <pthread.h>
+#include "ibis_isgr_energy.h"
+
+
+/* queue of blocks; it holds at most all the blocks, so a push never waits */
+typedef struct {
+    ISGRI_energy_block_struct *items[ISGRI_PIPE_BUFFERS+1];
+    int                        head,
+                               count;
+    pthread_mutex_t            lock;
+    pthread_cond_t             notEmpty;
+} ISGRI_energy_queue_struct;
+
+typedef struct {
+    dal_element               *rawTable,
+                              *outTable;
+    long                       numEvents,
+                               blockRows;
+    ISGRI_energy_rows_struct  *rows;       /* selected rows, NULL: all */
+    int                        readStatus,
+                               writeStatus;
+    volatile int               failed;     /* set by any stage: others only pass blocks */
+    pthread_mutex_t            dalLock;    /* DAL is not thread-safe */
+    ISGRI_energy_queue_struct  freeQueue,
+                               readQueue,
+                               doneQueue;
+} ISGRI_energy_pipeline_struct;
+
+
+static void ibis_isgr_energyQueueInit(ISGRI_energy_queue_struct *ptr_queue)
+{
+    ptr_queue->head=0;
+    ptr_queue->count=0;
+    pthread_mutex_init(&ptr_queue->lock, NULL);
+    pthread_cond_init(&ptr_queue->notEmpty, NULL);
+}
+
+static void ibis_isgr_energyQueueDestroy(ISGRI_energy_queue_struct *ptr_queue)
+{
+    pthread_mutex_destroy(&ptr_queue->lock);
+    pthread_cond_destroy(&ptr_queue->notEmpty);
+}
+
+/* NULL marks the end of the stream */
+static void ibis_isgr_energyQueuePush(ISGRI_energy_queue_struct *ptr_queue,
+                                      ISGRI_energy_block_struct *ptr_block)
+{
+    pthread_mutex_lock(&ptr_queue->lock);
+    ptr_queue->items[(ptr_queue->head+ptr_queue->count) % (ISGRI_PIPE_BUFFERS+1)]=ptr_block;
+    ptr_queue->count++;
+    pthread_cond_signal(&ptr_queue->notEmpty);
+    pthread_mutex_unlock(&ptr_queue->lock);
+}
+
+static ISGRI_energy_block_struct *ibis_isgr_energyQueuePop(ISGRI_energy_queue_struct *ptr_queue)
+{
+    ISGRI_energy_block_struct *ptr_block;
+
+    pthread_mutex_lock(&ptr_queue->lock);
+    while (ptr_queue->count == 0)
+        pthread_cond_wait(&ptr_queue->notEmpty, &ptr_queue->lock);
+    ptr_block=ptr_queue->items[ptr_queue->head];
+    ptr_queue->head=(ptr_queue->head+1) % (ISGRI_PIPE_BUFFERS+1);
+    ptr_queue->count--;
+    pthread_mutex_unlock(&ptr_queue->lock);
+
+    return ptr_block;
+}
+
+
+/* reader stage: fills free blocks from ISGR-EVTS-ALL */
+static void *ibis_isgr_energyPipeRead(void *arg)
+{
+    long firstRow,
+         numRows;
+
+    ISGRI_energy_pipeline_struct *ptr_pipe=(ISGRI_energy_pipeline_struct *)arg;
+    ISGRI_energy_block_struct    *ptr_block;
+
+    for (firstRow=0; firstRow < ptr_pipe->numEvents && !ptr_pipe->failed; firstRow+=ptr_pipe->blockRows) {
+        numRows=ptr_pipe->numEvents-firstRow;
+        if (numRows > ptr_pipe->blockRows) numRows=ptr_pipe->blockRows;
+
+        ptr_block=ibis_isgr_energyQueuePop(&ptr_pipe->freeQueue);
+
+        pthread_mutex_lock(&ptr_pipe->dalLock);
+        ptr_pipe->readStatus=ibis_isgr_energyBlockRead(ptr_pipe->rawTable, firstRow, numRows, ptr_pipe->rows,
+                                                       ptr_block, ptr_pipe->readStatus);
+        pthread_mutex_unlock(&ptr_pipe->dalLock);
+        if (ptr_pipe->readStatus != ISDC_OK) {
+            ptr_pipe->failed=1;
+            ibis_isgr_energyQueuePush(&ptr_pipe->freeQueue, ptr_block);
+            break;
+        }
+        ibis_isgr_energyQueuePush(&ptr_pipe->readQueue, ptr_block);
+    }
+    ibis_isgr_energyQueuePush(&ptr_pipe->readQueue, NULL);
+    return NULL;
+}
+
+
+/* writer stage: writes corrected blocks to the output table */
+static void *ibis_isgr_energyPipeWrite(void *arg)
+{
+    ISGRI_energy_pipeline_struct *ptr_pipe=(ISGRI_energy_pipeline_struct *)arg;
+    ISGRI_energy_block_struct    *ptr_block;
+
+    while ((ptr_block=ibis_isgr_energyQueuePop(&ptr_pipe->doneQueue)) != NULL) {
+        if (!ptr_pipe->failed) {
+            pthread_mutex_lock(&ptr_pipe->dalLock);
+            ptr_pipe->writeStatus=ibis_isgr_energyBlockWrite(ptr_pipe->outTable, ptr_block,
+                                                             ptr_pipe->writeStatus);
+            pthread_mutex_unlock(&ptr_pipe->dalLock);
+            if (ptr_pipe->writeStatus != ISDC_OK) ptr_pipe->failed=1;
+        }
+        ibis_isgr_energyQueuePush(&ptr_pipe->freeQueue, ptr_block);
+    }
+    return NULL;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyPipeline
+ * DESCRIPTION:
+ *  Pipelined streaming mode. Same result as ibis_isgr_energyStream, with
+ *  the reading and writing of blocks done by two threads while the
+ *  calling thread corrects the current block. DAL calls of both threads
+ *  are serialised by a lock, also held by the correction while it calls
+ *  DAL3IBIS or forks its workers (nThreads, at least one as in the
+ *  streaming mode): reading and writing overlap the work of the forked
+ *  workers, not each other nor DAL3IBIS. The random generator of DAL3GEN
+ *  being global, blocks are corrected one after the other, with the
+ *  per-block seeds of the streaming mode.
+ * ERROR CODES:
+ *  DAL error codes
+ *  I_ISGR_ERR_MEMORY             Memory allocation error
+ *  I_ISGR_ERR_PARALLEL           if the threads cannot be started
+ *  ibis_isgr_energyPrepareOut()  error codes
+ *  ibis_isgr_energyReconstruct() error codes
+ *
+ * PARAMETERS:
+ *  same as ibis_isgr_energyStream
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyPipeline(dal_element        *workGRP,
+                             dal_element        *rawTable,
+                             char               *outName,
+                             ISGRI_energy_calibration_struct *ptr_ISGRI_energy_calibration,
+                             IBIS_events_struct *ptr_IBIS_events,
+                             ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                             int                 chatter,
+                             int                 status)
+{
+    int          i,
+                 numWorkers,
+                 numBuffers = 0,
+                 haveReader = 0,
+                 haveWriter = 0;
+    long         numBlocks = 0;
+    pthread_t    reader,
+                 writer;
+
+    IBIS_events_struct            view;
+    ISGRI_energy_block_struct     blocks[ISGRI_PIPE_BUFFERS],
+                                 *ptr_block;
+    ISGRI_energy_pipeline_struct  pipe;
+    ISGRI_energy_spectra_struct  *ptr_spectra=ptr_ibis_isgr_energy_settings->spectra;
+
+    if (status != ISDC_OK) return status;
+
+    memset(&pipe, 0, sizeof(pipe));
+    pipe.rawTable=rawTable;
+    pipe.rows=ptr_ibis_isgr_energy_settings->rows;
+    pipe.numEvents=ptr_IBIS_events->numEvents;
+    pipe.blockRows=ibis_isgr_energyBlockRows(ptr_ibis_isgr_energy_settings->streamRows);
+    if (pipe.blockRows > pipe.numEvents && pipe.numEvents > 0) pipe.blockRows=pipe.numEvents;
+    numWorkers=ptr_ibis_isgr_energy_settings->nThreads > 0 ? ptr_ibis_isgr_energy_settings->nThreads : 1;
+
+    status=ibis_isgr_energyPrepareOut(workGRP, outName, pipe.numEvents, ptr_ibis_isgr_energy_settings,
+                                      &pipe.outTable, chatter, status);
+    if (status != ISDC_OK) return status;
+
+    if (chatter > 1)
+        RILlogMessage(NULL, Log_1, "Pipelined streaming of %ld events by blocks of %ld",
+                      pipe.numEvents, pipe.blockRows);
+
+    pthread_mutex_init(&pipe.dalLock, NULL);
+    ibis_isgr_energyQueueInit(&pipe.freeQueue);
+    ibis_isgr_energyQueueInit(&pipe.readQueue);
+    ibis_isgr_energyQueueInit(&pipe.doneQueue);
+
+    for (i=0; i < ISGRI_PIPE_BUFFERS && status == ISDC_OK; i++) {
+        status=ibis_isgr_energyBlockAlloc(&blocks[i], pipe.blockRows,
+                                          ptr_ibis_isgr_energy_settings->arena, status);
+        if (status == ISDC_OK) {
+            numBuffers++;
+            ibis_isgr_energyQueuePush(&pipe.freeQueue, &blocks[i]);
+        }
+    }
+
+    if (status == ISDC_OK) {
+        haveReader=(pthread_create(&reader, NULL, ibis_isgr_energyPipeRead,  &pipe) == 0);
+        haveWriter=(pthread_create(&writer, NULL, ibis_isgr_energyPipeWrite, &pipe) == 0);
+        if (!haveReader || !haveWriter) {
+            RILlogMessage(NULL, Error_2, "Cannot start pipeline threads");
+            status=I_ISGR_ERR_PARALLEL;
+            pipe.failed=1;
+            if (!haveReader) ibis_isgr_energyQueuePush(&pipe.readQueue, NULL);
+        }
+    }
+
+    /* correction stage */
+    ptr_ibis_isgr_energy_settings->dalLock=&pipe.dalLock;
+    if (haveReader || haveWriter) {
+        while ((ptr_block=ibis_isgr_energyQueuePop(&pipe.readQueue)) != NULL) {
+            if (!pipe.failed && ptr_block->numSelected > 0) {
+                ibis_isgr_energyBlockView(ptr_IBIS_events, ptr_block, &view);
+                status=ibis_isgr_energyCorrect(ptr_ISGRI_energy_calibration, &view,
+                                               ptr_ibis_isgr_energy_settings,
+                                               ptr_block->firstRow/ISGRI_RECON_BLOCK, numWorkers,
+                                               ptr_block->numSelected == ptr_block->numRows ? ptr_spectra : NULL,
+                                               chatter, status);
+                if (status == ISDC_OK && view.isgri_pi != ptr_block->isgri_pi)
+                    memcpy(ptr_block->isgri_pi, view.isgri_pi, ptr_block->numRows*sizeof(DAL3_Byte));
+                if (status == ISDC_OK && view.isgri_energy != ptr_block->isgri_energy)
+                    memcpy(ptr_block->isgri_energy, view.isgri_energy, ptr_block->numRows*sizeof(float));
+                if (status == ISDC_OK && ptr_spectra != NULL && ptr_block->numSelected < ptr_block->numRows)
+                    ibis_isgr_energyBlockSpectra(pipe.rows, ptr_block, ptr_spectra);
+                if (status != ISDC_OK) pipe.failed=1;
+                numBlocks++;
+            }
+            ibis_isgr_energyBlockFill(pipe.rows, ptr_block);
+            if (haveWriter)
+                ibis_isgr_energyQueuePush(&pipe.doneQueue, ptr_block);
+            else
+                ibis_isgr_energyQueuePush(&pipe.freeQueue, ptr_block);
+        }
+        if (haveWriter) ibis_isgr_energyQueuePush(&pipe.doneQueue, NULL);
+    }
+
+    if (haveReader) pthread_join(reader, NULL);
+    if (haveWriter) pthread_join(writer, NULL);
+    ptr_ibis_isgr_energy_settings->dalLock=NULL;
+
+    for (i=0; i < numBuffers; i++)
+        ibis_isgr_energyBlockFree(&blocks[i]);
+    ibis_isgr_energyQueueDestroy(&pipe.freeQueue);
+    ibis_isgr_energyQueueDestroy(&pipe.readQueue);
+    ibis_isgr_energyQueueDestroy(&pipe.doneQueue);
+    pthread_mutex_destroy(&pipe.dalLock);
+
+    if (status == ISDC_OK) status=pipe.readStatus;
+    if (status == ISDC_OK) status=pipe.writeStatus;
+    if (status != ISDC_OK) {
+        RILlogMessage(NULL, Error_2, "Cannot write output data. Status=%d", status);
+        return status;
+    }
+    if (chatter > 2)
+        RILlogMessage(NULL, Log_0, "Pipeline: %ld blocks corrected", numBlocks);
+    RILlogMessage(NULL, Log_0, "all done");
+    return status;
+}
@@ -0,0 +1,171 @@
+/************************************************************************
+ * FILE:        ibis_isgr_energy_prefetch.c
+ * VERSION:     9.1
+ * COMPONENT:   ibis_isgr_energy
+ * AUTHOR:      V. Savchenko,   APC & ISDC
+ * DESCRIPTION: calibration files read ahead (parameter calPrefetch): a
+ *              thread reads the files of the calibration tables and of
+ *              the converted HK into the page cache while the events are
+ *              read, so that the loading of the calibration, done
+ *              afterwards by DAL3IBIS, does not wait for the disk. The
+ *              tables of index DOLs and the HK of the group are found
+ *              before the thread starts: the thread makes no DAL call,
+ *              DAL is not thread safe.
+ * HISTORY:
+ *   VS, 9.1  first version
+ *   VS, 9.1  members of the indexes and HK of the group read ahead
+ ************************************************************************/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include "fitsio.h"
+#include "ibis_isgr_energy.h"
+
+
+static double ibis_isgr_energyPrefetchNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1.0e-9*ts.tv_nsec;
+}
+
+
+/* adds the file of a DOL (without extension) to the list, once */
+static void ibis_isgr_energyPrefetchAdd(ISGRI_energy_prefetch_struct *ptr_prefetch,
+                                        char *DOL)
+{
+    int  i;
+    char fileName[DAL_FILE_NAME_STRING],
+        *ptr_end;
+
+    if (DOL == NULL || ptr_prefetch->numFiles >= ISGRI_PREFETCH_FILES) return;
+
+    while (*DOL == ' ') DOL++;
+    strncpy(fileName, DOL, DAL_FILE_NAME_STRING-1);
+    fileName[DAL_FILE_NAME_STRING-1]='\0';
+    if ((ptr_end=strchr(fileName, '[')) != NULL) *ptr_end='\0';
+    for (ptr_end=fileName+strlen(fileName); ptr_end > fileName && ptr_end[-1] == ' '; ptr_end--)
+        ptr_end[-1]='\0';
+    if (fileName[0] == '\0') return;
+
+    for (i=0; i < ptr_prefetch->numFiles; i++)
+        if (strcmp(ptr_prefetch->files[i], fileName) == 0) return;
+    strcpy(ptr_prefetch->files[ptr_prefetch->numFiles++], fileName);
+}
+
+
+/* thread: reads the files through, the data are dropped */
+static void *ibis_isgr_energyPrefetchRun(void *arg)
+{
+    int     i,
+            fd;
+    ssize_t numRead;
+    double  t0=ibis_isgr_energyPrefetchNow();
+    char   *buffer;
+
+    ISGRI_energy_prefetch_struct *ptr_prefetch=(ISGRI_energy_prefetch_struct *)arg;
+
+    buffer=(char *)malloc(ISGRI_PREFETCH_CHUNK);
+    for (i=0; i < ptr_prefetch->numFiles && buffer != NULL; i++) {
+        if ((fd=open(ptr_prefetch->files[i], O_RDONLY)) < 0) continue;
+#ifdef POSIX_FADV_WILLNEED
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+        while ((numRead=read(fd, buffer, ISGRI_PREFETCH_CHUNK)) > 0)
+            ptr_prefetch->bytes+=numRead;
+        close(fd);
+    }
+    free(buffer);
+
+    ptr_prefetch->wall=ibis_isgr_energyPrefetchNow()-t0;
+    return NULL;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyPrefetchStart
+ * DESCRIPTION:
+ *  Starts reading ahead the files of the LUT1, MCEC, LUT2 and L2RE
+ *  tables (their copies in the calibration snapshot if any), and of the
+ *  converted HK given by hkCnvDOL, else of the group (its member
+ *  IBIS-DPE.-CNV, found through inGRP). In batch mode, for an index DOL,
+ *  the tables of the Science Window are selected first
+ *  (ibis_isgr_energyCalSelect, kept in the cache for
+ *  ibis_isgr_energyCalibrate), and the member tables are read ahead, not
+ *  the index. Nothing is started if the thread cannot be
+ *  created: the calibration is then read as without calPrefetch.
+ *
+ * PARAMETERS:
+ *  ptr_prefetch               out  files and thread
+ *  workGRP   dal_element *     in  working group (TSTART/TSTOP)
+ *  ptr_ISGRI_energy_caldb_dols in  calibration DOLs
+ *  ptr_cal_cache           in/out  tables selected
+ *  hkCnvDOL         char *     in  converted HK, "" for the group's
+ *  chatter           int       in  verbosity level
+ ************************************************************************/
+void ibis_isgr_energyPrefetchStart(ISGRI_energy_prefetch_struct   *ptr_prefetch,
+                                   dal_element                    *workGRP,
+                                   ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                                   ISGRI_energy_cal_cache_struct  *ptr_cal_cache,
+                                   char                           *hkCnvDOL,
+                                   int                             chatter)
+{
+    double tStart,
+           tStop;
+    char   grpDOL[DAL_FILE_NAME_STRING],
+           hkFile[DAL_FILE_NAME_STRING];
+
+    memset(ptr_prefetch, 0, sizeof(ISGRI_energy_prefetch_struct));
+
+    /* members of the indexes; on failure ibis_isgr_energyCalibrate reports it */
+    if (ptr_cal_cache->select && ibis_isgr_energyScwTime(workGRP, &tStart, &tStop, ISDC_OK) == ISDC_OK)
+        ibis_isgr_energyCalSelect(ptr_cal_cache, ptr_ISGRI_energy_caldb_dols, tStart, tStop, chatter, ISDC_OK);
+
+#define PREFETCH_TABLE(table) \
+    ibis_isgr_energyPrefetchAdd(ptr_prefetch, \
+        ptr_ISGRI_energy_caldb_dols->table##_snap[0] != '\0' ? ptr_ISGRI_energy_caldb_dols->table##_snap : \
+        ptr_cal_cache->table.resolved && strcmp(ptr_cal_cache->table.DOL, ptr_ISGRI_energy_caldb_dols->table##_DOL) == 0 ? \
+            ptr_cal_cache->table.member : ptr_ISGRI_energy_caldb_dols->table##_DOL)
+
+    PREFETCH_TABLE(lut1);
+    PREFETCH_TABLE(mcec);
+    PREFETCH_TABLE(lut2);
+    PREFETCH_TABLE(l2re);
+
+#undef PREFETCH_TABLE
+    if (hkCnvDOL[0] != '\0')
+        ibis_isgr_energyPrefetchAdd(ptr_prefetch, hkCnvDOL);
+    else if (PILGetString("inGRP", grpDOL) == ISDC_OK) {
+        ibis_isgr_energyGroupMember(grpDOL, DS_ISGR_HK, hkFile);
+        ibis_isgr_energyPrefetchAdd(ptr_prefetch, hkFile);
+    }
+
+    if (ptr_prefetch->numFiles == 0) return;
+
+    ptr_prefetch->started=(pthread_create(&ptr_prefetch->thread, NULL,
+                                          ibis_isgr_energyPrefetchRun, ptr_prefetch) == 0);
+    if (!ptr_prefetch->started)
+        RILlogMessage(NULL, Warning_1, "Cannot start the calibration prefetch thread");
+    else if (chatter > 2)
+        RILlogMessage(NULL, Log_0, "Reading ahead %d calibration files", ptr_prefetch->numFiles);
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyPrefetchJoin
+ * DESCRIPTION:
+ *  Waits for the read ahead of ibis_isgr_energyPrefetchStart (if any).
+ ************************************************************************/
+void ibis_isgr_energyPrefetchJoin(ISGRI_energy_prefetch_struct *ptr_prefetch,
+                                  int                           chatter)
+{
+    if (!ptr_prefetch->started) return;
+
+    pthread_join(ptr_prefetch->thread, NULL);
+    ptr_prefetch->started=0;
+    if (chatter > 2)
+        RILlogMessage(NULL, Log_0, "Calibration files read ahead: %d files, %.0f bytes in %.3f s",
+                      ptr_prefetch->numFiles, ptr_prefetch->bytes, ptr_prefetch->wall);
+}
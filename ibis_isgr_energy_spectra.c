@@ -0,0 +1,223 @@
+/************************************************************************
+ * FILE:        ibis_isgr_energy_spectra.c
+ * VERSION:     9.1
+ * COMPONENT:   ibis_isgr_energy
+ * AUTHOR:      V. Savchenko,   APC & ISDC
+ * DESCRIPTION: spectra of the corrected events (parameter spectraFile):
+ *              ISGRI_PI counts per pixel and energy x rise time counts per
+ *              MDU, accumulated while the events of a block are in cache,
+ *              so that the calibration monitoring needs no second pass
+ *              over ISGR-EVTS-COR. They go to a file of their own, not
+ *              to extensions of the Science Window group, so that one
+ *              file collects the spectra of a whole batch
+ * HISTORY:
+ *   VS, 9.1  first version
+ *   VS, 9.1  MDU of the ISGRI modules, images tile-compressed, lookup of
+ *            the spectra of a fingerprint (incremental mode)
+ *   VS, 9.1  pixel to MDU mapping recorded (MDUMAP), documented as unverified
+ ************************************************************************/
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "fitsio.h"
+#include "ibis_isgr_energy.h"
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energySpectraAdd
+ * DESCRIPTION:
+ *  Adds corrected events to the spectra. Events out of the detector are
+ *  only counted (numOutside); events out of the energy range of the MDU
+ *  spectra are in the pixel spectra only (numOverflow).
+ *
+ * PARAMETERS:
+ *  ptr_spectra                 in/out  spectra
+ *  numEvents         long      in   number of events
+ *  isgriY, isgriZ    DAL3_Byte *  in   pixel coordinates
+ *  riseTime          DAL3_Byte *  in   rise time
+ *  isgriPi           DAL3_Byte *  in   ISGRI_PI
+ *  isgriEnergy       float *      in   ISGRI_ENERGY, keV
+ ************************************************************************/
+void ibis_isgr_energySpectraAdd(ISGRI_energy_spectra_struct *ptr_spectra,
+                                long             numEvents,
+                                const DAL3_Byte *isgriY,
+                                const DAL3_Byte *isgriZ,
+                                const DAL3_Byte *riseTime,
+                                const DAL3_Byte *isgriPi,
+                                const float     *isgriEnergy)
+{
+    long  i,
+          pixel,
+          bin;
+    float energy;
+
+    for (i=0; i < numEvents; i++) {
+        pixel=ISGRI_PIXEL(isgriY[i], isgriZ[i]);
+        if (pixel >= ISGRI_N_PIX) {
+            ptr_spectra->numOutside++;
+            continue;
+        }
+        ptr_spectra->pixelPi[pixel*ISGRI_SPEC_N_PI+isgriPi[i]]++;
+
+        energy=isgriEnergy[i];
+        if (!(energy >= 0.0f && energy < ISGRI_SPEC_N_ENERGY*ISGRI_SPEC_ENERGY_BIN)) {
+            ptr_spectra->numOverflow++;
+            continue;
+        }
+        bin=(long)(energy/ISGRI_SPEC_ENERGY_BIN);
+        if (bin >= ISGRI_SPEC_N_ENERGY) bin=ISGRI_SPEC_N_ENERGY-1;
+        ptr_spectra->mduEnergy[((long)ISGRI_MDU(isgriY[i], isgriZ[i])*ISGRI_SPEC_N_RT+riseTime[i])*ISGRI_SPEC_N_ENERGY+bin]++;
+    }
+    ptr_spectra->numEvents+=numEvents;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energySpectraWrite
+ * DESCRIPTION:
+ *  Appends the spectra of one Science Window to the spectra file, as two
+ *  image extensions (created with an empty primary if the file is new):
+ *    ISGR-PIXL-SPE  ISGRI_PI x pixel (pixel = 128*ISGRI_Y + ISGRI_Z)
+ *    ISGR-MDU.-SPE  energy x rise time x MDU (ISGRI_MDU), bins of EBIN keV,
+ *                   with the mapping of the pixels to the MDU (MDUMAP)
+ *  both with the SWID and fingerprint (ISGFPRNT) of the Science Window.
+ *  The images are Rice tile-compressed: most of their 20 MB of counts are
+ *  zeros.
+ *  The file is locked while written, so that the workers of the batch
+ *  mode (nProcs) can share it.
+ * ERROR CODES:
+ *  I_ISGR_ERR_SPECTRA        if the spectra cannot be written
+ *
+ * PARAMETERS:
+ *  spectraFile      char *    in   file name
+ *  ptr_spectra                in   spectra of the Science Window
+ *  swid             char *    in   SWID, "" if unknown
+ *  fingerprint      char *    in   fingerprint of the inputs
+ *  chatter           int      in   verbosity level
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energySpectraWrite(char *spectraFile,
+                                 ISGRI_energy_spectra_struct *ptr_spectra,
+                                 char *swid,
+                                 char *fingerprint,
+                                 int   chatter,
+                                 int   status)
+{
+    int       lockFd,
+              fitsStatus = 0;
+    long      pixelAxes[2] = { ISGRI_SPEC_N_PI, ISGRI_N_PIX },
+              mduAxes[3]   = { ISGRI_SPEC_N_ENERGY, ISGRI_SPEC_N_RT, ISGRI_N_MDU };
+    float     energyBin = ISGRI_SPEC_ENERGY_BIN;
+    char      createName[DAL_FILE_NAME_STRING+1];
+    fitsfile *fits = NULL;
+    struct stat fileStat;
+
+    if (status != ISDC_OK) return status;
+
+    lockFd=open(spectraFile, O_RDWR|O_CREAT, 0644);
+    if (lockFd < 0 || flock(lockFd, LOCK_EX) != 0) {
+        RILlogMessage(NULL, Error_2, "Cannot lock spectra file %s", spectraFile);
+        if (lockFd >= 0) close(lockFd);
+        return I_ISGR_ERR_SPECTRA;
+    }
+
+    if (fstat(lockFd, &fileStat) == 0 && fileStat.st_size == 0) {
+        snprintf(createName, sizeof(createName), "!%s", spectraFile);
+        fits_create_file(&fits, createName, &fitsStatus);
+        fits_create_img(fits, BYTE_IMG, 0, NULL, &fitsStatus);
+        fits_write_key(fits, TSTRING, "COMPVERS", COMPONENT_VERSION,
+                       COMPONENT_NAME " version", &fitsStatus);
+        fits_write_chksum(fits, &fitsStatus);
+    } else {
+        fits_open_file(&fits, spectraFile, READWRITE, &fitsStatus);
+    }
+
+    fits_set_compression_type(fits, RICE_1, &fitsStatus);
+    fits_create_img(fits, LONG_IMG, 2, pixelAxes, &fitsStatus);
+    fits_update_key(fits, TSTRING, "EXTNAME", DS_ISGR_PIX_SPE, "ISGRI_PI counts per pixel", &fitsStatus);
+    fits_write_key(fits, TSTRING, "SWID", swid, "Science Window", &fitsStatus);
+    fits_write_key(fits, TSTRING, KEY_FINGERPRINT, fingerprint, "fingerprint of the inputs", &fitsStatus);
+    fits_write_key(fits, TLONG, "NEVENTS", &ptr_spectra->numEvents, "corrected events", &fitsStatus);
+    fits_write_key(fits, TLONG, "NOUTSIDE", &ptr_spectra->numOutside, "events out of the detector", &fitsStatus);
+    fits_write_img(fits, TUINT, 1, ISGRI_N_PIX*ISGRI_SPEC_N_PI, ptr_spectra->pixelPi, &fitsStatus);
+    fits_write_chksum(fits, &fitsStatus);
+
+    fits_create_img(fits, LONG_IMG, 3, mduAxes, &fitsStatus);
+    fits_update_key(fits, TSTRING, "EXTNAME", DS_ISGR_MDU_SPE, "energy x rise time counts per MDU", &fitsStatus);
+    fits_write_key(fits, TSTRING, "SWID", swid, "Science Window", &fitsStatus);
+    fits_write_key(fits, TSTRING, KEY_FINGERPRINT, fingerprint, "fingerprint of the inputs", &fitsStatus);
+    fits_write_key(fits, TFLOAT, "EBIN", &energyBin, "[keV] width of the energy bins", &fitsStatus);
+    fits_write_key(fits, TSTRING, "MDUMAP", ISGRI_MDU_MAP, "MDU of a pixel, not verified", &fitsStatus);
+    fits_write_key(fits, TLONG, "NOVERFLO", &ptr_spectra->numOverflow, "events out of the energy bins", &fitsStatus);
+    fits_write_img(fits, TUINT, 1, ISGRI_N_MDU*ISGRI_SPEC_N_RT*ISGRI_SPEC_N_ENERGY,
+                   ptr_spectra->mduEnergy, &fitsStatus);
+    fits_write_chksum(fits, &fitsStatus);
+
+    if (fits != NULL) fits_close_file(fits, &fitsStatus);
+    close(lockFd);
+
+    if (fitsStatus != 0) {
+        RILlogMessage(NULL, Error_2, "Cannot write spectra file %s (FITS status %d)", spectraFile, fitsStatus);
+        return I_ISGR_ERR_SPECTRA;
+    }
+    if (chatter > 1)
+        RILlogMessage(NULL, Log_1, "Spectra of %ld events added to %s", ptr_spectra->numEvents, spectraFile);
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energySpectraHas
+ * DESCRIPTION:
+ *  Tells if the spectra file has the spectra of the inputs of the given
+ *  fingerprint (ISGR-MDU.-SPE, the last extension written for a Science
+ *  Window, with that ISGFPRNT), so that an up-to-date output is only kept
+ *  (incremental) when its spectra are there too.
+ *
+ * PARAMETERS:
+ *  spectraFile      char *    in   file name
+ *  fingerprint      char *    in   current fingerprint
+ * RETURN:            int     1 if the spectra are in the file
+ ************************************************************************/
+int ibis_isgr_energySpectraHas(char *spectraFile,
+                               char *fingerprint)
+{
+    int       lockFd,
+              fitsStatus = 0,
+              numHdus = 0,
+              hdu,
+              found = 0;
+    char      extName[FLEN_VALUE],
+              previous[FLEN_VALUE];
+    fitsfile *fits = NULL;
+
+    if (fingerprint[0] == '\0') return 0;
+
+    if ((lockFd=open(spectraFile, O_RDONLY)) < 0) return 0;
+    if (flock(lockFd, LOCK_SH) != 0) {
+        close(lockFd);
+        return 0;
+    }
+
+    fits_open_file(&fits, spectraFile, READONLY, &fitsStatus);
+    fits_get_num_hdus(fits, &numHdus, &fitsStatus);
+    for (hdu=numHdus; hdu > 1 && fitsStatus == 0 && !found; hdu--) {
+        fits_movabs_hdu(fits, hdu, NULL, &fitsStatus);
+        extName[0]=previous[0]='\0';
+        fits_read_key(fits, TSTRING, "EXTNAME", extName, NULL, &fitsStatus);
+        if (fitsStatus == 0 && strcmp(extName, DS_ISGR_MDU_SPE) == 0) {
+            fits_read_key(fits, TSTRING, KEY_FINGERPRINT, previous, NULL, &fitsStatus);
+            found=(fitsStatus == 0 && strcmp(previous, fingerprint) == 0);
+        }
+        if (fitsStatus == KEY_NO_EXIST) fitsStatus=0;
+    }
+    if (fits != NULL) {
+        fitsStatus=0;
+        fits_close_file(fits, &fitsStatus);
+    }
+    close(lockFd);
+
+    return found;
+}
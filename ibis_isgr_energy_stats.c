@@ -0,0 +1,318 @@
+/************************************************************************
+ * FILE:        ibis_isgr_energy_stats.c
+ * VERSION:     9.1
+ * COMPONENT:   ibis_isgr_energy
+ * AUTHOR:      V. Savchenko,   APC & ISDC
+ * DESCRIPTION: per-stage instrumentation of ibis_isgr_energyWork: wall and
+ *              CPU time, rows, bytes read and written (as counted by the
+ *              kernel), peak RSS. Reported in the log, as keywords of
+ *              ISGR-EVTS-COR and in an optional JSON sidecar (parameter
+ *              statsFile).
+ * HISTORY:
+ *   VS, 9.1  first version
+ ************************************************************************/
+
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "ibis_isgr_energy.h"
+
+
+/* wall time, s */
+static double ibis_isgr_energyStatsWall(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
+/* CPU time of the process and of its reconstruction workers, s; peak RSS, kB */
+static double ibis_isgr_energyStatsCpu(long *peakRss)
+{
+    double        cpu;
+    struct rusage self;
+
+    getrusage(RUSAGE_SELF, &self);
+    cpu=self.ru_utime.tv_sec + 1.0e-6*self.ru_utime.tv_usec
+       +self.ru_stime.tv_sec + 1.0e-6*self.ru_stime.tv_usec
+       +ibis_isgr_energyWorkersCpu();
+    if (peakRss != NULL) *peakRss=self.ru_maxrss;
+
+    return cpu;
+}
+
+/* bytes read and written by the process (rchar, wchar of /proc/self/io),
+   0 if not available */
+static int ibis_isgr_energyStatsIo(double *bytesRead,
+                                   double *bytesWritten)
+{
+    int   found = 0;
+    char  line[DAL_BIG_STRING];
+    FILE *fp;
+
+    *bytesRead=*bytesWritten=0.;
+    fp=fopen("/proc/self/io", "r");
+    if (fp == NULL) return 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "rchar: %lf", bytesRead) == 1) found|=1;
+        if (sscanf(line, "wchar: %lf", bytesWritten) == 1) found|=2;
+    }
+    fclose(fp);
+    return found == 3;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyStatsBegin
+ * DESCRIPTION:
+ *  Starts the measure of a stage.
+ *
+ * PARAMETERS:
+ *  name             char *   in    stage name
+ ************************************************************************/
+void ibis_isgr_energyStatsBegin(ISGRI_energy_stats_struct *ptr_stats,
+                                char   *name)
+{
+    if (ptr_stats->numStages == 0 && ptr_stats->wallStart == 0.)
+        ptr_stats->wallStart=ibis_isgr_energyStatsWall();
+    snprintf(ptr_stats->current, sizeof(ptr_stats->current), "%s", name);
+    ptr_stats->open=1;
+    ptr_stats->wall0=ibis_isgr_energyStatsWall();
+    ptr_stats->cpu0=ibis_isgr_energyStatsCpu(NULL);
+    if (!ibis_isgr_energyStatsIo(&ptr_stats->read0, &ptr_stats->written0))
+        ptr_stats->read0=ptr_stats->written0=-1.;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyStatsEnd
+ * DESCRIPTION:
+ *  Ends the measure of the stage started by ibis_isgr_energyStatsBegin:
+ *  wall and CPU time, bytes read and written by the process (all its
+ *  threads, e.g. the calibration read ahead, and its reconstruction
+ *  workers) during the stage, peak RSS. Stages beyond
+ *  ISGRI_STATS_MAX_STAGES are ignored.
+ *
+ * PARAMETERS:
+ *  rows             long     in    rows processed
+ ************************************************************************/
+void ibis_isgr_energyStatsEnd(ISGRI_energy_stats_struct *ptr_stats,
+                              long    rows)
+{
+    double bytesRead,
+           bytesWritten;
+
+    ISGRI_energy_stage_stats_struct *ptr_stage;
+
+    if (!ptr_stats->open) return;
+    ptr_stats->open=0;
+    if (ptr_stats->numStages >= ISGRI_STATS_MAX_STAGES) return;
+
+    ptr_stage=&ptr_stats->stage[ptr_stats->numStages++];
+    snprintf(ptr_stage->name, sizeof(ptr_stage->name), "%s", ptr_stats->current);
+    ptr_stage->wall=ibis_isgr_energyStatsWall()-ptr_stats->wall0;
+    ptr_stage->cpu=ibis_isgr_energyStatsCpu(&ptr_stage->peakRss)-ptr_stats->cpu0;
+    ptr_stage->rows=rows;
+    ptr_stage->bytesRead=ptr_stage->bytesWritten=-1.;
+    if (ptr_stats->read0 >= 0. && ibis_isgr_energyStatsIo(&bytesRead, &bytesWritten)) {
+        ptr_stage->bytesRead=bytesRead-ptr_stats->read0;
+        ptr_stage->bytesWritten=bytesWritten-ptr_stats->written0;
+    }
+}
+
+
+/* JSON string without quotes, backslashes or control characters */
+void ibis_isgr_energyStatsJsonString(FILE *fp, const char *string)
+{
+    fputc('"', fp);
+    for (; *string != '\0'; string++) {
+        if (*string == '"' || *string == '\\') fputc('\\', fp);
+        if ((unsigned char)*string >= 0x20) fputc(*string, fp);
+    }
+    fputc('"', fp);
+}
+
+
+/* totals of the stages, bytes -1 if unknown for one of them */
+static void ibis_isgr_energyStatsTotals(ISGRI_energy_stats_struct *ptr_stats,
+                                        double *cpu,
+                                        double *bytesRead,
+                                        double *bytesWritten,
+                                        long   *peakRss)
+{
+    int i;
+    ISGRI_energy_stage_stats_struct *ptr_stage;
+
+    *cpu=*bytesRead=*bytesWritten=0.;
+    *peakRss=0;
+    for (i=0; i < ptr_stats->numStages; i++) {
+        ptr_stage=&ptr_stats->stage[i];
+        *cpu+=ptr_stage->cpu;
+        if (*bytesRead >= 0.)
+            *bytesRead= ptr_stage->bytesRead < 0. ? -1. : *bytesRead+ptr_stage->bytesRead;
+        if (*bytesWritten >= 0.)
+            *bytesWritten= ptr_stage->bytesWritten < 0. ? -1. : *bytesWritten+ptr_stage->bytesWritten;
+        if (ptr_stage->peakRss > *peakRss) *peakRss=ptr_stage->peakRss;
+    }
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyStatsKeywords
+ * DESCRIPTION:
+ *  Writes the totals of the stages measured so far as keywords of the
+ *  output table, before it is stamped:
+ *    ISGTWALL, ISGTCPU  total wall and CPU time, s
+ *    ISGPKRSS           peak resident set size, kB
+ *    ISGBYTRD, ISGBYTWR bytes read and written (-1: unknown)
+ *    ISGWT01..          wall time of each stage, s (name in the comment)
+ *  A failure is a warning: it never changes the status.
+ *
+ * PARAMETERS:
+ *  outTable dal_element *    in    output table
+ *  ptr_stats                 in    measured stages
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyStatsKeywords(dal_element *outTable,
+                                  ISGRI_energy_stats_struct *ptr_stats,
+                                  int          status)
+{
+    int     i,
+            keyStatus = ISDC_OK;
+    long    peakRss;
+    double  cpu,
+            bytesRead,
+            bytesWritten;
+    char    key[16],
+            comment[DAL_BIG_STRING];
+
+    if (status != ISDC_OK) return status;
+
+    ibis_isgr_energyStatsTotals(ptr_stats, &cpu, &bytesRead, &bytesWritten, &peakRss);
+    keyStatus=DALattributePutReal(outTable, "ISGTWALL", ibis_isgr_energyStatsWall()-ptr_stats->wallStart,
+                                  "s", "ibis_isgr_energy wall time", keyStatus);
+    keyStatus=DALattributePutReal(outTable, "ISGTCPU",  cpu,  "s", "ibis_isgr_energy CPU time", keyStatus);
+    keyStatus=DALattributePutInt(outTable,  "ISGPKRSS", peakRss, "kB", "ibis_isgr_energy peak RSS", keyStatus);
+    keyStatus=DALattributePutReal(outTable, "ISGBYTRD", bytesRead, "byte", "ibis_isgr_energy bytes read", keyStatus);
+    keyStatus=DALattributePutReal(outTable, "ISGBYTWR", bytesWritten, "byte", "ibis_isgr_energy bytes written", keyStatus);
+    for (i=0; i < ptr_stats->numStages; i++) {
+        snprintf(key, sizeof(key), "ISGWT%02d", i+1);
+        snprintf(comment, sizeof(comment), "wall time of %s", ptr_stats->stage[i].name);
+        keyStatus=DALattributePutReal(outTable, key, ptr_stats->stage[i].wall, "s", comment, keyStatus);
+    }
+    if (keyStatus != ISDC_OK)
+        RILlogMessage(NULL, Warning_1, "Cannot write timing keywords. Status=%d", keyStatus);
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyStatsJson
+ * DESCRIPTION:
+ *  Writes the stages of one Science Window as one JSON object, without
+ *  end of line (statsFile, reply of the daemon).
+ *
+ * PARAMETERS:
+ *  fp              FILE *    in    output
+ *  ptr_stats                 in    measured stages, reported
+ *  runStatus        int      in    status of the run
+ ************************************************************************/
+void ibis_isgr_energyStatsJson(FILE  *fp,
+                               ISGRI_energy_stats_struct *ptr_stats,
+                               int    runStatus)
+{
+    int     i;
+    long    peakRss;
+    double  cpu,
+            bytesRead,
+            bytesWritten;
+
+    ISGRI_energy_stage_stats_struct *ptr_stage;
+
+    ibis_isgr_energyStatsTotals(ptr_stats, &cpu, &bytesRead, &bytesWritten, &peakRss);
+
+    fprintf(fp, "{\"component\":\"%s\",\"version\":\"%s\",\"swid\":", COMPONENT_NAME, COMPONENT_VERSION);
+    ibis_isgr_energyStatsJsonString(fp, ptr_stats->swid);
+    fprintf(fp, ",\"status\":%d,\"wall_s\":%.6f,\"cpu_s\":%.6f,\"peak_rss_kb\":%ld,"
+                "\"bytes_read\":%.0f,\"bytes_written\":%.0f,\"stages\":[",
+            runStatus, ptr_stats->wallEnd-ptr_stats->wallStart, cpu, peakRss, bytesRead, bytesWritten);
+    for (i=0; i < ptr_stats->numStages; i++) {
+        ptr_stage=&ptr_stats->stage[i];
+        fprintf(fp, "%s{\"name\":", i > 0 ? "," : "");
+        ibis_isgr_energyStatsJsonString(fp, ptr_stage->name);
+        fprintf(fp, ",\"wall_s\":%.6f,\"cpu_s\":%.6f,\"rows\":%ld,"
+                    "\"bytes_read\":%.0f,\"bytes_written\":%.0f,\"peak_rss_kb\":%ld}",
+                ptr_stage->wall, ptr_stage->cpu, ptr_stage->rows,
+                ptr_stage->bytesRead, ptr_stage->bytesWritten, ptr_stage->peakRss);
+    }
+    fprintf(fp, "]}");
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyStatsReport
+ * DESCRIPTION:
+ *  Reports the stages of one Science Window: in the log (chatter > 2),
+ *  and as one JSON line appended to the statsFile (if not empty). A
+ *  stage still being measured (the run failed in it) is ended first,
+ *  as "<stage> (failed)". The keywords of the output table are written
+ *  before it is stamped (ibis_isgr_energyStatsKeywords).
+ *  A failure to report is a warning: it never changes the status.
+ *
+ * PARAMETERS:
+ *  workGRP  dal_element *    in    working group, for SWID
+ *  ptr_stats                 in/out  measured stages (wallEnd, swid set)
+ *  runStatus        int      in    status of the run
+ *  statsFile       char *    in    JSON sidecar, "" for none
+ *  chatter          int      in    verbosity level
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyStatsReport(dal_element *workGRP,
+                                ISGRI_energy_stats_struct *ptr_stats,
+                                int          runStatus,
+                                char        *statsFile,
+                                int          chatter,
+                                int          status)
+{
+    int     i;
+    char    name[sizeof(ptr_stats->current)];
+    FILE   *fp;
+
+    ISGRI_energy_stage_stats_struct *ptr_stage;
+
+    if (ptr_stats->open) {
+        snprintf(name, sizeof(name), "%s", ptr_stats->current);
+        snprintf(ptr_stats->current, sizeof(ptr_stats->current), "%.22s (failed)", name);
+        ibis_isgr_energyStatsEnd(ptr_stats, 0);
+    }
+
+    ptr_stats->wallEnd=ibis_isgr_energyStatsWall();
+    for (i=0; i < ptr_stats->numStages; i++) {
+        ptr_stage=&ptr_stats->stage[i];
+        if (chatter > 2)
+            RILlogMessage(NULL, Log_0, "Stage %-22s wall %8.3f s  cpu %8.3f s  rows %9ld  rss %8ld kB"
+                          "  read %.0f  written %.0f",
+                          ptr_stage->name, ptr_stage->wall, ptr_stage->cpu,
+                          ptr_stage->rows, ptr_stage->peakRss,
+                          ptr_stage->bytesRead, ptr_stage->bytesWritten);
+    }
+
+    ptr_stats->swid[0]='\0';
+    if (workGRP != NULL
+        && DALattributeGetChar(workGRP, "SWID", ptr_stats->swid, NULL, NULL, ISDC_OK) != ISDC_OK)
+        ptr_stats->swid[0]='\0';
+
+    if (statsFile == NULL || statsFile[0] == '\0') return status;
+
+    fp=fopen(statsFile, "a");
+    if (fp == NULL) {
+        RILlogMessage(NULL, Warning_1, "Cannot open statistics file %s", statsFile);
+        return status;
+    }
+    ibis_isgr_energyStatsJson(fp, ptr_stats, runStatus);
+    fprintf(fp, "\n");
+    if (fclose(fp) != 0)
+        RILlogMessage(NULL, Warning_1, "Cannot write statistics file %s", statsFile);
+
+    return status;
+}
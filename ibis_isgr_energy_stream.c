@@ -0,0 +1,493 @@
+/************************************************************************
+ * FILE:        ibis_isgr_energy_stream.c
+ * VERSION:     9.1
+ * COMPONENT:   ibis_isgr_energy
+ * AUTHOR:      V. Savchenko,   APC & ISDC
+ * DESCRIPTION: streaming mode: events are read, corrected and written by
+ *              blocks of rows, memory does not depend on the ScW length
+ * HISTORY:
+ *   VS, 9.1  first version
+ *   VS, 9.1  OBT range from a few rows of ISGR-EVTS-PRP, events not read
+ ************************************************************************/
+
+#include "ibis_isgr_energy.h"
+
+
+/* OBT of an OBTSTART/OBTEND keyword of the group (decimal string) */
+static int ibis_isgr_energyGroupObt(dal_element *workGRP,
+                                    char        *keyName,
+                                    OBTime      *obt,
+                                    int          status)
+{
+    char  value[DAL_BIG_STRING],
+         *end;
+
+    status=DALattributeGetChar(workGRP, keyName, value, NULL, NULL, status);
+    if (status != ISDC_OK) return status;
+
+    *obt=(OBTime)strtoll(value, &end, 10);
+    if (end == value) {
+        RILlogMessage(NULL, Error_2, "%s of the group is not an OBT: %s", keyName, value);
+        return I_ISGR_ERR_BAD_INPUT;
+    }
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyStreamHeader
+ * DESCRIPTION:
+ *  Fills the Science Window part of an event list without reading the
+ *  events: the number of events is that of the rows of ISGR-EVTS-ALL,
+ *  which are streamed, and the OBT range is read from OB_TIME of the
+ *  first and last events of ISGR-EVTS-PRP, with useGTI of the first and
+ *  last events inside the GTI (ibis_isgr_energyGtiRows, into ptr_rows).
+ *  Without ISGR-EVTS-PRP rows (useGTI no), or without event in the GTI,
+ *  the OBTSTART/OBTEND keywords of the group are used. Calibration
+ *  loading and the temperature and bias correction get the OBT range of
+ *  the events selected, as without streaming; only a few rows are read.
+ * ERROR CODES:
+ *  DAL error codes
+ *  I_ISGR_ERR_BAD_INPUT      if OBTSTART/OBTEND is not an OBT
+ *  ibis_isgr_energyGtiRows() error codes
+ *
+ * PARAMETERS:
+ *  workGRP   dal_element *     in  working group
+ *  gti               int       in  useGTI
+ *  ptr_arena                   in  arena of the Science Window
+ *  ptr_rows                   out  with useGTI, the rows in the GTI
+ *  ptr_IBIS_events            out  event list without columns
+ *  rawTable  dal_element **   out  ISGR-EVTS-ALL
+ *  chatter           int      in   verbosity level
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyStreamHeader(dal_element               *workGRP,
+                                 int                        gti,
+                                 ISGRI_energy_arena_struct *ptr_arena,
+                                 ISGRI_energy_rows_struct  *ptr_rows,
+                                 IBIS_events_struct        *ptr_IBIS_events,
+                                 dal_element              **rawTable,
+                                 int                        chatter,
+                                 int                        status)
+{
+    long         numPrp = 0,
+                 first = 0,
+                 last = 0;
+    dal_element *prpTable = NULL;
+
+    if (status != ISDC_OK) return status;
+
+    memset(ptr_IBIS_events, 0, sizeof(IBIS_events_struct));
+    memset(ptr_rows, 0, sizeof(ISGRI_energy_rows_struct));
+
+    status=DALobjectFindElement(workGRP, DS_ISGR_RAW, rawTable, status);
+    status=DALtableGetNumRows(*rawTable, &ptr_IBIS_events->numEvents, status);
+    if (status != ISDC_OK) {
+        RILlogMessage(NULL, Error_2, "%13s bintable NOT found.", DS_ISGR_RAW);
+        return status;
+    }
+
+    if (gti) {
+        status=ibis_isgr_energyGtiRows(workGRP, ptr_IBIS_events->numEvents,
+                                       ptr_arena, ptr_rows, chatter, status);
+        if (status != ISDC_OK) return status;
+        if (ptr_rows->numRanges > 0) {
+            first=ptr_rows->first[0];
+            last=ptr_rows->last[ptr_rows->numRanges-1];
+        }
+    } else if (DALobjectFindElement(workGRP, DS_ISGR_PRP, &prpTable, ISDC_OK) == ISDC_OK
+               && DALtableGetNumRows(prpTable, &numPrp, ISDC_OK) == ISDC_OK
+               && numPrp == ptr_IBIS_events->numEvents) {
+        last=numPrp;
+    }
+
+    if (last > first) {
+        status=ibis_isgr_energyPrpObt(workGRP, first, last-1,
+                                      &ptr_IBIS_events->obtStart, &ptr_IBIS_events->obtEnd, status);
+    } else {
+        status=ibis_isgr_energyGroupObt(workGRP, "OBTSTART", &ptr_IBIS_events->obtStart, status);
+        status=ibis_isgr_energyGroupObt(workGRP, "OBTEND",   &ptr_IBIS_events->obtEnd,   status);
+    }
+    if (status != ISDC_OK) {
+        RILlogMessage(NULL, Error_2, "Cannot read the OBT range of the events. Status=%d", status);
+        return status;
+    }
+
+    if (chatter > 1)
+        RILlogMessage(NULL, Log_1, "%13s: %ld events to stream, OBT %lld - %lld", DS_ISGR_RAW,
+                      ptr_IBIS_events->numEvents,
+                      (long long)ptr_IBIS_events->obtStart, (long long)ptr_IBIS_events->obtEnd);
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyBlockAlloc / ibis_isgr_energyBlockFree
+ * DESCRIPTION:
+ *  Allocates (frees) the columns of a block of at most maxRows events,
+ *  from the arena if not NULL (then freed with the arena).
+ * ERROR CODES:
+ *  I_ISGR_ERR_MEMORY         Memory allocation error
+ ************************************************************************/
+int ibis_isgr_energyBlockAlloc(ISGRI_energy_block_struct *ptr_block,
+                               long                       maxRows,
+                               ISGRI_energy_arena_struct *ptr_arena,
+                               int                        status)
+{
+    if (status != ISDC_OK) return status;
+
+    memset(ptr_block, 0, sizeof(ISGRI_energy_block_struct));
+    ptr_block->maxRows=maxRows;
+    ptr_block->arena=ptr_arena;
+
+#define BLOCK_COLUMN_ALLOC(size) \
+    (ptr_arena != NULL ? ibis_isgr_energyArenaAlloc(ptr_arena, size) : malloc(size))
+
+    ptr_block->isgri_pha   =(DAL3_Word *)BLOCK_COLUMN_ALLOC(maxRows*sizeof(DAL3_Word));
+    ptr_block->riseTime    =(DAL3_Byte *)BLOCK_COLUMN_ALLOC(maxRows*sizeof(DAL3_Byte));
+    ptr_block->isgri_y     =(DAL3_Byte *)BLOCK_COLUMN_ALLOC(maxRows*sizeof(DAL3_Byte));
+    ptr_block->isgri_z     =(DAL3_Byte *)BLOCK_COLUMN_ALLOC(maxRows*sizeof(DAL3_Byte));
+    ptr_block->isgri_pi    =(DAL3_Byte *)BLOCK_COLUMN_ALLOC(maxRows*sizeof(DAL3_Byte));
+    ptr_block->isgri_energy=(float     *)BLOCK_COLUMN_ALLOC(maxRows*sizeof(float));
+
+#undef BLOCK_COLUMN_ALLOC
+
+    if (ptr_block->isgri_pha == NULL || ptr_block->riseTime == NULL
+        || ptr_block->isgri_y == NULL || ptr_block->isgri_z == NULL
+        || ptr_block->isgri_pi == NULL || ptr_block->isgri_energy == NULL) {
+        ibis_isgr_energyBlockFree(ptr_block);
+        RILlogMessage(NULL, Error_2, "Cannot allocate a block of %ld events", maxRows);
+        return I_ISGR_ERR_MEMORY;
+    }
+    return status;
+}
+
+void ibis_isgr_energyBlockFree(ISGRI_energy_block_struct *ptr_block)
+{
+    if (ptr_block->arena == NULL) {
+        free(ptr_block->isgri_pha);
+        free(ptr_block->riseTime);
+        free(ptr_block->isgri_y);
+        free(ptr_block->isgri_z);
+        free(ptr_block->isgri_pi);
+        free(ptr_block->isgri_energy);
+    }
+    memset(ptr_block, 0, sizeof(ISGRI_energy_block_struct));
+}
+
+
+/* input columns of rows firstRow.. (0-based) at position offset of the block */
+static int ibis_isgr_energyBlockReadRows(dal_element               *rawTable,
+                                         long                       firstRow,
+                                         long                       numRows,
+                                         long                       offset,
+                                         ISGRI_energy_block_struct *ptr_block,
+                                         int                        status)
+{
+    dal_dataType type;
+
+    type=DAL_USHORT;
+    status=DALtableGetColBins(rawTable, "ISGRI_PHA", 0, &type, firstRow+1, numRows, ptr_block->isgri_pha+offset, status);
+    type=DAL_BYTE;
+    status=DALtableGetColBins(rawTable, "RISE_TIME", 0, &type, firstRow+1, numRows, ptr_block->riseTime+offset, status);
+    type=DAL_BYTE;
+    status=DALtableGetColBins(rawTable, "ISGRI_Y",   0, &type, firstRow+1, numRows, ptr_block->isgri_y+offset, status);
+    type=DAL_BYTE;
+    status=DALtableGetColBins(rawTable, "ISGRI_Z",   0, &type, firstRow+1, numRows, ptr_block->isgri_z+offset, status);
+
+    return status;
+}
+
+
+/* first range of the selection ending after row */
+static long ibis_isgr_energyRowsSearch(ISGRI_energy_rows_struct *ptr_rows,
+                                       long                      row)
+{
+    long low = 0,
+         high = ptr_rows->numRanges,
+         middle;
+
+    while (low < high) {
+        middle=low+(high-low)/2;
+        if (ptr_rows->last[middle] <= row) low=middle+1;
+        else                               high=middle;
+    }
+    return low;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyBlockRead
+ * DESCRIPTION:
+ *  Reads the input columns of rows firstRow..firstRow+numRows-1 (0-based)
+ *  of ISGR-EVTS-ALL into the block. With a selection of rows (ptr_rows
+ *  not NULL), only the selected rows are read, the others are set to 0;
+ *  numSelected of the block tells how many were read.
+ * ERROR CODES:
+ *  DAL error codes
+ ************************************************************************/
+int ibis_isgr_energyBlockRead(dal_element               *rawTable,
+                              long                       firstRow,
+                              long                       numRows,
+                              ISGRI_energy_rows_struct  *ptr_rows,
+                              ISGRI_energy_block_struct *ptr_block,
+                              int                        status)
+{
+    long i,
+         first,
+         last;
+
+    if (status != ISDC_OK) return status;
+
+    ptr_block->firstRow=firstRow;
+    ptr_block->numRows=numRows;
+    ptr_block->numSelected=numRows;
+
+    if (ptr_rows == NULL) {
+        status=ibis_isgr_energyBlockReadRows(rawTable, firstRow, numRows, 0, ptr_block, status);
+    } else {
+        memset(ptr_block->isgri_pha, 0, numRows*sizeof(DAL3_Word));
+        memset(ptr_block->riseTime,  0, numRows*sizeof(DAL3_Byte));
+        memset(ptr_block->isgri_y,   0, numRows*sizeof(DAL3_Byte));
+        memset(ptr_block->isgri_z,   0, numRows*sizeof(DAL3_Byte));
+        ptr_block->numSelected=0;
+        for (i=ibis_isgr_energyRowsSearch(ptr_rows, firstRow);
+             i < ptr_rows->numRanges && ptr_rows->first[i] < firstRow+numRows && status == ISDC_OK; i++) {
+            first= ptr_rows->first[i] > firstRow ? ptr_rows->first[i] : firstRow;
+            last=  ptr_rows->last[i] < firstRow+numRows ? ptr_rows->last[i] : firstRow+numRows;
+            status=ibis_isgr_energyBlockReadRows(rawTable, first, last-first, first-firstRow, ptr_block, status);
+            ptr_block->numSelected+=last-first;
+        }
+    }
+
+    if (status != ISDC_OK)
+        RILlogMessage(NULL, Error_2, "Cannot read events %ld-%ld. Status=%d",
+                      firstRow+1, firstRow+numRows, status);
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyBlockFill
+ * DESCRIPTION:
+ *  Sets ISGRI_FILL_PI and ISGRI_FILL_ENERGY for the rows of the block
+ *  outside the selection (nothing without selection).
+ ************************************************************************/
+void ibis_isgr_energyBlockFill(ISGRI_energy_rows_struct  *ptr_rows,
+                               ISGRI_energy_block_struct *ptr_block)
+{
+    long i,
+         row,
+         next,
+         end=ptr_block->firstRow+ptr_block->numRows;
+
+    if (ptr_rows == NULL) return;
+
+    i=ibis_isgr_energyRowsSearch(ptr_rows, ptr_block->firstRow);
+    for (row=ptr_block->firstRow; row < end; row=next) {
+        if (i < ptr_rows->numRanges && ptr_rows->first[i] <= row) {
+            next= ptr_rows->last[i] < end ? ptr_rows->last[i] : end;
+            i++;
+            continue;
+        }
+        next= i < ptr_rows->numRanges && ptr_rows->first[i] < end ? ptr_rows->first[i] : end;
+        for (; row < next; row++) {
+            ptr_block->isgri_pi[row-ptr_block->firstRow]=ISGRI_FILL_PI;
+            ptr_block->isgri_energy[row-ptr_block->firstRow]=ISGRI_FILL_ENERGY;
+        }
+    }
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyBlockSpectra
+ * DESCRIPTION:
+ *  Adds the corrected rows of the block inside the selection to the
+ *  spectra (the whole block without selection).
+ ************************************************************************/
+void ibis_isgr_energyBlockSpectra(ISGRI_energy_rows_struct    *ptr_rows,
+                                  ISGRI_energy_block_struct   *ptr_block,
+                                  ISGRI_energy_spectra_struct *ptr_spectra)
+{
+    long i,
+         first,
+         last,
+         end=ptr_block->firstRow+ptr_block->numRows;
+
+#define BLOCK_SPECTRA(offset, numRows) \
+    ibis_isgr_energySpectraAdd(ptr_spectra, numRows, \
+                               ptr_block->isgri_y+(offset), ptr_block->isgri_z+(offset), \
+                               ptr_block->riseTime+(offset), ptr_block->isgri_pi+(offset), \
+                               ptr_block->isgri_energy+(offset))
+
+    if (ptr_rows == NULL) {
+        BLOCK_SPECTRA(0, ptr_block->numRows);
+        return;
+    }
+    for (i=ibis_isgr_energyRowsSearch(ptr_rows, ptr_block->firstRow);
+         i < ptr_rows->numRanges && ptr_rows->first[i] < end; i++) {
+        first= ptr_rows->first[i] > ptr_block->firstRow ? ptr_rows->first[i] : ptr_block->firstRow;
+        last=  ptr_rows->last[i] < end ? ptr_rows->last[i] : end;
+        BLOCK_SPECTRA(first-ptr_block->firstRow, last-first);
+    }
+
+#undef BLOCK_SPECTRA
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyBlockWrite
+ * DESCRIPTION:
+ *  Writes ISGRI_PI and ISGRI_ENERGY of the block at its rows of the
+ *  output table.
+ * ERROR CODES:
+ *  DAL error codes
+ ************************************************************************/
+int ibis_isgr_energyBlockWrite(dal_element               *outTable,
+                               ISGRI_energy_block_struct *ptr_block,
+                               int                        status)
+{
+    if (status != ISDC_OK) return status;
+
+    status=ibis_isgr_energyWriteRows(outTable, ptr_block->firstRow, ptr_block->numRows,
+                                     ptr_block->isgri_pi, ptr_block->isgri_energy, status);
+
+    if (status != ISDC_OK)
+        RILlogMessage(NULL, Error_2, "Cannot write events %ld-%ld. Status=%d",
+                      ptr_block->firstRow+1, ptr_block->firstRow+ptr_block->numRows, status);
+    return status;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyBlockView
+ * DESCRIPTION:
+ *  Event list of the block: Science Window part of the header list,
+ *  columns of the block.
+ ************************************************************************/
+void ibis_isgr_energyBlockView(IBIS_events_struct        *ptr_header,
+                               ISGRI_energy_block_struct *ptr_block,
+                               IBIS_events_struct        *ptr_view)
+{
+    *ptr_view=*ptr_header;
+    ptr_view->numEvents   =ptr_block->numRows;
+    ptr_view->isgri_pha   =ptr_block->isgri_pha;
+    ptr_view->riseTime    =ptr_block->riseTime;
+    ptr_view->isgri_y     =ptr_block->isgri_y;
+    ptr_view->isgri_z     =ptr_block->isgri_z;
+    ptr_view->isgri_pi    =ptr_block->isgri_pi;
+    ptr_view->isgri_energy=ptr_block->isgri_energy;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyBlockRows
+ * DESCRIPTION:
+ *  Rows per streaming block: streamRows rounded up to a multiple of
+ *  ISGRI_RECON_BLOCK, so that the random seeds of the reconstruction
+ *  blocks are the same as without streaming.
+ ************************************************************************/
+long ibis_isgr_energyBlockRows(long streamRows)
+{
+    return ((streamRows+ISGRI_RECON_BLOCK-1)/ISGRI_RECON_BLOCK)*ISGRI_RECON_BLOCK;
+}
+
+
+/************************************************************************
+ * FUNCTION:  ibis_isgr_energyStream
+ * DESCRIPTION:
+ *  Streaming mode: prepares the output table, then reads, reconstructs
+ *  and writes the events block by block. Only one block is in memory.
+ *  The reconstruction is done with per-block random seeds, as without
+ *  streaming, so the result does not depend on streamRows. With a selection of rows
+ *  (gtiRows), only the selected rows are read, blocks without any are not
+ *  corrected, and the other rows get the fill values.
+ *  The spectra (spectraFile) get the events of the blocks entirely
+ *  selected during their reconstruction, those of the other blocks
+ *  (selected rows only) just after it.
+ * ERROR CODES:
+ *  DAL error codes
+ *  I_ISGR_ERR_MEMORY             Memory allocation error
+ *  ibis_isgr_energyPrepareOut()  error codes
+ *  ibis_isgr_energyReconstruct() error codes
+ *
+ * PARAMETERS:
+ *  workGRP   dal_element *     in  working group
+ *  rawTable  dal_element *     in  ISGR-EVTS-ALL
+ *  outName          char *     in  bintable name of the output data
+ *  ptr_ISGRI_energy_calibration    in  calibration
+ *  ptr_IBIS_events                 in  Science Window part of the events
+ *  ptr_ibis_isgr_energy_settings   in  streamRows, nThreads, seed, erase, rows,
+ *                                      spectra
+ *  chatter           int      in   verbosity level
+ * RETURN:            int     current status
+ ************************************************************************/
+int ibis_isgr_energyStream(dal_element        *workGRP,
+                           dal_element        *rawTable,
+                           char               *outName,
+                           ISGRI_energy_calibration_struct *ptr_ISGRI_energy_calibration,
+                           IBIS_events_struct *ptr_IBIS_events,
+                           ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                           int                 chatter,
+                           int                 status)
+{
+    int          numWorkers;
+    long         blockRows,
+                 firstRow,
+                 numRows,
+                 numEvents;
+    dal_element *outTable;
+
+    ISGRI_energy_spectra_struct *ptr_spectra=ptr_ibis_isgr_energy_settings->spectra;
+
+    IBIS_events_struct        view;
+    ISGRI_energy_block_struct block;
+
+    if (status != ISDC_OK) return status;
+
+    numEvents=ptr_IBIS_events->numEvents;
+    blockRows=ibis_isgr_energyBlockRows(ptr_ibis_isgr_energy_settings->streamRows);
+    if (blockRows > numEvents && numEvents > 0) blockRows=numEvents;
+    numWorkers=ptr_ibis_isgr_energy_settings->nThreads;
+
+    status=ibis_isgr_energyPrepareOut(workGRP, outName, numEvents, ptr_ibis_isgr_energy_settings,
+                                      &outTable, chatter, status);
+    if (status != ISDC_OK) return status;
+
+    if (chatter > 1)
+        RILlogMessage(NULL, Log_1, "Streaming %ld events by blocks of %ld", numEvents, blockRows);
+
+    status=ibis_isgr_energyBlockAlloc(&block, blockRows, ptr_ibis_isgr_energy_settings->arena, status);
+    for (firstRow=0; firstRow < numEvents && status == ISDC_OK; firstRow+=blockRows) {
+        numRows=numEvents-firstRow;
+        if (numRows > blockRows) numRows=blockRows;
+
+        status=ibis_isgr_energyBlockRead(rawTable, firstRow, numRows, ptr_ibis_isgr_energy_settings->rows,
+                                         &block, status);
+        if (status == ISDC_OK && block.numSelected > 0) {
+            ibis_isgr_energyBlockView(ptr_IBIS_events, &block, &view);
+            status=ibis_isgr_energyCorrect(ptr_ISGRI_energy_calibration, &view,
+                                           ptr_ibis_isgr_energy_settings,
+                                           firstRow/ISGRI_RECON_BLOCK, numWorkers,
+                                           block.numSelected == numRows ? ptr_spectra : NULL,
+                                           chatter, status);
+            /* the reconstruction may return its own arrays */
+            if (status == ISDC_OK && view.isgri_pi != block.isgri_pi)
+                memcpy(block.isgri_pi, view.isgri_pi, numRows*sizeof(DAL3_Byte));
+            if (status == ISDC_OK && view.isgri_energy != block.isgri_energy)
+                memcpy(block.isgri_energy, view.isgri_energy, numRows*sizeof(float));
+            if (status == ISDC_OK && ptr_spectra != NULL && block.numSelected < numRows)
+                ibis_isgr_energyBlockSpectra(ptr_ibis_isgr_energy_settings->rows, &block, ptr_spectra);
+        }
+        ibis_isgr_energyBlockFill(ptr_ibis_isgr_energy_settings->rows, &block);
+        status=ibis_isgr_energyBlockWrite(outTable, &block, status);
+    }
+    ibis_isgr_energyBlockFree(&block);
+
+    if (status != ISDC_OK) {
+        RILlogMessage(NULL, Error_2, "Cannot write output data. Status=%d", status);
+        return status;
+    }
+    RILlogMessage(NULL, Log_0, "all done");
+    return status;
+}
@@ -0,0 +1,712 @@
+/************************************************************************
+ * FILE:        ibis_isgr_energy_synth.c
+ * VERSION:     9.1
+ * COMPONENT:   ibis_isgr_energy
+ * AUTHOR:      V. Savchenko,   APC & ISDC
+ * DESCRIPTION: generator of synthetic Science Window groups for the
+ *              regression suite (unit_test/README.regress): a group
+ *              swg.fits with ISGR-EVTS-ALL, ISGR-EVTS-PRP (with the
+ *              OB_TIME of the events), IBIS-GNRL-GTI, IBIS-DPE.-CNV and
+ *              ISGR-EVTS-COR. Events are written by blocks, so any number
+ *              of events can be made. The data are reproducible for a
+ *              given seed. Calibration files cal/ with ISGR-OFFS-MOD,
+ *              ISGR-MCEC-MOD, ISGR-3DL2-MOD and ISGR-L2RE-MOD valid for
+ *              the Science Window are written with them (or alone, -cal):
+ *              each one is made from the ISDC template of its data
+ *              structure, so that its layout is the one DAL3IBIS reads,
+ *              and filled with arbitrary but reproducible values. The
+ *              corrected energies are then not physical: the tables only
+ *              serve the suites and the bench, without CALDB.
+ *              Also gives the data checksum of a table (-sum), to compare
+ *              outputs with the baselines of the suite, and compares the
+ *              tile-compressed output (outCompressed) with the current
+ *              one (-compress): ISGRI_PI and ISGRI_ENERGY of a given
+ *              ISGR-EVTS-COR written as a plain table, then compressed
+ *              from it to other files as the program does
+ *              (ibis_isgr_energyCompressFile), without and with
+ *              ISGRI_ENERGY rounded, with their size, write and read
+ *              throughput.
+ * USAGE:
+ *   ibis_isgr_energy_synth <directory> <numEvents> [seed]
+ *   ibis_isgr_energy_synth -cal <directory>
+ *   ibis_isgr_energy_synth -sum <DOL of a table>
+ *   ibis_isgr_energy_synth -compress <DOL of ISGR-EVTS-COR> <directory> [tolerance]
+ * HISTORY:
+ *   VS, 9.1  first version
+ *   VS, 9.1  OB_TIME only in ISGR-EVTS-PRP, no synthetic calibration
+ *   VS, 9.1  -compress through the compression of the output in its file
+ *   VS, 9.1  calibration files from the ISDC templates (cal/, -cal)
+ *   VS, 9.1  -compress from the plain file to separate files
+ ************************************************************************/
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <math.h>
+#include <time.h>
+#include "fitsio.h"
+#include "ibis_isgr_energy.h"
+
+
+#define SYNTH_BLOCK       1048576l    /* events written at once */
+#define SYNTH_DURATION    3600.0      /* s, of the Science Window */
+#define SYNTH_HK_PERIOD   8.0         /* s, between HK1 samples */
+#define SYNTH_REVOL       1234
+#define SYNTH_OBT_START   (((OBTime)SYNTH_REVOL << 32) + 0x10000000ll)
+#define SYNTH_IJD_START   4000.25     /* TSTART */
+#define SYNTH_VALIDITY    10.0        /* days of validity of the calibration around TSTART */
+#define SYNTH_PHA_LINE    600         /* channel of the line (about 60 keV) */
+#define SYNTH_TOLERANCE   0.01        /* keV, default rounding of -compress */
+
+
+/* xorshift: reproducible synthetic data */
+static unsigned long ibis_isgr_energySynthRand(unsigned long long *state)
+{
+    *state^=*state << 13;
+    *state^=*state >> 7;
+    *state^=*state << 17;
+    return (unsigned long)(*state >> 11);
+}
+
+/* uniform in [0, 1) */
+static double ibis_isgr_energySynthUniform(unsigned long long *state)
+{
+    return (ibis_isgr_energySynthRand(state) % 1000000ul)*1.0e-6;
+}
+
+
+/* creates a file with one empty binary table, positioned on it */
+static fitsfile *ibis_isgr_energySynthTable(char *dirName,
+                                            char *fileName,
+                                            char *extName,
+                                            int   numCols,
+                                            char *names[],
+                                            char *forms[],
+                                            int  *fitsStatus)
+{
+    char      path[DAL_FILE_NAME_STRING];
+    fitsfile *fits = NULL;
+
+    snprintf(path, DAL_FILE_NAME_STRING, "!%s/%s", dirName, fileName);
+    fits_create_file(&fits, path, fitsStatus);
+    fits_create_tbl(fits, BINARY_TBL, 0, numCols, names, forms, NULL, extName, fitsStatus);
+    if (*fitsStatus != 0) {
+        fprintf(stderr, "cannot create %s[%s]\n", path+1, extName);
+        fits_report_error(stderr, *fitsStatus);
+    }
+    return fits;
+}
+
+
+/* OBT of event i of numEvents, uniform over the Science Window */
+static OBTime ibis_isgr_energySynthObt(long i, long numEvents)
+{
+    unsigned long long span = (unsigned long long)(SYNTH_DURATION*ISGRI_OBT_PER_SEC);
+
+    return SYNTH_OBT_START + (OBTime)(span/numEvents*i + span%numEvents*i/numEvents);
+}
+
+
+/* ISGR-EVTS-ALL, ISGR-EVTS-PRP, ISGR-EVTS-COR */
+static int ibis_isgr_energySynthEvents(char               *dirName,
+                                       long                numEvents,
+                                       unsigned long long *state)
+{
+    char      *allNames[] = { "DELTA_TIME", "RISE_TIME", "ISGRI_PHA", "ISGRI_Y", "ISGRI_Z",
+                              "SELECT_FLAG" },
+              *allForms[] = { "1J", "1B", "1U", "1B", "1B", "1B" },
+              *prpNames[] = { "OB_TIME", "SELECT_FLAG" },
+              *prpForms[] = { "4U", "1B" },
+              *corNames[] = { "ISGRI_PI", "ISGRI_ENERGY" },
+              *corForms[] = { "1B", "1E" };
+    int        fitsStatus = 0,
+               k;
+    long       i,
+               first,
+               numRows;
+    OBTime     obt,
+               previous = SYNTH_OBT_START;
+    double     u;
+    long      *deltaTime;
+    DAL3_Word *pha,
+              *obtWords;
+    DAL3_Byte *riseTime,
+              *isgriY,
+              *isgriZ,
+              *flag;
+    fitsfile  *allFits,
+              *prpFits,
+              *corFits;
+
+    deltaTime=(long *)malloc(SYNTH_BLOCK*sizeof(long));
+    pha=(DAL3_Word *)malloc(SYNTH_BLOCK*sizeof(DAL3_Word));
+    obtWords=(DAL3_Word *)malloc(4*SYNTH_BLOCK*sizeof(DAL3_Word));
+    riseTime=(DAL3_Byte *)malloc(SYNTH_BLOCK);
+    isgriY=(DAL3_Byte *)malloc(SYNTH_BLOCK);
+    isgriZ=(DAL3_Byte *)malloc(SYNTH_BLOCK);
+    flag=(DAL3_Byte *)calloc(SYNTH_BLOCK, 1);
+    if (deltaTime == NULL || pha == NULL || obtWords == NULL || riseTime == NULL
+        || isgriY == NULL || isgriZ == NULL || flag == NULL) {
+        fprintf(stderr, "cannot allocate the blocks of events\n");
+        return I_ISGR_ERR_MEMORY;
+    }
+
+    allFits=ibis_isgr_energySynthTable(dirName, "isgri_events.fits", DS_ISGR_RAW, 6, allNames, allForms, &fitsStatus);
+    prpFits=ibis_isgr_energySynthTable(dirName, "isgri_prp_events.fits", "ISGR-EVTS-PRP", 2, prpNames, prpForms, &fitsStatus);
+
+    for (first=0; first < numEvents && fitsStatus == 0; first+=numRows) {
+        numRows=numEvents-first < SYNTH_BLOCK ? numEvents-first : SYNTH_BLOCK;
+
+        for (i=0; i < numRows; i++) {
+            obt=ibis_isgr_energySynthObt(first+i, numEvents);
+            deltaTime[i]=(long)(obt-previous);
+            previous=obt;
+            for (k=0; k < 4; k++)
+                obtWords[4*i+k]=(DAL3_Word)(obt >> (16*(3-k)));
+
+            /* power law continuum, with one line in 10 % of the events */
+            u=ibis_isgr_energySynthUniform(state);
+            if (u < 0.1)
+                pha[i]=(DAL3_Word)(SYNTH_PHA_LINE - 20 + ibis_isgr_energySynthRand(state) % 41);
+            else
+                pha[i]=(DAL3_Word)(40.0/(0.02 + 0.98*ibis_isgr_energySynthUniform(state)));
+            if (pha[i] > 2047) pha[i]=2047;
+            riseTime[i]=(DAL3_Byte)(ibis_isgr_energySynthRand(state) % 256);
+            isgriY[i]=(DAL3_Byte)(ibis_isgr_energySynthRand(state) % 128);
+            isgriZ[i]=(DAL3_Byte)(ibis_isgr_energySynthRand(state) % 128);
+        }
+
+        fits_write_col(allFits, TLONG,   1, first+1, 1, numRows,   deltaTime, &fitsStatus);
+        fits_write_col(allFits, TBYTE,   2, first+1, 1, numRows,   riseTime,  &fitsStatus);
+        fits_write_col(allFits, TUSHORT, 3, first+1, 1, numRows,   pha,       &fitsStatus);
+        fits_write_col(allFits, TBYTE,   4, first+1, 1, numRows,   isgriY,    &fitsStatus);
+        fits_write_col(allFits, TBYTE,   5, first+1, 1, numRows,   isgriZ,    &fitsStatus);
+        fits_write_col(allFits, TBYTE,   6, first+1, 1, numRows,   flag,      &fitsStatus);
+        fits_write_col(prpFits, TUSHORT, 1, first+1, 1, 4*numRows, obtWords,  &fitsStatus);
+        fits_write_col(prpFits, TBYTE,   2, first+1, 1, numRows,   flag,      &fitsStatus);
+    }
+    fits_close_file(allFits, &fitsStatus);
+    fits_close_file(prpFits, &fitsStatus);
+
+    /* output, as attached by the pipeline: rows of zeros */
+    corFits=ibis_isgr_energySynthTable(dirName, "isgri_cor_events.fits", "ISGR-EVTS-COR", 2, corNames, corForms, &fitsStatus);
+    fits_insert_rows(corFits, 0, numEvents, &fitsStatus);
+    fits_close_file(corFits, &fitsStatus);
+
+    free(deltaTime);
+    free(pha);
+    free(obtWords);
+    free(riseTime);
+    free(isgriY);
+    free(isgriZ);
+    free(flag);
+
+    if (fitsStatus != 0) {
+        fits_report_error(stderr, fitsStatus);
+        return I_ISGR_ERR_BAD_INPUT;
+    }
+    return ISDC_OK;
+}
+
+
+/* IBIS-GNRL-GTI: three GTI covering most of the Science Window */
+static int ibis_isgr_energySynthGti(char *dirName)
+{
+    char     *names[] = { "START", "STOP" },
+             *forms[] = { "4U", "4U" };
+    double    fractions[][2] = { { 0.02, 0.40 }, { 0.45, 0.70 }, { 0.75, 0.99 } };
+    int       fitsStatus = 0,
+              i,
+              j,
+              k;
+    OBTime    obt;
+    DAL3_Word words[4];
+    fitsfile *fits;
+
+    /* OBT as OB_TIME: 4 x 16 bits, most significant first */
+    fits=ibis_isgr_energySynthTable(dirName, "ibis_gti.fits", DS_IBIS_GTI, 2, names, forms, &fitsStatus);
+    for (i=0; i < 3; i++)
+        for (j=0; j < 2; j++) {
+            obt=(OBTime)(SYNTH_OBT_START + fractions[i][j]*SYNTH_DURATION*ISGRI_OBT_PER_SEC);
+            for (k=0; k < 4; k++)
+                words[k]=(DAL3_Word)(obt >> (16*(3-k)));
+            fits_write_col(fits, TUSHORT, j+1, i+1, 1, 4, words, &fitsStatus);
+        }
+    fits_close_file(fits, &fitsStatus);
+
+    return fitsStatus == 0 ? ISDC_OK : I_ISGR_ERR_BAD_INPUT;
+}
+
+
+/* IBIS-DPE.-CNV: MDU bias and temperature every SYNTH_HK_PERIOD */
+static int ibis_isgr_energySynthHk(char               *dirName,
+                                   unsigned long long *state)
+{
+    char      names[1+2*ISGRI_N_MDU][32],
+             *namePtrs[1+2*ISGRI_N_MDU],
+             *forms[1+2*ISGRI_N_MDU];
+    int       fitsStatus = 0,
+              mdu;
+    long      i,
+              numRows = (long)(SYNTH_DURATION/SYNTH_HK_PERIOD)+2;
+    LONGLONG  obt;
+    double    value;
+    fitsfile *fits;
+
+    snprintf(names[0], 32, "%s", KEY_HK_OBT);
+    forms[0]="1K";
+    for (mdu=0; mdu < ISGRI_N_MDU; mdu++) {
+        snprintf(names[1+mdu], 32, "%s%d", KEY_MCE_BIAS, mdu);
+        snprintf(names[1+ISGRI_N_MDU+mdu], 32, "%s%d", KEY_MCE_TEMP, mdu);
+        forms[1+mdu]=forms[1+ISGRI_N_MDU+mdu]="1D";
+    }
+    for (i=0; i < 1+2*ISGRI_N_MDU; i++) namePtrs[i]=names[i];
+
+    fits=ibis_isgr_energySynthTable(dirName, "ibis_hk_cnv.fits", DS_ISGR_HK, 1+2*ISGRI_N_MDU,
+                                    namePtrs, forms, &fitsStatus);
+    for (i=0; i < numRows && fitsStatus == 0; i++) {
+        obt=(LONGLONG)(SYNTH_OBT_START + (i-1)*SYNTH_HK_PERIOD*ISGRI_OBT_PER_SEC);
+        fits_write_col(fits, TLONGLONG, 1, i+1, 1, 1, &obt, &fitsStatus);
+        for (mdu=0; mdu < ISGRI_N_MDU; mdu++) {
+            value=KEY_DEF_BIAS + 2.0*(ibis_isgr_energySynthUniform(state)-0.5);
+            fits_write_col(fits, TDOUBLE, 2+mdu, i+1, 1, 1, &value, &fitsStatus);
+            value=KEY_DEF_TEMP + 0.5*mdu/ISGRI_N_MDU + 0.2*(ibis_isgr_energySynthUniform(state)-0.5);
+            fits_write_col(fits, TDOUBLE, 2+ISGRI_N_MDU+mdu, i+1, 1, 1, &value, &fitsStatus);
+        }
+    }
+    fits_close_file(fits, &fitsStatus);
+
+    return fitsStatus == 0 ? ISDC_OK : I_ISGR_ERR_BAD_INPUT;
+}
+
+
+/* swg.fits: the group of the Science Window, with the members above */
+static int ibis_isgr_energySynthGroup(char *dirName)
+{
+    char     *members[] = { "isgri_events.fits[" DS_ISGR_RAW "]",
+                            "isgri_prp_events.fits[ISGR-EVTS-PRP]",
+                            "ibis_gti.fits[" DS_IBIS_GTI "]",
+                            "ibis_hk_cnv.fits[" DS_ISGR_HK "]",
+                            "isgri_cor_events.fits[ISGR-EVTS-COR]" },
+              path[DAL_FILE_NAME_STRING],
+              value[FLEN_VALUE];
+    int       fitsStatus = 0,
+              i,
+              revol = SYNTH_REVOL;
+    double    tStart = SYNTH_IJD_START,
+              tStop = SYNTH_IJD_START + SYNTH_DURATION/86400.0;
+    fitsfile *groupFits = NULL,
+             *memberFits;
+
+    snprintf(path, DAL_FILE_NAME_STRING, "!%s/swg.fits", dirName);
+    fits_create_file(&groupFits, path, &fitsStatus);
+    fits_create_img(groupFits, BYTE_IMG, 0, NULL, &fitsStatus);
+    fits_create_group(groupFits, "GROUPING", GT_ID_ALL_URI, &fitsStatus);
+
+    fits_write_key(groupFits, TINT,    "REVOL",    &revol, "revolution", &fitsStatus);
+    snprintf(value, FLEN_VALUE, "%04d00100010", SYNTH_REVOL);
+    fits_write_key(groupFits, TSTRING, "SWID",     value, "synthetic Science Window", &fitsStatus);
+    fits_write_key(groupFits, TSTRING, "SW_TYPE",  "POINTING", NULL, &fitsStatus);
+    fits_write_key(groupFits, TSTRING, "SWBOUND",  "SYNTHETIC", NULL, &fitsStatus);
+    snprintf(value, FLEN_VALUE, "%llu", (unsigned long long)SYNTH_OBT_START);
+    fits_write_key(groupFits, TSTRING, "OBTSTART", value, "OBT of the start", &fitsStatus);
+    snprintf(value, FLEN_VALUE, "%llu",
+             (unsigned long long)(SYNTH_OBT_START + (OBTime)(SYNTH_DURATION*ISGRI_OBT_PER_SEC)));
+    fits_write_key(groupFits, TSTRING, "OBTEND",   value, "OBT of the end", &fitsStatus);
+    fits_write_key(groupFits, TDOUBLE, "TSTART",   &tStart, "IJD", &fitsStatus);
+    fits_write_key(groupFits, TDOUBLE, "TSTOP",    &tStop,  "IJD", &fitsStatus);
+
+    for (i=0; i < 5 && fitsStatus == 0; i++) {
+        snprintf(path, DAL_FILE_NAME_STRING, "%s/%s", dirName, members[i]);
+        memberFits=NULL;
+        fits_open_file(&memberFits, path, READWRITE, &fitsStatus);
+        fits_add_group_member(groupFits, memberFits, 0, &fitsStatus);
+        if (memberFits != NULL) fits_close_file(memberFits, &fitsStatus);
+    }
+    fits_close_file(groupFits, &fitsStatus);
+
+    if (fitsStatus != 0) {
+        fits_report_error(stderr, fitsStatus);
+        return I_ISGR_ERR_BAD_INPUT;
+    }
+    return ISDC_OK;
+}
+
+
+/* calibration tables: data structure, file in cal/, rows written when
+   the template has none */
+static const struct {
+    const char *extName;
+    const char *fileName;
+    long        numRows;
+} ibis_isgr_energySynthCalTables[] = {
+    { DS_ISGR_LUT1, "isgr_offs_mod.fits", ISGRI_N_PIX },
+    { DS_ISGR_MCEC, "isgr_mcec_mod.fits", ISGRI_N_MDU },
+    { DS_ISGR_LUT2, "isgr_3dl2_mod.fits", 1 },
+    { DS_ISGR_L2RE, "isgr_l2re_mod.fits", 1 }
+};
+#define SYNTH_CAL_TABLES \
+    ((int)(sizeof(ibis_isgr_energySynthCalTables)/sizeof(ibis_isgr_energySynthCalTables[0])))
+
+
+/* fills numValues values: integers 1, reals around 1 */
+static void ibis_isgr_energySynthCalValues(double             *values,
+                                           long                numValues,
+                                           int                 real,
+                                           unsigned long long *state)
+{
+    long i;
+
+    for (i=0; i < numValues; i++)
+        values[i]= real ? 0.95 + (ibis_isgr_energySynthRand(state) % 1000)*1.0e-4 : 1.0;
+}
+
+
+/* one calibration file, from $ISDC_ENV/templates/<extName>.tpl: every
+   numerical column (or the image) is filled, strings are left empty */
+static int ibis_isgr_energySynthCalTable(char               *calDir,
+                                         int                 table,
+                                         unsigned long long *state)
+{
+    char      path[DAL_FILE_NAME_STRING],
+              templateName[DAL_FILE_NAME_STRING],
+             *isdcEnv;
+    int       fitsStatus = 0,
+              hduType = 0,
+              numCols = 0,
+              numDims = 0,
+              col,
+              typeCode,
+              k;
+    long      numRows = 0,
+              repeat = 0,
+              width,
+              numValues,
+              dims[MAX_IMG_DIM];
+    double    vStart = SYNTH_IJD_START - SYNTH_VALIDITY,
+              vStop  = SYNTH_IJD_START + SYNTH_VALIDITY,
+             *values = NULL;
+    fitsfile *fits = NULL;
+
+    isdcEnv=getenv("ISDC_ENV");
+    snprintf(templateName, sizeof(templateName), "%s/templates/%s.tpl",
+             isdcEnv != NULL ? isdcEnv : ".", ibis_isgr_energySynthCalTables[table].extName);
+    snprintf(path, sizeof(path), "!%s/%s", calDir, ibis_isgr_energySynthCalTables[table].fileName);
+
+    fits_create_template(&fits, path, templateName, &fitsStatus);
+    fits_movnam_hdu(fits, ANY_HDU, (char *)ibis_isgr_energySynthCalTables[table].extName, 0, &fitsStatus);
+    fits_get_hdu_type(fits, &hduType, &fitsStatus);
+    fits_update_key(fits, TDOUBLE, "VSTART", &vStart, "IJD, start of validity", &fitsStatus);
+    fits_update_key(fits, TDOUBLE, "VSTOP",  &vStop,  "IJD, end of validity", &fitsStatus);
+
+    if (fitsStatus == 0 && hduType == IMAGE_HDU) {
+        fits_get_img_dim(fits, &numDims, &fitsStatus);
+        fits_get_img_size(fits, numDims, dims, &fitsStatus);
+        for (numValues=1, k=0; k < numDims; k++) numValues*=dims[k];
+        values=(double *)malloc((numValues > 0 ? numValues : 1)*sizeof(double));
+        if (values == NULL) fitsStatus=MEMORY_ALLOCATION;
+        if (fitsStatus == 0 && numDims > 0) {
+            ibis_isgr_energySynthCalValues(values, numValues, 1, state);
+            fits_write_img(fits, TDOUBLE, 1, numValues, values, &fitsStatus);
+        }
+    } else if (fitsStatus == 0) {
+        fits_get_num_rows(fits, &numRows, &fitsStatus);
+        if (fitsStatus == 0 && numRows == 0) {
+            numRows=ibis_isgr_energySynthCalTables[table].numRows;
+            fits_insert_rows(fits, 0, numRows, &fitsStatus);
+        }
+        fits_get_num_cols(fits, &numCols, &fitsStatus);
+        for (col=1; col <= numCols && fitsStatus == 0; col++) {
+            fits_get_coltype(fits, col, &typeCode, &repeat, &width, &fitsStatus);
+            if (fitsStatus != 0 || typeCode < 0 || typeCode == TSTRING || typeCode == TLOGICAL)
+                continue;
+            numValues=numRows*repeat;
+            free(values);
+            values=(double *)malloc((numValues > 0 ? numValues : 1)*sizeof(double));
+            if (values == NULL) {
+                fitsStatus=MEMORY_ALLOCATION;
+                break;
+            }
+            ibis_isgr_energySynthCalValues(values, numValues,
+                                           typeCode == TFLOAT || typeCode == TDOUBLE, state);
+            fits_write_col(fits, TDOUBLE, col, 1, 1, numValues, values, &fitsStatus);
+        }
+    }
+    fits_write_chksum(fits, &fitsStatus);
+    if (fits != NULL) fits_close_file(fits, &fitsStatus);
+    free(values);
+
+    if (fitsStatus != 0) {
+        fprintf(stderr, "cannot write %s from %s\n", path+1, templateName);
+        fits_report_error(stderr, fitsStatus);
+        return I_ISGR_ERR_BAD_INPUT;
+    }
+    return ISDC_OK;
+}
+
+
+/* cal/: LUT1, MCEC, LUT2 and L2RE valid for the Science Window */
+static int ibis_isgr_energySynthCalibration(char               *dirName,
+                                            unsigned long long *state)
+{
+    char calDir[DAL_FILE_NAME_STRING];
+    int  table,
+         status = ISDC_OK;
+
+    snprintf(calDir, sizeof(calDir), "%s/cal", dirName);
+    mkdir(dirName, 0755);
+    mkdir(calDir, 0755);
+
+    for (table=0; table < SYNTH_CAL_TABLES && status == ISDC_OK; table++)
+        status=ibis_isgr_energySynthCalTable(calDir, table, state);
+
+    return status;
+}
+
+
+/* data checksum and rows of a table: "<DATASUM> <rows>" */
+static int ibis_isgr_energySynthSum(char *DOL)
+{
+    int           fitsStatus = 0;
+    long          numRows = 0;
+    unsigned long dataSum = 0,
+                  hduSum = 0;
+    fitsfile     *fits = NULL;
+
+    fits_open_file(&fits, DOL, READONLY, &fitsStatus);
+    fits_get_num_rows(fits, &numRows, &fitsStatus);
+    fits_get_chksum(fits, &dataSum, &hduSum, &fitsStatus);
+    if (fits != NULL) fits_close_file(fits, &fitsStatus);
+
+    if (fitsStatus != 0) {
+        fprintf(stderr, "cannot read %s\n", DOL);
+        fits_report_error(stderr, fitsStatus);
+        return I_ISGR_ERR_BAD_INPUT;
+    }
+    printf("%lu %ld\n", dataSum, numRows);
+    return ISDC_OK;
+}
+
+
+static double ibis_isgr_energySynthNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1.0e-9*ts.tv_nsec;
+}
+
+
+/* plain ISGRI_PI and ISGRI_ENERGY table, as DAL writes ISGR-EVTS-COR */
+static int ibis_isgr_energySynthPlainWrite(char      *fileName,
+                                           long       numEvents,
+                                           DAL3_Byte *isgriPi,
+                                           float     *isgriEnergy)
+{
+    int       fitsStatus = 0;
+    char     *names[2] = { "ISGRI_PI", "ISGRI_ENERGY" },
+             *forms[2] = { "1B", "1E" },
+             *units[2] = { "", "keV" },
+              createName[DAL_FILE_NAME_STRING+1];
+    fitsfile *fits = NULL;
+
+    snprintf(createName, sizeof(createName), "!%s", fileName);
+    fits_create_file(&fits, createName, &fitsStatus);
+    fits_create_img(fits, BYTE_IMG, 0, NULL, &fitsStatus);
+    fits_create_tbl(fits, BINARY_TBL, numEvents, 2, names, forms, units, "ISGR-EVTS-COR", &fitsStatus);
+    fits_write_col(fits, TBYTE,  1, 1, 1, numEvents, isgriPi,     &fitsStatus);
+    fits_write_col(fits, TFLOAT, 2, 1, 1, numEvents, isgriEnergy, &fitsStatus);
+    fits_write_chksum(fits, &fitsStatus);
+    if (fits != NULL) fits_close_file(fits, &fitsStatus);
+
+    if (fitsStatus != 0) {
+        fprintf(stderr, "cannot write %s\n", fileName);
+        fits_report_error(stderr, fitsStatus);
+        return I_ISGR_ERR_BAD_INPUT;
+    }
+    return ISDC_OK;
+}
+
+
+/* ISGRI_PI and ISGRI_ENERGY of the first extension, plain or compressed,
+   as a reader of the output gets them */
+static int ibis_isgr_energySynthRead(char      *fileName,
+                                     long       numEvents,
+                                     DAL3_Byte *isgriPi,
+                                     float     *isgriEnergy)
+{
+    int       fitsStatus = 0,
+              keyStatus = 0,
+              compressed = 0,
+              piCol = 0,
+              energyCol = 0;
+    long      numRows = 0;
+    fitsfile *fits = NULL,
+             *plain = NULL,
+             *table;
+
+    fits_open_file(&fits, fileName, READONLY, &fitsStatus);
+    fits_movabs_hdu(fits, 2, NULL, &fitsStatus);
+    fits_read_key(fits, TLOGICAL, "ZTABLE", &compressed, NULL, &keyStatus);
+    table=fits;
+    if (fitsStatus == 0 && keyStatus == 0 && compressed) {
+        fits_create_file(&plain, "mem://", &fitsStatus);
+        fits_create_img(plain, BYTE_IMG, 0, NULL, &fitsStatus);
+        fits_uncompress_table(fits, plain, &fitsStatus);
+        table=plain;
+    }
+    fits_get_num_rows(table, &numRows, &fitsStatus);
+    fits_get_colnum(table, CASEINSEN, "ISGRI_PI", &piCol, &fitsStatus);
+    fits_get_colnum(table, CASEINSEN, "ISGRI_ENERGY", &energyCol, &fitsStatus);
+    if (fitsStatus == 0 && numRows != numEvents) fitsStatus=BAD_ROW_NUM;
+    fits_read_col(table, TBYTE,  piCol,     1, 1, numEvents, NULL, isgriPi,     NULL, &fitsStatus);
+    fits_read_col(table, TFLOAT, energyCol, 1, 1, numEvents, NULL, isgriEnergy, NULL, &fitsStatus);
+    if (plain != NULL) fits_close_file(plain, &fitsStatus);
+    if (fits != NULL) fits_close_file(fits, &fitsStatus);
+
+    if (fitsStatus != 0) {
+        fprintf(stderr, "cannot read %s\n", fileName);
+        fits_report_error(stderr, fitsStatus);
+        return I_ISGR_ERR_BAD_INPUT;
+    }
+    return ISDC_OK;
+}
+
+
+/* size, write and read throughput of ISGR-EVTS-COR plain, tile-compressed,
+   tile-compressed with ISGRI_ENERGY rounded; the compressed ones are
+   written from the plain file as the program does, so that their write
+   time is the one of the compression; the files are kept in dirName */
+static int ibis_isgr_energySynthCompress(char  *DOL,
+                                         char  *dirName,
+                                         double tolerance)
+{
+    int        fitsStatus = 0,
+               status = ISDC_OK,
+               piCol = 0,
+               energyCol = 0,
+               mode;
+    long       numEvents = 0,
+               i,
+               changedPi;
+    double     t0,
+               writeTime,
+               readTime,
+               megaBytes,
+               deviation,
+               maxDeviation;
+    char       fileName[DAL_FILE_NAME_STRING],
+               plainName[DAL_FILE_NAME_STRING];
+    char      *modeNames[3] = { "plain", "tiled", "tiled rounded" },
+              *modeFiles[3] = { "cor_plain.fits", "cor_tiled.fits", "cor_rounded.fits" };
+    DAL3_Byte *isgriPi,
+              *readPi;
+    float     *isgriEnergy,
+              *readEnergy;
+    fitsfile  *fits = NULL;
+    struct stat fileStat;
+
+    fits_open_file(&fits, DOL, READONLY, &fitsStatus);
+    fits_get_num_rows(fits, &numEvents, &fitsStatus);
+    fits_get_colnum(fits, CASEINSEN, "ISGRI_PI", &piCol, &fitsStatus);
+    fits_get_colnum(fits, CASEINSEN, "ISGRI_ENERGY", &energyCol, &fitsStatus);
+    if (fitsStatus == 0 && numEvents < 1) fitsStatus=BAD_ROW_NUM;
+
+    isgriPi=(DAL3_Byte *)malloc((numEvents > 0 ? numEvents : 1)*sizeof(DAL3_Byte));
+    readPi=(DAL3_Byte *)malloc((numEvents > 0 ? numEvents : 1)*sizeof(DAL3_Byte));
+    isgriEnergy=(float *)malloc((numEvents > 0 ? numEvents : 1)*sizeof(float));
+    readEnergy=(float *)malloc((numEvents > 0 ? numEvents : 1)*sizeof(float));
+    if (isgriPi == NULL || readPi == NULL || isgriEnergy == NULL || readEnergy == NULL) {
+        fprintf(stderr, "cannot allocate the columns of %ld events\n", numEvents);
+        return I_ISGR_ERR_MEMORY;
+    }
+    fits_read_col(fits, TBYTE,  piCol,     1, 1, numEvents, NULL, isgriPi,     NULL, &fitsStatus);
+    fits_read_col(fits, TFLOAT, energyCol, 1, 1, numEvents, NULL, isgriEnergy, NULL, &fitsStatus);
+    if (fits != NULL) fits_close_file(fits, &fitsStatus);
+    if (fitsStatus != 0) {
+        fprintf(stderr, "cannot read %s\n", DOL);
+        fits_report_error(stderr, fitsStatus);
+        return I_ISGR_ERR_BAD_INPUT;
+    }
+
+    mkdir(dirName, 0755);
+    megaBytes=numEvents*(double)ISGRI_EVENT_OUT_BYTES/1048576.;
+    printf("events          : %ld, %.1f MB of columns, tiles of %ld rows, tolerance %g keV (step %g keV)\n",
+           numEvents, megaBytes, ISGRI_COMPRESS_TILE_ROWS, tolerance, ibis_isgr_energyQuantumStep(tolerance));
+    printf("%-16s %10s %8s %12s %12s %12s %8s\n", "format", "bytes", "ratio",
+           "write MB/s", "read MB/s", "max dE keV", "PI diff");
+
+    snprintf(plainName, sizeof(plainName), "%s/%s", dirName, modeFiles[0]);
+    for (mode=0; mode < 3 && status == ISDC_OK; mode++) {
+        snprintf(fileName, sizeof(fileName), "%s/%s", dirName, modeFiles[mode]);
+
+        t0=ibis_isgr_energySynthNow();
+        if (mode == 0)
+            status=ibis_isgr_energySynthPlainWrite(fileName, numEvents, isgriPi, isgriEnergy);
+        else
+            status=ibis_isgr_energyCompressFile(plainName, "ISGR-EVTS-COR", fileName,
+                                                mode == 2 ? tolerance : 0., 0, status);
+        writeTime=ibis_isgr_energySynthNow()-t0;
+
+        t0=ibis_isgr_energySynthNow();
+        if (status == ISDC_OK) status=ibis_isgr_energySynthRead(fileName, numEvents, readPi, readEnergy);
+        readTime=ibis_isgr_energySynthNow()-t0;
+        if (status != ISDC_OK || stat(fileName, &fileStat) != 0) break;
+
+        maxDeviation=0.;
+        changedPi=0;
+        for (i=0; i < numEvents; i++) {
+            deviation=fabs((double)readEnergy[i]-isgriEnergy[i]);
+            if (deviation > maxDeviation) maxDeviation=deviation;
+            if (readPi[i] != isgriPi[i]) changedPi++;
+        }
+        printf("%-16s %10ld %8.2f %12.1f %12.1f %12.3g %8ld\n", modeNames[mode], (long)fileStat.st_size,
+               megaBytes*1048576./fileStat.st_size, megaBytes/writeTime, megaBytes/readTime,
+               maxDeviation, changedPi);
+    }
+
+    free(isgriPi);
+    free(readPi);
+    free(isgriEnergy);
+    free(readEnergy);
+    return status;
+}
+
+
+int main (int argc, char *argv[])
+{
+    int    status = ISDC_OK;
+    long   numEvents;
+    unsigned long long state = 0x2545F4914F6CDD1Dull;
+
+    if (argc == 3 && strcmp(argv[1], "-sum") == 0)
+        return ibis_isgr_energySynthSum(argv[2]) == ISDC_OK ? 0 : 1;
+    if (argc == 3 && strcmp(argv[1], "-cal") == 0)
+        return ibis_isgr_energySynthCalibration(argv[2], &state) == ISDC_OK ? 0 : 1;
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "-compress") == 0)
+        return ibis_isgr_energySynthCompress(argv[2], argv[3],
+                                             argc > 4 ? atof(argv[4]) : SYNTH_TOLERANCE) == ISDC_OK ? 0 : 1;
+
+    if (argc < 3 || argc > 4 || (numEvents=(long)strtod(argv[2], NULL)) <= 0) {
+        fprintf(stderr, "usage: %s <directory> <numEvents> [seed]\n", argv[0]);
+        fprintf(stderr, "       %s -cal <directory>\n", argv[0]);
+        fprintf(stderr, "       %s -sum <DOL of a table>\n", argv[0]);
+        fprintf(stderr, "       %s -compress <DOL of ISGR-EVTS-COR> <directory> [tolerance]\n", argv[0]);
+        return 1;
+    }
+    if (argc > 3) state^=strtoull(argv[3], NULL, 10)*0x9E3779B97F4A7C15ull;
+    if (state == 0) state=1;
+
+    mkdir(argv[1], 0755);
+    status=ibis_isgr_energySynthHk(argv[1], &state);
+    if (status == ISDC_OK) status=ibis_isgr_energySynthGti(argv[1]);
+    if (status == ISDC_OK) status=ibis_isgr_energySynthEvents(argv[1], numEvents, &state);
+    if (status == ISDC_OK) status=ibis_isgr_energySynthGroup(argv[1]);
+    if (status == ISDC_OK) status=ibis_isgr_energySynthCalibration(argv[1], &state);
+
+    if (status != ISDC_OK) {
+        fprintf(stderr, "synthetic Science Window %s not written (status %d)\n", argv[1], status);
+        return 1;
+    }
+    printf("%s: %ld events, %.0f s, revolution %d\n", argv[1], numEvents, SYNTH_DURATION, SYNTH_REVOL);
+    return 0;
+}
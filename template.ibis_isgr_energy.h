@@ -62,6 +62,7 @@
 #ifndef IBIS_ENERGY_H_INCLUDED
 #define IBIS_ENERGY_H_INCLUDED
 
+#include <pthread.h>
 #include "isdc.h"
 #include "dal3ibis.h"
 #include "dal3ibis_calib.h"
@@ -79,8 +80,18 @@
 #define I_ISGR_ERR_ISGR_OUT_COR   -122054
 #define I_ISGR_ERR_IBIS_IREM_BAD  -122055
 #define I_ISGR_ERR_ISGR_PHGO2_BAD -122056
+#define I_ISGR_ERR_BATCH_LIST     -122057
+#define I_ISGR_ERR_CAL_SNAPSHOT   -122058
+#define I_ISGR_ERR_PARALLEL       -122059
+#define I_ISGR_ERR_DAEMON         -122060
+#define I_ISGR_ERR_DRIVER         -122061
+#define I_ISGR_ERR_SPECTRA        -122062
+#define I_ISGR_ERR_COMPRESS       -122063
+#define I_ISGR_ERR_CAL_INDEX      -122064
 
 #define ISGRI_N_PIX     16384l
+/* pixel number, ISGRI_N_PIX for coordinates out of the detector */
+#define ISGRI_PIXEL(y,z) (((y) < 128 && (z) < 128) ? 128l*(y)+(z) : ISGRI_N_PIX)
 #define ISGRI_GO_N_COL      5
 #define ISGRI_DIM_LUT2_3D   3
 #define ISGRI_RT_N_ENER_SCALED 1024
@@ -100,6 +111,7 @@
 */
 
 #define DS_ISGR_RAW       "ISGR-EVTS-ALL"
+#define DS_ISGR_PRP       "ISGR-EVTS-PRP"
 #define DS_ISGR_GO        "ISGR-OFFS-MOD"
 #define DS_ISGR_3DL2_MOD  "ISGR-3DL2-MOD"
 #define DS_PHG2           "ISGR-GAIN-MOD"
@@ -113,6 +125,11 @@
 #define DS_ISGR_RT        "ISGR-RISE-MOD"
 */
 #define KEY_COL_OUT  "ISGRI_PI"
+#define KEY_EVT_OBT  "OB_TIME"      /* OBT of the events, 4 x 16 bits */
+#define DS_IBIS_GTI  "IBIS-GNRL-GTI"
+#define ISGRI_FILL_PI       0       /* output of the events outside the GTI */
+#define ISGRI_FILL_ENERGY   0.0f    /* (gtiRows) */
+#define KEY_FINGERPRINT "ISGFPRNT"  /* inputs of a complete ISGR-EVTS-COR */
 
 #define DS_ISGR_HK   "IBIS-DPE.-CNV"
 #define KEY_MCE_BIAS "I0E_MCDTE_MBIAS"
@@ -125,6 +142,70 @@
 
 #define SEC_DELTA_MIN       25      /* minimal time range to search HK1 */
 
+#define CAL_VALIDITY_UNBOUNDED  1.0e6 /* IJD, validity of a table given directly */
+#define CAL_SNAP_VERSION    2       /* format of the calibration snapshot */
+
+#define ISGRI_RECON_BLOCK   65536l  /* events with their own random sequence */
+
+/* per-event columns of IBIS_events_struct, COLUMN(type, member, input):
+   input 1 for the columns read from ISGR-EVTS-ALL, 0 for the results.
+   Every array of the structure must be listed: views on a block of
+   events (ibis_isgr_energyEventsView) and releases go
+   through this list, and ibis_isgr_energy.c checks the layout */
+#define ISGRI_EVENT_COLUMNS(COLUMN) \
+    COLUMN(DAL3_Word, isgri_pha,    1) \
+    COLUMN(DAL3_Byte, riseTime,     1) \
+    COLUMN(DAL3_Byte, isgri_y,      1) \
+    COLUMN(DAL3_Byte, isgri_z,      1) \
+    COLUMN(DAL3_Byte, isgri_pi,     0) \
+    COLUMN(float,     isgri_energy, 0)
+#define ISGRI_PIPE_ROWS   1048576l  /* default block of the pipelined mode */
+#define ISGRI_PIPE_BUFFERS  3       /* blocks being read, corrected, written */
+
+#define ISGRI_ARENA_CHUNK  8388608l  /* bytes of an arena chunk */
+#define ISGRI_ARENA_ALIGN  64         /* alignment of arena buffers (cache line) */
+
+/* job queue of the revolution driver (nProcs) */
+#define ISGRI_JOB_PENDING   'P'
+#define ISGRI_JOB_RUNNING   'R'
+#define ISGRI_JOB_DONE      'D'
+#define ISGRI_JOB_FAILED    'F'
+#define ISGRI_JOB_ATTEMPTS  3         /* runs of a job with retryable errors */
+
+/* spectra accumulated during the reconstruction (spectraFile) */
+#define DS_ISGR_PIX_SPE      "ISGR-PIXL-SPE"  /* ISGRI_PI counts per pixel */
+#define DS_ISGR_MDU_SPE      "ISGR-MDU.-SPE"  /* energy x rise time counts per MDU */
+#define ISGRI_SPEC_N_PI      256      /* ISGRI_PI channels */
+#define ISGRI_SPEC_N_RT      256      /* rise time channels */
+#define ISGRI_SPEC_N_ENERGY  512      /* energy bins of the MDU spectra */
+#define ISGRI_SPEC_ENERGY_BIN  2.0f   /* keV */
+/* MDU of a pixel, as assumed by the spectra: 8 blocks of 32 ISGRI_Y x 64
+   ISGRI_Z, numbered along ISGRI_Y, then ISGRI_Z. Neither taken from
+   DAL3IBIS (which does not export its mapping) nor checked against the
+   MDU numbering of the HK (I0E_MTEMP2_MMDUn): the spectra file records it
+   (keyword MDUMAP), so that its users can check it or regroup the pixels */
+#define ISGRI_MDU(y,z)       ((y)/32 + 4*((z)/64))
+#define ISGRI_MDU_MAP        "ISGRI_Y/32+4*(ISGRI_Z/64)"
+
+/* calibration files read ahead while the events are read (calPrefetch) */
+#define ISGRI_PREFETCH_FILES   5      /* LUT1, MCEC, LUT2, L2RE, converted HK */
+#define ISGRI_PREFETCH_CHUNK   1048576l
+
+/* tile-compressed copy of ISGR-EVTS-COR (outCompressed) */
+#define ISGRI_COMPRESS_TILE_ROWS 1048576l /* rows per tile, about 5 MB uncompressed */
+#define ISGRI_COMPRESS_SUFFIX    ".fz"    /* appended to the file of the output */
+
+#define ISGRI_STATS_MAX_STAGES 16     /* instrumented stages of one run */
+/* bytes of the output columns per event */
+#define ISGRI_EVENT_OUT_BYTES (sizeof(DAL3_Byte)+sizeof(float))
+/* rows written at once: half of the FITS I/O buffers (NIOBUF 40 x 2880),
+   leaving room for unaligned rows and the other open HDUs */
+#define ISGRI_OUT_CHUNK_BYTES 57600l
+
+#define ISGRI_N_MDU          8
+#define KEY_HK_OBT           "OBT"          /* time column of the converted HK */
+#define ISGRI_OBT_PER_SEC    1048576.0      /* OBT ticks per second */
+
 /* constant parameters for the energy correction */
 #define OFF_SCALE0          -1.997
 #define G_SCALE0             1.0184
@@ -140,22 +221,537 @@ typedef struct {
     char lut1_DOL[DAL_FILE_NAME_STRING];
     char mcec_DOL[DAL_FILE_NAME_STRING];
     char l2re_DOL[DAL_FILE_NAME_STRING];
+    /* copies of the same tables in the calibration snapshot, "" for none */
+    char lut2_snap[DAL_FILE_NAME_STRING];
+    char lut1_snap[DAL_FILE_NAME_STRING];
+    char mcec_snap[DAL_FILE_NAME_STRING];
+    char l2re_snap[DAL_FILE_NAME_STRING];
 } ISGRI_energy_caldb_dols_struct;
 
+/* buffers owned by the component for one Science Window */
+typedef struct ISGRI_energy_arena_chunk {
+    struct ISGRI_energy_arena_chunk *next;
+    size_t size,
+           used;
+} ISGRI_energy_arena_chunk_struct;
+
+typedef struct {
+    ISGRI_energy_arena_chunk_struct *chunks;  /* current chunk first */
+    int    numChunks;
+    long   numAllocs;
+    size_t used,
+           reserved,                          /* bytes of the chunks */
+           highWater;                         /* largest reserved */
+} ISGRI_energy_arena_struct;
+
+typedef struct {
+    ISGRI_energy_arena_chunk_struct *chunk;
+    size_t used;
+} ISGRI_energy_arena_mark_struct;
+
 typedef struct  {
     int makeUnique,
         clobber,
         gti,
         erase, chatter;
+    int  nThreads;                        /* worker processes, 0: none */
+    long streamRows;                      /* 0: whole event list in memory */
+    int  pipeline;                        /* overlap I/O and correction */
+    pthread_mutex_t *dalLock;             /* lock of the DAL calls of other threads
+                                             (pipeline), NULL: no other thread */
+    int  seedSet;
+    unsigned long seed;
+    char grpList[DAL_FILE_NAME_STRING];   /* batch mode if not empty */
+    char calSnapshot[DAL_FILE_NAME_STRING];
+    char statsFile[DAL_FILE_NAME_STRING]; /* JSON sidecar if not empty */
+    int  incremental;                     /* skip up-to-date outputs */
+    char fingerprint[DAL_BIG_STRING];     /* of the current Science Window */
+    ISGRI_energy_arena_struct *arena;     /* buffers of the current Science Window */
+    char hkCnvDOL[DAL_FILE_NAME_STRING];  /* converted HK replacing the group's */
+    struct ISGRI_energy_stats *stats;     /* if not NULL, gets those of the last run */
+    int  gtiRows;                         /* read and correct only the rows in the GTI */
+    struct ISGRI_energy_rows *rows;       /* rows of the current Science Window, NULL: all */
+    int  nProcs;                          /* batch mode by worker processes if > 0 */
+    char jobQueue[DAL_FILE_NAME_STRING];  /* their job queue, "" for <grpList>.queue */
+    char spectraFile[DAL_FILE_NAME_STRING]; /* spectra of the events, "" for none */
+    struct ISGRI_energy_spectra *spectra; /* of the current Science Window, NULL: none */
+    int  calPrefetch;                     /* read the calibration files ahead */
+    int  outCompressed;                   /* also a tile-compressed copy (.fz) */
+    double energyTolerance;               /* keV, rounding of its ISGRI_ENERGY, 0: exact */
 } ibis_isgr_energy_settings_struct;
 
+/* one Science Window of the job queue (one line of the queue file) */
+typedef struct {
+    char   state;                         /* ISGRI_JOB_* */
+    int    attempts,
+           status;                        /* of the last attempt */
+    long   pid,                           /* worker of the last attempt */
+           numEvents;                     /* rows of ISGR-EVTS-ALL */
+    double wall;                          /* s, of the last attempt */
+    char   DOL[DAL_FILE_NAME_STRING];
+} ISGRI_energy_job_struct;
+
+/* ranges of rows of ISGR-EVTS-ALL, sorted and disjoint */
+typedef struct ISGRI_energy_rows {
+    long  numRanges,
+          numRows;                        /* rows in the ranges */
+    long *first,                          /* 0-based */
+         *last;                           /* excluded */
+} ISGRI_energy_rows_struct;
+
+/* resources used by one stage of ibis_isgr_energyWork */
+typedef struct {
+    char   name[32];
+    double wall,                    /* s */
+           cpu;                     /* s, with the reconstruction workers */
+    long   rows,
+           peakRss;                 /* kB, at the end of the stage */
+    double bytesRead,               /* by the process (rchar, wchar */
+           bytesWritten;            /* of /proc/self/io), -1: unknown */
+} ISGRI_energy_stage_stats_struct;
+
+typedef struct ISGRI_energy_stats {
+    int    numStages;
+    double wallStart,               /* start of the first stage */
+           wallEnd,                 /* time of the report */
+           wall0,                   /* start of the current stage */
+           cpu0,
+           read0,
+           written0;
+    int    open;                    /* a stage is being measured */
+    char   current[32];             /* its name */
+    char   swid[DAL_BIG_STRING];
+    ISGRI_energy_stage_stats_struct stage[ISGRI_STATS_MAX_STAGES];
+} ISGRI_energy_stats_struct;
+
+/* spectra of the corrected events of one Science Window (spectraFile) */
+typedef struct ISGRI_energy_spectra {
+    long         numEvents,
+                 numOutside,                 /* coordinates out of the detector */
+                 numOverflow;                /* energy out of the MDU spectra */
+    unsigned int pixelPi[ISGRI_N_PIX*ISGRI_SPEC_N_PI];       /* [pixel][PI] */
+    unsigned int mduEnergy[ISGRI_N_MDU*ISGRI_SPEC_N_RT*ISGRI_SPEC_N_ENERGY]; /* [MDU][RT][energy] */
+} ISGRI_energy_spectra_struct;
+
+/* a block of rows of the event list (streaming mode) */
+typedef struct {
+    long       firstRow,                  /* 0-based row in ISGR-EVTS-ALL */
+               numRows,
+               maxRows,
+               numSelected;               /* rows in the selection (all without) */
+    DAL3_Word *isgri_pha;
+    DAL3_Byte *riseTime,
+              *isgri_y,
+              *isgri_z,
+              *isgri_pi;
+    float     *isgri_energy;
+    ISGRI_energy_arena_struct *arena;     /* owner of the columns, NULL: malloc */
+} ISGRI_energy_block_struct;
+
+/* calibration table selected for a DOL, kept across Science Windows */
+typedef struct {
+    char   DOL[DAL_FILE_NAME_STRING];     /* table or index given */
+    char   member[DAL_FILE_NAME_STRING];  /* table loaded for it */
+    double vStart;                  /* validity of the member, IJD */
+    double vStop;
+    int    resolved;
+    char   loaded[DAL_FILE_NAME_STRING];  /* table in the calibration, "" if none */
+} ISGRI_energy_cal_cache_entry_struct;
+
+typedef struct {
+    ISGRI_energy_calibration_struct     calibration;  /* of the current Science Window */
+    ISGRI_energy_cal_cache_entry_struct lut1,
+                                        mcec,
+                                        lut2,
+                                        l2re;
+    int  initialized,
+         select;                    /* batch: members selected and kept here */
+    long nLoads,                    /* MCEC, LUT2, L2RE tables loaded */
+         nReuses;                   /* MCEC, LUT2, L2RE tables kept loaded */
+} ISGRI_energy_cal_cache_struct;
+
+
+/* calibration files read ahead by a thread (calPrefetch) */
+typedef struct {
+    pthread_t thread;
+    int       started,
+              numFiles;
+    char      files[ISGRI_PREFETCH_FILES][DAL_FILE_NAME_STRING];
+    double    bytes,                    /* read ahead */
+              wall;                     /* s, of the thread */
+} ISGRI_energy_prefetch_struct;
+
+/* library: calibration handle for events given as arrays; the functions
+   are not thread-safe (global DAL3GEN random generator, DAL, forked
+   workers): calls must not overlap, even with different handles */
+typedef struct {
+    ISGRI_energy_caldb_dols_struct   dols;
+    ISGRI_energy_cal_cache_struct    cache;
+    ibis_isgr_energy_settings_struct settings;
+    char   hkDOL[DAL_FILE_NAME_STRING];  /* group with the HK, "" for none */
+    OBTime obtStart,                     /* events the calibration was loaded for */
+           obtEnd;
+    int    calibrated,
+           chatter;
+} ISGRI_energy_library_struct;
+
+int ibis_isgr_energyLibOpen(ISGRI_energy_library_struct **ptr_library,
+                        const char   *lut1DOL,
+                        const char   *mcecDOL,
+                        const char   *lut2DOL,
+                        const char   *l2reDOL,
+                        const char   *hkDOL,
+                        int           nThreads,
+                        int           chatter,
+                        int           status);
+
+int ibis_isgr_energyLibCorrect(ISGRI_energy_library_struct *ptr_library,
+                        long             numEvents,
+                        const DAL3_Word *isgriPha,
+                        const DAL3_Byte *riseTime,
+                        const DAL3_Byte *isgriY,
+                        const DAL3_Byte *isgriZ,
+                        const OBTime    *obt,
+                        unsigned long    seed,
+                        DAL3_Byte       *isgriPi,
+                        float           *isgriEnergy,
+                        int              status);
+
+void ibis_isgr_energyLibClose(ISGRI_energy_library_struct *ptr_library);
+
+int ibis_isgr_energyCalibrate(dal_element *workGRP,
+                        dal_element *hkGRP,
+                        IBIS_events_struct *ptr_IBIS_events,
+                        ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                        ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                        ISGRI_energy_stats_struct *ptr_stats,
+                        int chatter,
+                        int status);
+
+int ibis_isgr_energyCorrectEvents(dal_element *workGRP,
+                        dal_element *hkGRP,
+                        IBIS_events_struct *ptr_IBIS_events,
+                        ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                        ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                        ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                        int calibrate,
+                        ISGRI_energy_stats_struct *ptr_stats,
+                        int chatter,
+                        int status);
 
 int ibis_isgr_energyWork(dal_element *workGRP,
                         ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
                         ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                        ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                        int chatter,
+                        int status);
+
+int ibis_isgr_energyCheckOut(IBIS_events_struct *ptr_IBIS_events,
+                        dal_element *workGRP,
+                        char         *outName,
+                        ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                        int           chatter,
+                        int           status);
+
+int ibis_isgr_energyStampOut(dal_element *workGRP,
+                        char         *outName,
+                        ISGRI_energy_stats_struct *ptr_stats,
+                        char         *fingerprint,
+                        int           status);
+
+long ibis_isgr_energyRowBytes(dal_element *outTable);
+
+int ibis_isgr_energyWriteRows(dal_element *outTable,
+                        long          firstRow,
+                        long          numRows,
+                        DAL3_Byte    *isgriPi,
+                        float        *isgriEnergy,
+                        int           status);
+
+int ibis_isgr_energyPrepareOut(dal_element *workGRP,
+                        char         *outName,
+                        long          numEvents,
+                        ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                        dal_element **outTable,
+                        int           chatter,
+                        int           status);
+
+int ibis_isgr_energyStreamHeader(dal_element *workGRP,
+                        int           gti,
+                        ISGRI_energy_arena_struct *ptr_arena,
+                        ISGRI_energy_rows_struct *ptr_rows,
+                        IBIS_events_struct *ptr_IBIS_events,
+                        dal_element **rawTable,
+                        int           chatter,
+                        int           status);
+
+int ibis_isgr_energyBlockAlloc(ISGRI_energy_block_struct *ptr_block,
+                        long          maxRows,
+                        ISGRI_energy_arena_struct *ptr_arena,
+                        int           status);
+
+void ibis_isgr_energyBlockFree(ISGRI_energy_block_struct *ptr_block);
+
+int ibis_isgr_energyBlockRead(dal_element *rawTable,
+                        long          firstRow,
+                        long          numRows,
+                        ISGRI_energy_rows_struct *ptr_rows,
+                        ISGRI_energy_block_struct *ptr_block,
+                        int           status);
+
+void ibis_isgr_energyBlockFill(ISGRI_energy_rows_struct *ptr_rows,
+                        ISGRI_energy_block_struct *ptr_block);
+
+void ibis_isgr_energyBlockSpectra(ISGRI_energy_rows_struct *ptr_rows,
+                        ISGRI_energy_block_struct *ptr_block,
+                        ISGRI_energy_spectra_struct *ptr_spectra);
+
+void ibis_isgr_energySpectraAdd(ISGRI_energy_spectra_struct *ptr_spectra,
+                        long          numEvents,
+                        const DAL3_Byte *isgriY,
+                        const DAL3_Byte *isgriZ,
+                        const DAL3_Byte *riseTime,
+                        const DAL3_Byte *isgriPi,
+                        const float  *isgriEnergy);
+
+int ibis_isgr_energySpectraHas(char *spectraFile,
+                        char         *fingerprint);
+
+void ibis_isgr_energyPrefetchStart(ISGRI_energy_prefetch_struct *ptr_prefetch,
+                        dal_element  *workGRP,
+                        ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                        ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                        char         *hkCnvDOL,
+                        int           chatter);
+
+void ibis_isgr_energyPrefetchJoin(ISGRI_energy_prefetch_struct *ptr_prefetch,
+                        int           chatter);
+
+double ibis_isgr_energyQuantumStep(double tolerance);
+
+void ibis_isgr_energyQuantize(float *isgriEnergy,
+                        long          numEvents,
+                        double        step);
+
+int ibis_isgr_energyCompressFile(char *fileName,
+                        char         *extName,
+                        char         *outName,
+                        double        tolerance,
+                        int           chatter,
+                        int           status);
+
+int ibis_isgr_energyCompressOut(ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                        int           chatter,
+                        int           status);
+
+int ibis_isgr_energySpectraWrite(char *spectraFile,
+                        ISGRI_energy_spectra_struct *ptr_spectra,
+                        char         *swid,
+                        char         *fingerprint,
+                        int           chatter,
+                        int           status);
+
+int ibis_isgr_energyPrpObt(dal_element *workGRP,
+                        long          firstRow,
+                        long          lastRow,
+                        OBTime       *obtStart,
+                        OBTime       *obtEnd,
+                        int           status);
+
+int ibis_isgr_energyGtiRows(dal_element *workGRP,
+                        long          numEvents,
+                        ISGRI_energy_arena_struct *ptr_arena,
+                        ISGRI_energy_rows_struct *ptr_rows,
+                        int           chatter,
+                        int           status);
+
+int ibis_isgr_energyBlockWrite(dal_element *outTable,
+                        ISGRI_energy_block_struct *ptr_block,
+                        int           status);
+
+void ibis_isgr_energyBlockView(IBIS_events_struct *ptr_header,
+                        ISGRI_energy_block_struct *ptr_block,
+                        IBIS_events_struct *ptr_view);
+
+long ibis_isgr_energyBlockRows(long streamRows);
+
+int ibis_isgr_energyStream(dal_element *workGRP,
+                        dal_element  *rawTable,
+                        char         *outName,
+                        ISGRI_energy_calibration_struct *ptr_ISGRI_energy_calibration,
+                        IBIS_events_struct *ptr_IBIS_events,
+                        ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                        int           chatter,
+                        int           status);
+
+int ibis_isgr_energyPipeline(dal_element *workGRP,
+                        dal_element  *rawTable,
+                        char         *outName,
+                        ISGRI_energy_calibration_struct *ptr_ISGRI_energy_calibration,
+                        IBIS_events_struct *ptr_IBIS_events,
+                        ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                        int           chatter,
+                        int           status);
+
+int ibis_isgr_energyBatch(ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                        ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                        ISGRI_energy_cal_cache_struct *ptr_cal_cache,
                         int chatter,
                         int status);
 
+char *ibis_isgr_energyListEntry(char *line);
+
+int ibis_isgr_energyDriver(ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                        ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                        int chatter,
+                        int status);
+
+int ibis_isgr_energyRun(ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                        ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                        ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                        int          *ptr_chatter,
+                        int           status);
+
+int ibis_isgr_energyDaemon(char *socketName,
+                        ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                        int           status);
+
+int ibis_isgr_energyClient(char *socketName,
+                        int          *ptr_served,
+                        int           status);
+
+void ibis_isgr_energyEventsView(IBIS_events_struct *ptr_IBIS_events,
+                        long          first,
+                        long          numEvents,
+                        IBIS_events_struct *ptr_view);
+
+void ibis_isgr_energyEventsFree(IBIS_events_struct *ptr_IBIS_events);
+
+unsigned long ibis_isgr_energyBlockSeed(unsigned long seed,
+                        long          block);
+
+int ibis_isgr_energyReconstruct(ISGRI_energy_calibration_struct *ptr_ISGRI_energy_calibration,
+                        IBIS_events_struct *ptr_IBIS_events,
+                        unsigned long seed,
+                        long          firstBlock,
+                        int           numWorkers,
+                        pthread_mutex_t *dalLock,
+                        ISGRI_energy_spectra_struct *ptr_spectra,
+                        int           chatter,
+                        int           status);
+
+int ibis_isgr_energyCorrect(ISGRI_energy_calibration_struct *ptr_ISGRI_energy_calibration,
+                        IBIS_events_struct *ptr_IBIS_events,
+                        ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                        long          firstBlock,
+                        int           numWorkers,
+                        ISGRI_energy_spectra_struct *ptr_spectra,
+                        int           chatter,
+                        int           status);
+
+void *ibis_isgr_energyArenaAlloc(ISGRI_energy_arena_struct *ptr_arena,
+                        size_t        size);
+
+void ibis_isgr_energyArenaMark(ISGRI_energy_arena_struct *ptr_arena,
+                        ISGRI_energy_arena_mark_struct *ptr_mark);
+
+void ibis_isgr_energyArenaRewind(ISGRI_energy_arena_struct *ptr_arena,
+                        ISGRI_energy_arena_mark_struct *ptr_mark);
+
+void ibis_isgr_energyArenaRelease(ISGRI_energy_arena_struct *ptr_arena,
+                        int           chatter);
+
+void ibis_isgr_energyStatsBegin(ISGRI_energy_stats_struct *ptr_stats,
+                        char         *name);
+
+void ibis_isgr_energyStatsEnd(ISGRI_energy_stats_struct *ptr_stats,
+                        long          rows);
+
+int ibis_isgr_energyStatsKeywords(dal_element *outTable,
+                        ISGRI_energy_stats_struct *ptr_stats,
+                        int           status);
+
+double ibis_isgr_energyWorkersCpu(void);
+
+void ibis_isgr_energyStatsJson(FILE *fp,
+                        ISGRI_energy_stats_struct *ptr_stats,
+                        int           runStatus);
+
+void ibis_isgr_energyStatsJsonString(FILE *fp,
+                        const char   *string);
+
+int ibis_isgr_energyStatsReport(dal_element *workGRP,
+                        ISGRI_energy_stats_struct *ptr_stats,
+                        int           runStatus,
+                        char         *statsFile,
+                        int           chatter,
+                        int           status);
+
+int ibis_isgr_energyFingerprint(dal_element *workGRP,
+                        ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                        ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                        char         *fingerprint,
+                        int           chatter,
+                        int           status);
+
+unsigned long long ibis_isgr_energyFingerprintHash(const char *string);
+
+int ibis_isgr_energyUpToDate(dal_element *workGRP,
+                        char         *outName,
+                        char         *fingerprint);
+
+int ibis_isgr_energyCalSnapshotBuild(char *snapName,
+                        ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                        int   chatter,
+                        int   status);
+
+int ibis_isgr_energyCalSnapshot(char *snapName,
+                        ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                        int   chatter,
+                        int   status);
+
+int ibis_isgr_energyScwTime(dal_element *workGRP,
+                        double      *tStart,
+                        double      *tStop,
+                        int          status);
+
+int ibis_isgr_energyCalMember(char *DOL,
+                        char        *dsName,
+                        double       tStart,
+                        double       tStop,
+                        char        *member,
+                        double      *vStart,
+                        double      *vStop,
+                        int          status);
+
+int ibis_isgr_energyCalLookup(ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                        ISGRI_energy_cal_cache_entry_struct *ptr_entry,
+                        char        *DOL,
+                        char        *dsName,
+                        double       tStart,
+                        double       tStop,
+                        int          chatter,
+                        int          status);
+
+int ibis_isgr_energyCalSelect(ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                        ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
+                        double       tStart,
+                        double       tStop,
+                        int          chatter,
+                        int          status);
+
+int ibis_isgr_energyCalRelease(ISGRI_energy_cal_cache_struct *ptr_cal_cache,
+                        int          status);
+
+int ibis_isgr_energyOpenGroup(char *grpDOL,
+                        ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
+                        dal_element **ptr_workGRP,
+                        int          status);
+
+void ibis_isgr_energyGroupMember(char *grpDOL,
+                        char         *dsName,
+                        char         *fileName);
+
 
 int ibis_isgr_energyCheckIn(
                          char         *acorName,
@@ -180,12 +776,6 @@ int ibis_isgr_energyReadData(dal_element *workGRP,
                          DAL3_Byte **isZ);
 
 
-int ibis_isgr_energyWork(dal_element *workGRP,
-                        ibis_isgr_energy_settings_struct *ptr_ibis_isgr_energy_settings,
-                        ISGRI_energy_caldb_dols_struct *ptr_ISGRI_energy_caldb_dols,
-                        int chatter,
-                        int status);
-
 
 int ibis_isgr_energyReadCal(dal_element *isgrOffsTabPtr,
                          dal_element    *isgrRiseTabPtr,